@@ -0,0 +1,334 @@
+#include <QColor>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTextStream>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "plotrenderer.h"
+#include "workstealingpool.h"
+#include "tracer.h"
+
+// Пакетная отрисовка графиков без окна: задания читаются из JSON-файла, каждое
+// рисуется на QImage теми же функциями, что и в PlotWidget (PlotRenderer), и
+// сохраняется в PNG. Задания распределяются по ядрам через WorkStealingPool.
+// С --benchmark файлы не пишутся, а каждое задание повторяется --repeat раз —
+// так утилита служит бенчмарком пропускной способности всего конвейера.
+//
+// Формат файла заданий:
+//   {
+//     "defaults": {"width": 800, "height": 600, "viewport": [-10, 10, -10, 10]},
+//     "jobs": [
+//       {"output": "sin.png", "functions": ["sin(x)"]},
+//       {"output": "two.png", "width": 1920, "height": 1080,
+//        "functions": [{"expression": "x^2", "color": "#d03030", "width": 2}, "cos(x)"]}
+//     ]
+//   }
+// viewport — [xMin, xMax, yMin, yMax]; вместо объекта можно передать сразу массив заданий.
+//
+//   function_plotter_render jobs.json -o out
+//   function_plotter_render jobs.json --benchmark --repeat 20 --threads 4
+
+namespace {
+
+void silentMessageHandler(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+struct CurveSpec {
+    QString expression;
+    QColor color = Qt::blue;
+    qreal width = 2.5;
+};
+
+struct RenderJob {
+    QString output;
+    ViewportSnapshot viewport;
+    QVector<CurveSpec> curves;
+};
+
+// Итог одного задания; пишется только потоком, который его выполнял
+struct JobResult {
+    bool ok = true;
+    QString error;
+    qint64 samplingNs = 0;
+    qint64 paintNs = 0;
+    qint64 saveNs = 0;
+    qint64 evaluations = 0;
+};
+
+// Рабочее состояние одного слота пула: буферы переиспользуются между заданиями
+struct SlotState {
+    PlotRenderer renderer;
+    SampleBuffer points;
+    SamplerScratch scratch;
+};
+
+// Накладывает на задание поля объекта: сначала defaults, затем само задание
+bool applyJobFields(const QJsonObject &object, RenderJob &job, QString &error)
+{
+    if (object.contains("output")) {
+        job.output = object.value("output").toString();
+    }
+    QSize size = job.viewport.size;
+    if (object.contains("width")) {
+        size.setWidth(object.value("width").toInt());
+    }
+    if (object.contains("height")) {
+        size.setHeight(object.value("height").toInt());
+    }
+    job.viewport.size = size;
+
+    if (object.contains("viewport")) {
+        const QJsonArray bounds = object.value("viewport").toArray();
+        if (bounds.size() != 4) {
+            error = "viewport должен содержать четыре числа: xMin, xMax, yMin, yMax";
+            return false;
+        }
+        job.viewport.xMin = bounds.at(0).toDouble();
+        job.viewport.xMax = bounds.at(1).toDouble();
+        job.viewport.yMin = bounds.at(2).toDouble();
+        job.viewport.yMax = bounds.at(3).toDouble();
+    }
+
+    if (object.contains("functions")) {
+        job.curves.clear();
+        for (const QJsonValue &value : object.value("functions").toArray()) {
+            CurveSpec curve;
+            if (value.isString()) {
+                curve.expression = value.toString();
+            } else {
+                const QJsonObject spec = value.toObject();
+                curve.expression = spec.value("expression").toString();
+                if (spec.contains("color")) {
+                    curve.color = QColor(spec.value("color").toString());
+                }
+                curve.width = spec.value("width").toDouble(curve.width);
+            }
+            job.curves.append(curve);
+        }
+    }
+    return true;
+}
+
+bool loadJobs(const QString &fileName, QVector<RenderJob> &jobs, QString &error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = "не удалось открыть " + fileName;
+        return false;
+    }
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (document.isNull()) {
+        error = parseError.errorString();
+        return false;
+    }
+
+    RenderJob defaults;
+    defaults.viewport.size = QSize(800, 600);
+    QJsonArray list;
+    if (document.isArray()) {
+        list = document.array();
+    } else {
+        if (!applyJobFields(document.object().value("defaults").toObject(), defaults, error)) {
+            return false;
+        }
+        list = document.object().value("jobs").toArray();
+    }
+
+    for (int i = 0; i < list.size(); ++i) {
+        RenderJob job = defaults;
+        if (!applyJobFields(list.at(i).toObject(), job, error)) {
+            error = QString("задание %1: %2").arg(i).arg(error);
+            return false;
+        }
+        if (job.viewport.size.isEmpty() || job.viewport.xMin >= job.viewport.xMax ||
+            job.viewport.yMin >= job.viewport.yMax) {
+            error = QString("задание %1: пустой размер или область просмотра").arg(i);
+            return false;
+        }
+        if (job.output.isEmpty()) {
+            job.output = QString("plot_%1.png").arg(i, 4, 10, QLatin1Char('0'));
+        }
+        jobs.append(job);
+    }
+    return true;
+}
+
+// Вычисляет точки и рисует одно задание; image остаётся у вызывающего
+void renderJob(const RenderJob &job, SlotState &state, QImage &image, JobResult &result)
+{
+    TraceScope trace("renderJob", "batch");
+    if (image.size() != job.viewport.size) {
+        image = QImage(job.viewport.size, QImage::Format_ARGB32_Premultiplied);
+    }
+    state.renderer.setViewport(job.viewport);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    StageTimer stage;
+    state.renderer.drawBackground(painter);
+    state.renderer.drawGrid(painter);
+    state.renderer.drawAxes(painter);
+    state.renderer.drawAxisLabels(painter);
+    result.paintNs += stage.lap();
+
+    for (const CurveSpec &curve : job.curves) {
+        try {
+            Function func(curve.expression, curve.color);
+            func.width = curve.width;
+            int evaluations = 0;
+            FunctionSampler::calculatePoints(func, job.viewport, state.points, FunctionSampler::CancelCheck(),
+                                             &evaluations, nullptr, &state.scratch);
+            result.evaluations += evaluations;
+            result.samplingNs += stage.lap();
+            state.renderer.drawFunction(painter, func.expression, func, state.points);
+            result.paintNs += stage.lap();
+        }
+        catch (const mu::Parser::exception_type &e) {
+            result.ok = false;
+            result.error = QString("%1: %2").arg(curve.expression, QString::fromStdString(e.GetMsg()));
+        }
+        catch (const std::exception &e) {
+            result.ok = false;
+            result.error = QString("%1: %2").arg(curve.expression, QString::fromUtf8(e.what()));
+        }
+    }
+}
+
+QString formatMs(qint64 ns)
+{
+    return QString::number(ns / 1e6, 'f', 2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Окна не открываются: шрифты и растеризация работают и без дисплея
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Пакетная отрисовка графиков в PNG");
+    parser.addHelpOption();
+    parser.addPositionalArgument("jobs", "Файл заданий в формате JSON.");
+    QCommandLineOption outputOption({"o", "output-dir"}, "Каталог для PNG (по умолчанию текущий).", "dir", ".");
+    QCommandLineOption threadsOption("threads", "Число потоков (по умолчанию по числу ядер).", "count");
+    QCommandLineOption benchmarkOption("benchmark", "Только замер: файлы не сохраняются.");
+    QCommandLineOption repeatOption("repeat", "Сколько раз выполнить каждое задание.", "count", "1");
+    QCommandLineOption traceOption("trace", "Записать трассу Chrome Trace Event в файл.", "file");
+    parser.addOptions({outputOption, threadsOption, benchmarkOption, repeatOption, traceOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    if (parser.isSet(traceOption)) {
+        Tracer::start(parser.value(traceOption).toStdString());
+        Tracer::setThreadName("main");
+    }
+
+    QVector<RenderJob> jobs;
+    QString error;
+    if (!loadJobs(parser.positionalArguments().first(), jobs, error)) {
+        err << "Ошибка в файле заданий: " << error << '\n';
+        return 1;
+    }
+
+    const bool benchmark = parser.isSet(benchmarkOption);
+    const int repeat = std::max(1, parser.value(repeatOption).toInt());
+    const QDir outputDir(parser.value(outputOption));
+    if (!benchmark && !outputDir.exists() && !QDir().mkpath(outputDir.path())) {
+        err << "Не удалось создать каталог " << outputDir.path() << '\n';
+        return 1;
+    }
+
+    // Отладочный вывод парсера из рабочих потоков только мешает
+    qInstallMessageHandler(silentMessageHandler);
+
+    // Общий пул приложения или свой, если число потоков задано явно. По умолчанию
+    // вычисление точек внутри задания тоже идёт через общий пул: вложенный run
+    // допустим. С --threads задание считает точки в своём потоке, иначе общий пул
+    // занял бы все ядра в обход заданного числа потоков
+    std::unique_ptr<WorkStealingPool> ownPool;
+    WorkStealingPool *pool = &WorkStealingPool::instance();
+    if (parser.isSet(threadsOption)) {
+        ownPool.reset(new WorkStealingPool(std::max(0, parser.value(threadsOption).toInt() - 1)));
+        pool = ownPool.get();
+        Function::parallelEvaluationEnabled = false;
+    }
+
+    std::vector<SlotState> slots(pool->slotCount());
+    std::vector<QImage> images(pool->slotCount());
+    std::vector<JobResult> results(jobs.size() * repeat);
+    std::atomic<qint64> pixels{0};
+
+    QElapsedTimer timer;
+    timer.start();
+    pool->run(static_cast<int>(results.size()), [&](int index, int slot) {
+        const RenderJob &job = jobs[index % jobs.size()];
+        JobResult &result = results[index];
+        renderJob(job, slots[slot], images[slot], result);
+        pixels.fetch_add(qint64(job.viewport.size.width()) * job.viewport.size.height(),
+                         std::memory_order_relaxed);
+        // Файл пишется один раз, при первом повторе задания
+        if (!benchmark && index < jobs.size()) {
+            StageTimer stage;
+            if (!images[slot].save(outputDir.filePath(job.output), "PNG")) {
+                result.ok = false;
+                result.error = "не удалось сохранить " + job.output;
+            }
+            result.saveNs = stage.lap();
+        }
+    });
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    int failed = 0;
+    JobResult total;
+    for (int i = 0; i < static_cast<int>(results.size()); ++i) {
+        const JobResult &result = results[i];
+        if (!result.ok) {
+            ++failed;
+            if (i < jobs.size()) {
+                err << jobs[i].output << ": " << result.error << '\n';
+            }
+        }
+        total.samplingNs += result.samplingNs;
+        total.paintNs += result.paintNs;
+        total.saveNs += result.saveNs;
+        total.evaluations += result.evaluations;
+    }
+
+    const double seconds = elapsedNs / 1e9;
+    const int count = static_cast<int>(results.size());
+    QTextStream out(stdout);
+    out << "изображений: " << count << ", потоков: " << pool->slotCount()
+        << ", время: " << formatMs(elapsedNs) << " мс\n";
+    out << "изображений/с: " << QString::number(count / seconds, 'f', 1)
+        << ", Мпикс/с: " << QString::number(pixels.load() / 1e6 / seconds, 'f', 1)
+        << ", вычислений функций: " << total.evaluations << '\n';
+    // Сумма по всем потокам: показывает, на что уходит процессорное время
+    out << "на изображение, мс: вычисление " << formatMs(total.samplingNs / count)
+        << ", отрисовка " << formatMs(total.paintNs / count);
+    if (!benchmark) {
+        out << ", сохранение " << formatMs(total.saveNs / jobs.size());
+    }
+    out << '\n';
+    out.flush();
+
+    Tracer::stop();
+    return failed > 0 ? 1 : 0;
+}
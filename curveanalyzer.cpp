@@ -0,0 +1,465 @@
+#include "curveanalyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "tracer.h"
+
+namespace {
+
+constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+constexpr double Epsilon = std::numeric_limits<double>::epsilon();
+
+// Смены знака в values: exact(i) — значение в точке i ровно ноль, bracket(i) —
+// знак меняется между точками i и i + 1. Обработчики возвращают false, чтобы
+// остановить просмотр; тогда и сама функция возвращает false
+template <typename Exact, typename Bracket>
+bool scanSignChanges(const double *values, int count, const Exact &exact, const Bracket &bracket)
+{
+    for (int i = 0; i < count; ++i) {
+        const double value = values[i];
+        if (!std::isfinite(value)) {
+            continue;
+        }
+        if (value == 0.0) {
+            // Ноль, который тянется по нескольким точкам, — одна особая точка
+            if ((i == 0 || values[i - 1] != 0.0) && !exact(i)) {
+                return false;
+            }
+            continue;
+        }
+        if (i + 1 < count) {
+            const double next = values[i + 1];
+            if (std::isfinite(next) && next != 0.0 && (value < 0) != (next < 0) && !bracket(i)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Значение функции в одной точке
+double evaluateAt(const Function &function, double x, int *evaluations)
+{
+    double y = NaN;
+    function.evaluateBatch(&x, &y, 1);
+    if (evaluations) {
+        ++*evaluations;
+    }
+    return y;
+}
+
+} // namespace
+
+void CurveAnalysisCache::evict()
+{
+    if (entries.size() <= DefaultCapacity) {
+        return;
+    }
+    // Удаляем записи, к которым дольше всего не обращались; текущие не трогаем
+    QVector<QPair<quint64, Key>> order;
+    order.reserve(entries.size());
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        if (it->lastUse != useCounter) {
+            order.append({it->lastUse, it.key()});
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const QPair<quint64, Key> &a, const QPair<quint64, Key> &b) {
+        return a.first < b.first;
+    });
+    for (const auto &entry : order) {
+        if (entries.size() <= DefaultCapacity) {
+            break;
+        }
+        entries.remove(entry.second);
+    }
+}
+
+double CurveAnalyzer::findRoot(const Evaluate &f, double a, double b, double fa, double fb,
+                               double tolerance, int *evaluations)
+{
+    if (fa == 0.0) {
+        return a;
+    }
+    if (fb == 0.0) {
+        return b;
+    }
+    if (!std::isfinite(fa) || !std::isfinite(fb) || (fa > 0) == (fb > 0)) {
+        return NaN;
+    }
+    // Корень всё время лежит между b и c; b — лучшее приближение, a — предыдущее
+    double c = b;
+    double fc = fb;
+    double d = b - a;
+    double e = d;
+    for (int iteration = 0; iteration < MaxIterations; ++iteration) {
+        if ((fb > 0 && fc > 0) || (fb < 0 && fc < 0)) {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if (std::abs(fc) < std::abs(fb)) {
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+        const double tol = 2.0 * Epsilon * std::abs(b) + 0.5 * tolerance;
+        const double middle = 0.5 * (c - b);
+        if (std::abs(middle) <= tol || fb == 0.0) {
+            return b;
+        }
+        if (std::abs(e) >= tol && std::abs(fa) > std::abs(fb)) {
+            // Секущая (a == c) или обратная квадратичная интерполяция
+            const double s = fb / fa;
+            double p;
+            double q;
+            if (a == c) {
+                p = 2.0 * middle * s;
+                q = 1.0 - s;
+            } else {
+                const double r = fb / fc;
+                q = fa / fc;
+                p = s * (2.0 * middle * q * (q - r) - (b - a) * (r - 1.0));
+                q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+            }
+            if (p > 0) {
+                q = -q;
+            }
+            p = std::abs(p);
+            // Шаг принимается, только если он уменьшает отрезок быстрее деления пополам
+            if (2.0 * p < std::min(3.0 * middle * q - std::abs(tol * q), std::abs(e * q))) {
+                e = d;
+                d = p / q;
+            } else {
+                d = middle;
+                e = d;
+            }
+        } else {
+            d = middle;
+            e = d;
+        }
+        a = b;
+        fa = fb;
+        b += std::abs(d) > tol ? d : std::copysign(tol, middle);
+        fb = f(b);
+        if (evaluations) {
+            ++*evaluations;
+        }
+        if (!std::isfinite(fb)) {
+            return NaN;
+        }
+    }
+    return NaN;
+}
+
+double CurveAnalyzer::findMinimum(const Evaluate &f, double a, double b, double x, double fx,
+                                  double tolerance, int *evaluations)
+{
+    // Доля золотого сечения
+    constexpr double golden = 0.3819660112501051;
+    const double relative = std::sqrt(Epsilon);
+    // x — лучшая точка, w — вторая по значению, v — предыдущее значение w
+    double w = x;
+    double v = x;
+    double fw = fx;
+    double fv = fx;
+    double d = 0.0;
+    double e = 0.0;
+    for (int iteration = 0; iteration < MaxIterations; ++iteration) {
+        const double middle = 0.5 * (a + b);
+        const double tol = relative * std::abs(x) + tolerance;
+        if (std::abs(x - middle) <= 2.0 * tol - 0.5 * (b - a)) {
+            return x;
+        }
+        bool parabolic = false;
+        if (std::abs(e) > tol) {
+            // Парабола через x, w и v
+            const double r = (x - w) * (fx - fv);
+            double q = (x - v) * (fx - fw);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2.0 * (q - r);
+            if (q > 0) {
+                p = -p;
+            }
+            q = std::abs(q);
+            const double previous = e;
+            e = d;
+            if (std::abs(p) < std::abs(0.5 * q * previous) && p > q * (a - x) && p < q * (b - x)) {
+                d = p / q;
+                const double u = x + d;
+                if (u - a < 2.0 * tol || b - u < 2.0 * tol) {
+                    d = std::copysign(tol, middle - x);
+                }
+                parabolic = true;
+            }
+        }
+        if (!parabolic) {
+            e = x >= middle ? a - x : b - x;
+            d = golden * e;
+        }
+        const double u = std::abs(d) >= tol ? x + d : x + std::copysign(tol, d);
+        const double fu = f(u);
+        if (evaluations) {
+            ++*evaluations;
+        }
+        if (fu <= fx) {
+            (u >= x ? a : b) = x;
+            v = w;
+            fv = fw;
+            w = x;
+            fw = fx;
+            x = u;
+            fx = fu;
+        } else {
+            (u < x ? a : b) = u;
+            if (fu <= fw || w == x) {
+                v = w;
+                fv = fw;
+                w = u;
+                fw = fu;
+            } else if (fu <= fv || v == x || v == w) {
+                v = u;
+                fv = fu;
+            }
+        }
+    }
+    return x;
+}
+
+bool CurveAnalyzer::refined(CurveAnalysisCache *cache, CurveFeature::Kind kind, double a, double b,
+                            const std::function<bool(double &x, double &y)> &refine, double &x, double &y)
+{
+    if (!cache) {
+        return refine(x, y);
+    }
+    const CurveAnalysisCache::Key key{kind, a, b};
+    auto entry = cache->entries.find(key);
+    if (entry != cache->entries.end()) {
+        ++cache->last.hits;
+    } else {
+        ++cache->last.misses;
+        CurveAnalysisCache::Entry computed;
+        computed.found = refine(computed.x, computed.y);
+        entry = cache->entries.insert(key, computed);
+    }
+    entry->lastUse = cache->useCounter;
+    x = entry->x;
+    y = entry->y;
+    return entry->found;
+}
+
+bool CurveAnalyzer::analyzeFunction(const Function &function, const SampleBuffer &points,
+                                    const ViewportSnapshot &viewport, QVector<CurveFeature> &features,
+                                    CurveAnalysisCache *cache, const CancelCheck &cancelled, int *evaluations)
+{
+    TraceScope trace("analyzeFunction", "analysis", points.size());
+    if (cache) {
+        ++cache->useCounter;
+        cache->last = CurveAnalysisCache::Stats();
+    }
+    const int count = points.size();
+    const double *xs = points.xs.data();
+    const double *ys = points.ys.data();
+    // Уточняем до тысячной доли пикселя
+    const double tolerance = 1e-3 * (viewport.xMax - viewport.xMin) / std::max(1, viewport.size.width());
+    const Evaluate f = [&function, evaluations](double x) {
+        return evaluateAt(function, x, evaluations);
+    };
+    const Evaluate negated = [&f](double x) {
+        return -f(x);
+    };
+    auto visible = [&viewport](double x) {
+        return x >= viewport.xMin && x <= viewport.xMax;
+    };
+    auto add = [&features, &function](CurveFeature::Kind kind, double x, double y) {
+        CurveFeature feature;
+        feature.kind = kind;
+        feature.x = x;
+        feature.y = y;
+        feature.expression = function.expression;
+        features.append(feature);
+    };
+
+    bool stopped = false;
+    int roots = 0;
+    scanSignChanges(ys, count, [&](int i) {
+        if (visible(xs[i])) {
+            add(CurveFeature::Root, xs[i], 0.0);
+            ++roots;
+        }
+        return roots < MaxFeatures;
+    }, [&](int i) {
+        if (cancelled && cancelled()) {
+            stopped = true;
+            return false;
+        }
+        const double a = xs[i];
+        const double b = xs[i + 1];
+        if (b < viewport.xMin || a > viewport.xMax) {
+            return true;
+        }
+        double x;
+        double y;
+        const bool found = refined(cache, CurveFeature::Root, a, b, [&](double &root, double &value) {
+            root = findRoot(f, a, b, ys[i], ys[i + 1], tolerance);
+            if (!std::isfinite(root)) {
+                return false;
+            }
+            // Смена знака через полюс (tan у π/2) или скачок: значение не уменьшилось
+            value = f(root);
+            return std::abs(value) <= std::min(std::abs(ys[i]), std::abs(ys[i + 1]));
+        }, x, y);
+        if (found && visible(x)) {
+            add(CurveFeature::Root, x, y);
+            ++roots;
+        }
+        return roots < MaxFeatures;
+    });
+
+    int extrema = 0;
+    for (int i = 1; i + 1 < count && extrema < MaxFeatures && !stopped; ++i) {
+        const double y0 = ys[i - 1];
+        const double y1 = ys[i];
+        const double y2 = ys[i + 1];
+        if (!std::isfinite(y0) || !std::isfinite(y1) || !std::isfinite(y2) ||
+            xs[i + 1] < viewport.xMin || xs[i - 1] > viewport.xMax) {
+            continue;
+        }
+        // Разницы на уровне ошибок округления (sin^2 + cos^2) экстремумами не считаем
+        const double noise = 64.0 * Epsilon * std::max({std::abs(y0), std::abs(y1), std::abs(y2)});
+        const double rise = y1 - y0;
+        const double fall = y2 - y1;
+        if (std::abs(rise) <= noise || std::abs(fall) <= noise || (rise > 0) == (fall > 0)) {
+            continue;
+        }
+        if (cancelled && cancelled()) {
+            stopped = true;
+            break;
+        }
+        const CurveFeature::Kind kind = rise < 0 ? CurveFeature::Minimum : CurveFeature::Maximum;
+        const double a = xs[i - 1];
+        const double b = xs[i + 1];
+        double x;
+        double y;
+        const bool found = refined(cache, kind, a, b, [&](double &extremum, double &value) {
+            const double sign = kind == CurveFeature::Minimum ? 1.0 : -1.0;
+            extremum = findMinimum(kind == CurveFeature::Minimum ? f : negated, a, b, xs[i], sign * y1,
+                                   tolerance);
+            value = f(extremum);
+            // У гладкой функции уточнённое значение отличается от выборочного меньше,
+            // чем соседние точки выборки друг от друга; у полюса — неограниченно
+            return std::isfinite(value) && std::abs(value - y1) <= std::abs(rise) + std::abs(fall);
+        }, x, y);
+        if (found && visible(x)) {
+            add(kind, x, y);
+            ++extrema;
+        }
+    }
+
+    if (cache) {
+        cache->evict();
+    }
+    return !stopped;
+}
+
+bool CurveAnalyzer::findIntersections(const Function &first, const SampleBuffer &firstPoints,
+                                      const Function &second, const SampleBuffer &secondPoints,
+                                      const ViewportSnapshot &viewport, QVector<CurveFeature> &features,
+                                      CurveAnalysisCache *cache, const CancelCheck &cancelled, int *evaluations)
+{
+    TraceScope trace("findIntersections", "analysis", firstPoints.size());
+    if (cache) {
+        ++cache->useCounter;
+        cache->last = CurveAnalysisCache::Stats();
+    }
+    // Разность f - g в точках first; g интерполируется между соседними точками second
+    const int count = firstPoints.size();
+    const double *xs = firstPoints.xs.data();
+    const double *ys = firstPoints.ys.data();
+    const int secondCount = secondPoints.size();
+    std::vector<double> differences(count, NaN);
+    int j = 0;
+    for (int i = 0; i < count; ++i) {
+        const double x = xs[i];
+        while (j + 1 < secondCount && secondPoints.xs[j + 1] < x) {
+            ++j;
+        }
+        if (j + 1 >= secondCount || secondPoints.xs[j] > x) {
+            continue;
+        }
+        const double x0 = secondPoints.xs[j];
+        const double x1 = secondPoints.xs[j + 1];
+        const double t = x1 > x0 ? (x - x0) / (x1 - x0) : 0.0;
+        differences[i] = ys[i] - (secondPoints.ys[j] + t * (secondPoints.ys[j + 1] - secondPoints.ys[j]));
+    }
+
+    const double tolerance = 1e-3 * (viewport.xMax - viewport.xMin) / std::max(1, viewport.size.width());
+    const Evaluate g = [&second, evaluations](double x) {
+        return evaluateAt(second, x, evaluations);
+    };
+    const Evaluate difference = [&first, &g, evaluations](double x) {
+        return evaluateAt(first, x, evaluations) - g(x);
+    };
+    auto visible = [&viewport](double x) {
+        return x >= viewport.xMin && x <= viewport.xMax;
+    };
+    auto add = [&features, &first, &second](double x, double y) {
+        CurveFeature feature;
+        feature.kind = CurveFeature::Intersection;
+        feature.x = x;
+        feature.y = y;
+        feature.expression = first.expression;
+        feature.other = second.expression;
+        features.append(feature);
+    };
+
+    bool stopped = false;
+    int found = 0;
+    auto accept = [&](double a, double b, const std::function<bool(double &, double &)> &refine) {
+        if (cancelled && cancelled()) {
+            stopped = true;
+            return false;
+        }
+        if (b < viewport.xMin || a > viewport.xMax) {
+            return true;
+        }
+        double x;
+        double y;
+        if (refined(cache, CurveFeature::Intersection, a, b, refine, x, y) && visible(x)) {
+            add(x, y);
+            ++found;
+        }
+        return found < MaxFeatures;
+    };
+    scanSignChanges(differences.data(), count, [&](int i) {
+        // Разность по интерполированной g ровно ноль — проверяем по настоящей g
+        return accept(xs[i], xs[i], [&](double &x, double &y) {
+            x = xs[i];
+            y = ys[i];
+            const double exact = ys[i] - g(x);
+            return std::abs(exact) <= 64.0 * Epsilon * std::max(1.0, std::abs(y));
+        });
+    }, [&](int i) {
+        const double a = xs[i];
+        const double b = xs[i + 1];
+        return accept(a, b, [&](double &x, double &y) {
+            // Знак на концах — по настоящим значениям g, а не интерполированным
+            const double da = ys[i] - g(a);
+            const double db = ys[i + 1] - g(b);
+            x = findRoot(difference, a, b, da, db, tolerance);
+            if (!std::isfinite(x)) {
+                return false;
+            }
+            y = evaluateAt(first, x, evaluations);
+            return std::abs(y - g(x)) <= std::min(std::abs(da), std::abs(db));
+        });
+    });
+
+    if (cache) {
+        cache->evict();
+    }
+    return !stopped;
+}
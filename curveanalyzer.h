@@ -0,0 +1,135 @@
+#ifndef CURVEANALYZER_H
+#define CURVEANALYZER_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include "function.h"
+#include "functionsampler.h"
+#include "samplebuffer.h"
+
+// Особая точка графика функции
+struct CurveFeature {
+    enum Kind {
+        Root,           // f(x) = 0
+        Minimum,        // локальный минимум
+        Maximum,        // локальный максимум
+        Intersection    // f(x) = g(x)
+    };
+
+    Kind kind = Root;
+    double x = 0.0;
+    double y = 0.0;
+    QString expression;
+    // Вторая функция пересечения; у остальных точек пусто
+    QString other;
+};
+
+// Особые точки одного результата. Список неизменяем, пока на него есть ссылки
+using CurveFeatures = std::shared_ptr<const QVector<CurveFeature>>;
+
+// Уточнённые точки по отрезкам между соседними точками выборки. Точки выборки
+// привязаны к узлам SampleCache, поэтому при сдвиге области отрезки повторяются,
+// и уточнять приходится только отрезки открывшейся полосы. Как и в SampleCache,
+// при переполнении удаляются записи, к которым дольше всего не обращались.
+class CurveAnalysisCache
+{
+public:
+    struct Stats {
+        int hits = 0;    // отрезков взято из кэша
+        int misses = 0;  // отрезков уточнено заново
+    };
+
+    static constexpr int DefaultCapacity = 8192;
+
+    void clear() { entries.clear(); }
+    int size() const { return entries.size(); }
+    // Статистика последнего вызова CurveAnalyzer
+    const Stats &lastStats() const { return last; }
+
+private:
+    friend class CurveAnalyzer;
+
+    struct Key {
+        int kind;
+        double a;
+        double b;
+
+        bool operator==(const Key &other) const {
+            return kind == other.kind && a == other.a && b == other.b;
+        }
+    };
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    friend size_t qHash(const Key &key, size_t seed = 0)
+#else
+    friend uint qHash(const Key &key, uint seed = 0)
+#endif
+    {
+        return qHash(key.a, seed) ^ qHash(key.b * 3.0, seed) ^ static_cast<decltype(seed)>(key.kind);
+    }
+
+    // found = false — на отрезке ничего нет (полюс, разрыв, край отрезка)
+    struct Entry {
+        bool found = false;
+        double x = 0.0;
+        double y = 0.0;
+        quint64 lastUse = 0;
+    };
+
+    QHash<Key, Entry> entries;
+    quint64 useCounter = 0;
+    Stats last;
+
+    void evict();
+};
+
+// Поиск корней, экстремумов и пересечений по уже вычисленным точкам графиков.
+// Точки выборки дают только отрезки-кандидаты: смену знака f (корень), смену
+// направления (экстремум) или смену знака f - g (пересечение). Каждый кандидат
+// уточняется методом Брента — для корней комбинацией деления пополам, секущих и
+// обратной квадратичной интерполяции, для экстремумов — золотым сечением с
+// параболической интерполяцией — до долей пикселя. Кандидаты, которые при
+// уточнении оказываются полюсами или разрывами, отбрасываются.
+class CurveAnalyzer
+{
+public:
+    using CancelCheck = std::function<bool()>;
+    using Evaluate = std::function<double(double)>;
+
+    static constexpr int MaxIterations = 100;
+    // Больше точек одного вида на кривой — это уже не отдельные точки
+    // (sin(1/x) у нуля), а шум; остальные не ищутся
+    static constexpr int MaxFeatures = 256;
+
+    // Корень f на [a, b], если fa и fb разных знаков; NaN, если метод не сошёлся
+    static double findRoot(const Evaluate &f, double a, double b, double fa, double fb,
+                           double tolerance, int *evaluations = nullptr);
+    // Минимум f на [a, b]; x — начальная точка внутри отрезка, fx = f(x)
+    static double findMinimum(const Evaluate &f, double a, double b, double x, double fx,
+                              double tolerance, int *evaluations = nullptr);
+
+    // Корни и экстремумы функции по её точкам в области просмотра.
+    // При отмене возвращает false; уточнённое к этому моменту остаётся в кэше
+    static bool analyzeFunction(const Function &function, const SampleBuffer &points,
+                                const ViewportSnapshot &viewport, QVector<CurveFeature> &features,
+                                CurveAnalysisCache *cache = nullptr, const CancelCheck &cancelled = CancelCheck(),
+                                int *evaluations = nullptr);
+    // Пересечения двух функций. Кандидаты ищутся по точкам first, значения second
+    // в них интерполируются по её точкам
+    static bool findIntersections(const Function &first, const SampleBuffer &firstPoints,
+                                  const Function &second, const SampleBuffer &secondPoints,
+                                  const ViewportSnapshot &viewport, QVector<CurveFeature> &features,
+                                  CurveAnalysisCache *cache = nullptr, const CancelCheck &cancelled = CancelCheck(),
+                                  int *evaluations = nullptr);
+
+private:
+    // Точка на отрезке [a, b] из кэша или от refine (тогда она запоминается);
+    // false, если на отрезке её нет
+    static bool refined(CurveAnalysisCache *cache, CurveFeature::Kind kind, double a, double b,
+                        const std::function<bool(double &x, double &y)> &refine, double &x, double &y);
+};
+
+#endif // CURVEANALYZER_H
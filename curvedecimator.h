@@ -0,0 +1,95 @@
+#ifndef CURVEDECIMATOR_H
+#define CURVEDECIMATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include "functionsampler.h"
+
+// Прореживание точек перед построением QPainterPath (алгоритм M4).
+// Линия рисуется по целочисленным экранным координатам, поэтому все отрезки между
+// подряд идущими точками одного столбца пикселей вертикальны и вместе покрывают
+// промежуток от минимума до максимума. Достаточно оставить в столбце первую,
+// последнюю, минимальную и максимальную точки — картинка не меняется, а точек
+// остаётся не больше четырёх на столбец.
+// Невидимые точки (по предикату visible) не объединяются и проходят как есть,
+// чтобы разрывы линии остались на прежних местах.
+// Подходит для любых упорядоченных по x данных, не только для точек функции.
+class CurveDecimator
+{
+public:
+    // Результат пишется в result: буфер, переиспользуемый между кадрами, не
+    // выделяет память заново
+    template <typename T, typename Visible>
+    static void decimate(const SampleSeries<T> &points, const ViewportSnapshot &viewport,
+                         Visible visible, SampleSeries<T> &result)
+    {
+        const int count = points.size();
+        const int width = viewport.size.width();
+        const double xRange = viewport.xMax - viewport.xMin;
+        if (count <= 4 || width <= 0 || !(xRange > 0)) {
+            result = points;
+            return;
+        }
+
+        // Столбец считается так же, как в PlotWidget::transformToScreen
+        auto column = [&](double x) {
+            return static_cast<int>(width * (x - viewport.xMin) / xRange);
+        };
+
+        const T *xs = points.xs.data();
+        const T *ys = points.ys.data();
+        result.clear();
+        result.reserve(std::min(count, 4 * (width + 2)));
+        int i = 0;
+        while (i < count) {
+            if (!visible(xs[i], ys[i])) {
+                result.append(xs[i], ys[i]);
+                ++i;
+                continue;
+            }
+
+            // Серия видимых точек одного столбца
+            const int first = i;
+            const int pixel = column(xs[i]);
+            int minIndex = i;
+            int maxIndex = i;
+            int last = i;
+            while (last + 1 < count && visible(xs[last + 1], ys[last + 1]) &&
+                   column(xs[last + 1]) == pixel) {
+                ++last;
+                if (ys[last] < ys[minIndex]) minIndex = last;
+                if (ys[last] > ys[maxIndex]) maxIndex = last;
+            }
+
+            // Сохраняем исходный порядок точек
+            int kept[4] = {first, std::min(minIndex, maxIndex), std::max(minIndex, maxIndex), last};
+            int previous = -1;
+            for (int index : kept) {
+                if (index != previous) {
+                    result.append(xs[index], ys[index]);
+                    previous = index;
+                }
+            }
+            i = last + 1;
+        }
+    }
+
+    template <typename T, typename Visible>
+    static SampleSeries<T> decimate(const SampleSeries<T> &points, const ViewportSnapshot &viewport,
+                                    Visible visible)
+    {
+        SampleSeries<T> result;
+        decimate(points, viewport, visible, result);
+        return result;
+    }
+
+    // Видимы конечные точки внутри области просмотра по y
+    static SampleBuffer decimate(const SampleBuffer &points, const ViewportSnapshot &viewport)
+    {
+        return decimate(points, viewport, [&viewport](double, double y) {
+            return std::isfinite(y) && y >= viewport.yMin && y <= viewport.yMax;
+        });
+    }
+};
+
+#endif // CURVEDECIMATOR_H
@@ -0,0 +1,364 @@
+#include "dataseries.h"
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "workstealingpool.h"
+#include "tracer.h"
+
+namespace {
+
+const char FileMagic[8] = {'F', 'P', 'S', 'E', 'R', 'I', 'E', 'S'};
+
+DataSeries::FileHeader makeHeader(qint64 count)
+{
+    DataSeries::FileHeader header;
+    std::memcpy(header.magic, FileMagic, sizeof(header.magic));
+    header.version = DataSeries::FileVersion;
+    header.reserved = 0;
+    header.count = count;
+    return header;
+}
+
+bool fail(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+    return false;
+}
+
+bool isSeparator(char c)
+{
+    return c == ',' || c == ';' || c == ' ' || c == '\t';
+}
+
+// Читает число с позиции pos до разделителя; QByteArray::toDouble не зависит от локали
+bool readNumber(const char *line, int length, int &pos, double &value)
+{
+    while (pos < length && isSeparator(line[pos])) {
+        ++pos;
+    }
+    const int start = pos;
+    while (pos < length && !isSeparator(line[pos])) {
+        ++pos;
+    }
+    bool ok = false;
+    value = QByteArray::fromRawData(line + start, pos - start).toDouble(&ok);
+    return ok;
+}
+
+} // namespace
+
+std::shared_ptr<const DataSeries> DataSeries::open(const QString &fileName, QString *error)
+{
+    std::shared_ptr<DataSeries> series(new DataSeries);
+    QFile &file = series->file;
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fail(error, "Не удалось открыть " + fileName);
+        return nullptr;
+    }
+
+    FileHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header) ||
+        std::memcmp(header.magic, FileMagic, sizeof(header.magic)) != 0) {
+        fail(error, fileName + " не является файлом ряда данных");
+        return nullptr;
+    }
+    if (header.version != FileVersion) {
+        fail(error, QString("Неподдерживаемая версия файла: %1").arg(header.version));
+        return nullptr;
+    }
+    // count проверяется до умножения: из повреждённого заголовка произведение переполнится
+    if (header.count < 0 ||
+        header.count > (file.size() - qint64(sizeof(header))) / (2 * qint64(sizeof(double)))) {
+        fail(error, fileName + " обрезан");
+        return nullptr;
+    }
+    const qint64 expectedSize = qint64(sizeof(header)) + 2 * header.count * qint64(sizeof(double));
+
+    series->count = header.count;
+    series->seriesName = QFileInfo(fileName).fileName();
+    if (header.count > 0) {
+        // Заголовок занимает 24 байта, поэтому массивы выровнены по 8
+        uchar *memory = file.map(0, expectedSize);
+        if (!memory) {
+            fail(error, "Не удалось отобразить в память " + fileName + ": " + file.errorString());
+            return nullptr;
+        }
+        series->xs = reinterpret_cast<const double *>(memory + sizeof(header));
+        series->ys = series->xs + header.count;
+    }
+    if (!series->buildPyramid()) {
+        fail(error, fileName + ": x должен быть конечным и не убывать");
+        return nullptr;
+    }
+    return series;
+}
+
+bool DataSeries::write(const QString &fileName, const double *xs, const double *ys, qint64 count,
+                       QString *error)
+{
+    for (qint64 i = 0; i < count; ++i) {
+        if (!std::isfinite(xs[i]) || (i > 0 && xs[i] < xs[i - 1])) {
+            return fail(error, QString("Точка %1: x должен быть конечным и не убывать").arg(i));
+        }
+    }
+
+    QFile out(fileName);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail(error, "Не удалось создать " + fileName);
+    }
+    const FileHeader header = makeHeader(count);
+    const qint64 bytes = count * qint64(sizeof(double));
+    if (out.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header) ||
+        out.write(reinterpret_cast<const char *>(xs), bytes) != bytes ||
+        out.write(reinterpret_cast<const char *>(ys), bytes) != bytes) {
+        return fail(error, "Ошибка записи " + fileName + ": " + out.errorString());
+    }
+    return true;
+}
+
+bool DataSeries::convertCsv(const QString &csvFileName, const QString &fileName, QString *error)
+{
+    QFile csv(csvFileName);
+    if (!csv.open(QIODevice::ReadOnly)) {
+        return fail(error, "Не удалось открыть " + csvFileName);
+    }
+    QFile out(fileName);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail(error, "Не удалось создать " + fileName);
+    }
+    // x пишутся сразу в файл ряда, y — во временный файл, который дописывается в конце
+    QTemporaryFile yFile;
+    if (!yFile.open()) {
+        return fail(error, "Не удалось создать временный файл");
+    }
+
+    FileHeader header = makeHeader(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    constexpr int ChunkSize = 1 << 16;
+    std::vector<double> xChunk;
+    std::vector<double> yChunk;
+    xChunk.reserve(ChunkSize);
+    yChunk.reserve(ChunkSize);
+    auto flush = [&]() {
+        const qint64 bytes = qint64(xChunk.size() * sizeof(double));
+        const bool ok = out.write(reinterpret_cast<const char *>(xChunk.data()), bytes) == bytes &&
+                        yFile.write(reinterpret_cast<const char *>(yChunk.data()), bytes) == bytes;
+        xChunk.clear();
+        yChunk.clear();
+        return ok;
+    };
+
+    qint64 count = 0;
+    qint64 lineNumber = 0;
+    bool headerSkipped = false;
+    double lastX = -std::numeric_limits<double>::infinity();
+    char line[4096];
+    for (;;) {
+        qint64 length = csv.readLine(line, sizeof(line));
+        if (length < 0) {
+            break;
+        }
+        ++lineNumber;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            --length;
+        }
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+
+        int pos = 0;
+        double x = 0;
+        double y = 0;
+        if (!readNumber(line, int(length), pos, x) || !readNumber(line, int(length), pos, y)) {
+            // Первая строка с нечисловыми полями — заголовок столбцов
+            if (count == 0 && !headerSkipped) {
+                headerSkipped = true;
+                continue;
+            }
+            return fail(error, QString("Строка %1: ожидались два числа").arg(lineNumber));
+        }
+        if (!std::isfinite(x) || x < lastX) {
+            return fail(error, QString("Строка %1: x должен быть конечным и не убывать").arg(lineNumber));
+        }
+        lastX = x;
+        xChunk.push_back(x);
+        yChunk.push_back(y);
+        ++count;
+        if (int(xChunk.size()) == ChunkSize && !flush()) {
+            return fail(error, "Ошибка записи " + fileName);
+        }
+    }
+    if (!flush()) {
+        return fail(error, "Ошибка записи " + fileName);
+    }
+
+    yFile.seek(0);
+    QByteArray block;
+    while (!(block = yFile.read(1 << 20)).isEmpty()) {
+        if (out.write(block) != block.size()) {
+            return fail(error, "Ошибка записи " + fileName);
+        }
+    }
+    header.count = count;
+    if (!out.seek(0) || out.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header)) {
+        return fail(error, "Ошибка записи " + fileName);
+    }
+    return true;
+}
+
+bool DataSeries::isOrdered(qint64 from, qint64 to) const
+{
+    for (qint64 i = from; i < to; ++i) {
+        if (!std::isfinite(xs[i]) || (i > 0 && xs[i] < xs[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DataSeries::buildPyramid()
+{
+    TraceScope trace("buildPyramid", "data", count);
+    levels.clear();
+    if (count <= BucketSize) {
+        return isOrdered(0, count);
+    }
+
+    // Нулевой уровень — единственный проход по всем точкам ряда; он делится между ядрами.
+    // Заодно проверяется порядок x: на нём держится двоичный поиск в extract
+    Level base;
+    base.bucketPoints = BucketSize;
+    const qint64 buckets = (count + BucketSize - 1) / BucketSize;
+    base.minIndex.resize(buckets);
+    base.maxIndex.resize(buckets);
+    constexpr qint64 BucketsPerTask = 4096;
+    const int tasks = static_cast<int>((buckets + BucketsPerTask - 1) / BucketsPerTask);
+    std::atomic<bool> ordered{true};
+    WorkStealingPool::instance().run(tasks, [this, &base, &ordered, buckets](int task, int) {
+        const qint64 end = std::min(buckets, (task + 1) * BucketsPerTask);
+        if (!isOrdered(task * BucketsPerTask * BucketSize, std::min(count, end * BucketSize))) {
+            ordered.store(false, std::memory_order_relaxed);
+            return;
+        }
+        for (qint64 b = task * BucketsPerTask; b < end; ++b) {
+            const qint64 last = std::min(count, (b + 1) * BucketSize);
+            qint64 minIndex = -1;
+            qint64 maxIndex = -1;
+            for (qint64 i = b * BucketSize; i < last; ++i) {
+                const double y = ys[i];
+                if (!std::isfinite(y)) {
+                    continue;
+                }
+                if (minIndex < 0 || y < ys[minIndex]) minIndex = i;
+                if (maxIndex < 0 || y > ys[maxIndex]) maxIndex = i;
+            }
+            base.minIndex[b] = minIndex;
+            base.maxIndex[b] = maxIndex;
+        }
+    });
+    if (!ordered.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    levels.push_back(std::move(base));
+
+    // Следующие уровни строятся по предыдущим и вместе занимают не больше трети нулевого
+    while (levels.back().minIndex.size() > size_t(LevelFactor)) {
+        const Level &below = levels.back();
+        const qint64 belowCount = qint64(below.minIndex.size());
+        Level level;
+        level.bucketPoints = below.bucketPoints * LevelFactor;
+        const qint64 levelCount = (belowCount + LevelFactor - 1) / LevelFactor;
+        level.minIndex.resize(levelCount);
+        level.maxIndex.resize(levelCount);
+        for (qint64 b = 0; b < levelCount; ++b) {
+            qint64 minIndex = -1;
+            qint64 maxIndex = -1;
+            const qint64 last = std::min(belowCount, (b + 1) * LevelFactor);
+            for (qint64 c = b * LevelFactor; c < last; ++c) {
+                const qint64 cellMin = below.minIndex[c];
+                const qint64 cellMax = below.maxIndex[c];
+                if (cellMin < 0) {
+                    continue;
+                }
+                if (minIndex < 0 || ys[cellMin] < ys[minIndex]) minIndex = cellMin;
+                if (maxIndex < 0 || ys[cellMax] > ys[maxIndex]) maxIndex = cellMax;
+            }
+            level.minIndex[b] = minIndex;
+            level.maxIndex[b] = maxIndex;
+        }
+        levels.push_back(std::move(level));
+    }
+    return true;
+}
+
+void DataSeries::extract(const ViewportSnapshot &viewport, SampleBuffer &points) const
+{
+    TraceScope trace("extractSeries", "data");
+    points.clear();
+    if (count == 0 || !(viewport.xMax > viewport.xMin)) {
+        return;
+    }
+
+    qint64 first = std::lower_bound(xs, xs + count, viewport.xMin) - xs;
+    qint64 last = std::upper_bound(xs, xs + count, viewport.xMax) - xs;
+    if (first > 0) --first;
+    if (last < count) ++last;
+
+    // Самый грубый уровень, на котором корзин в области не меньше, чем столбцов.
+    // Если такого нет, исходных точек меньше BucketSize на столбец — берём их
+    const qint64 columns = std::max(1, viewport.size.width());
+    int levelIndex = -1;
+    for (int i = 0; i < int(levels.size()); ++i) {
+        if ((last - first) / levels[i].bucketPoints < columns) {
+            break;
+        }
+        levelIndex = i;
+    }
+    points.reserve(int(std::min<qint64>(last - first, 2 * LevelFactor * (columns + 2))));
+    appendRange(levelIndex, first, last, points);
+    trace.setValue(points.size());
+}
+
+void DataSeries::appendRange(int levelIndex, qint64 from, qint64 to, SampleBuffer &points) const
+{
+    if (levelIndex < 0) {
+        for (qint64 i = from; i < to; ++i) {
+            points.append(xs[i], ys[i]);
+        }
+        return;
+    }
+
+    const Level &level = levels[levelIndex];
+    const qint64 bucketPoints = level.bucketPoints;
+    const qint64 endBucket = (to + bucketPoints - 1) / bucketPoints;
+    for (qint64 b = from / bucketPoints; b < endBucket; ++b) {
+        const qint64 begin = b * bucketPoints;
+        const qint64 end = std::min(count, begin + bucketPoints);
+        // Частично попавшая корзина: только её часть внутри [from, to)
+        if (begin < from || end > to) {
+            appendRange(levelIndex - 1, std::max(begin, from), std::min(end, to), points);
+            continue;
+        }
+        const qint64 minIndex = level.minIndex[b];
+        const qint64 maxIndex = level.maxIndex[b];
+        if (minIndex < 0) {
+            points.append(xs[begin], std::numeric_limits<double>::quiet_NaN());
+            continue;
+        }
+        // Минимум и максимум — в порядке возрастания x
+        const qint64 left = std::min(minIndex, maxIndex);
+        const qint64 right = std::max(minIndex, maxIndex);
+        points.append(xs[left], ys[left]);
+        if (right != left) {
+            points.append(xs[right], ys[right]);
+        }
+    }
+}
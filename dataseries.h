@@ -0,0 +1,93 @@
+#ifndef DATASERIES_H
+#define DATASERIES_H
+
+#include <QFile>
+#include <QString>
+#include <memory>
+#include <vector>
+#include "functionsampler.h"
+#include "samplebuffer.h"
+
+// Ряд измеренных точек (x, y), упорядоченных по x, из файла, отображённого в память.
+// Точки не копируются: массивы x и y читаются прямо из отображения, и в памяти
+// процесса оказываются только страницы, к которым было обращение.
+//
+// Формат файла: заголовок FileHeader, затем count значений x и count значений y
+// (double, порядок байт машины). CSV переводится в него функцией convertCsv.
+//
+// При открытии проверяется, что x не убывают, и строится пирамида уровней
+// детализации: на нулевом уровне каждая корзина — BucketSize подряд идущих точек,
+// на каждом следующем корзина объединяет LevelFactor корзин предыдущего. Корзина
+// хранит номера точек с минимальным и максимальным y. extract выбирает уровень, на
+// котором в область просмотра попадает от одной до LevelFactor корзин на столбец
+// пикселей, и отдаёт по две точки на корзину, поэтому перерисовка читает O(ширины)
+// точек при любом размере ряда. Крайние корзины, лишь частично попавшие в область,
+// раскладываются по более мелким уровням вплоть до исходных точек.
+class DataSeries
+{
+public:
+    static constexpr int BucketSize = 64;
+    static constexpr int LevelFactor = 4;
+
+    struct FileHeader {
+        char magic[8];      // "FPSERIES"
+        quint32 version;
+        quint32 reserved;
+        qint64 count;
+    };
+    static constexpr quint32 FileVersion = 1;
+
+    // nullptr и текст ошибки в error, если файл не открылся, повреждён или x в нём
+    // не упорядочены.
+    // ВНИМАНИЕ: open строит пирамиду синхронно — это проход по всем точкам ряда,
+    // для рядов в сотни миллионов точек секунды чтения с диска. Не вызывайте его
+    // в потоке интерфейса: открывайте ряд в фоновом потоке и передавайте
+    // готовый в PlotWidget::addDataSeries.
+    static std::shared_ptr<const DataSeries> open(const QString &fileName, QString *error = nullptr);
+
+    // Записывает ряд в файл нужного формата; xs должны быть упорядочены
+    static bool write(const QString &fileName, const double *xs, const double *ys, qint64 count,
+                      QString *error = nullptr);
+    // Переводит CSV (x и y в первых двух столбцах, разделитель — запятая, точка
+    // с запятой, пробел или табуляция) в файл ряда. Строка заголовка пропускается.
+    // Файл читается потоком, поэтому размер CSV ограничен только диском.
+    static bool convertCsv(const QString &csvFileName, const QString &fileName, QString *error = nullptr);
+
+    DataSeries(const DataSeries &) = delete;
+    DataSeries &operator=(const DataSeries &) = delete;
+
+    // Имя для подписи на графике — имя файла без каталога
+    const QString &name() const { return seriesName; }
+    qint64 size() const { return count; }
+    const double *xData() const { return xs; }
+    const double *yData() const { return ys; }
+
+    // Точки для области просмотра, упорядоченные по x: исходные, если их
+    // немного, иначе минимумы и максимумы корзин подходящего уровня. Захватывается
+    // и по одной точке за краями области, чтобы линия доходила до границ.
+    // Корзина из одних NaN даёт точку с y = NaN — линия в этом месте прерывается.
+    void extract(const ViewportSnapshot &viewport, SampleBuffer &points) const;
+
+private:
+    struct Level {
+        qint64 bucketPoints = 0;           // точек исходного ряда на корзину
+        std::vector<qint64> minIndex;      // -1, если в корзине нет конечных y
+        std::vector<qint64> maxIndex;
+    };
+
+    QFile file;
+    QString seriesName;
+    const double *xs = nullptr;
+    const double *ys = nullptr;
+    qint64 count = 0;
+    std::vector<Level> levels;
+
+    DataSeries() = default;
+    // false, если x не конечны или убывают; пирамида тогда не строится
+    bool buildPyramid();
+    bool isOrdered(qint64 from, qint64 to) const;
+    // Дописывает точки [from, to) уровня levelIndex; -1 — исходные точки
+    void appendRange(int levelIndex, qint64 from, qint64 to, SampleBuffer &points) const;
+};
+
+#endif // DATASERIES_H
@@ -0,0 +1,377 @@
+#include "evaluationservice.h"
+#include <QMetaObject>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include "tracer.h"
+
+EvaluationService::EvaluationService(QObject *parent)
+    : QObject(parent)
+{
+    worker = std::thread(&EvaluationService::workerLoop, this);
+}
+
+EvaluationService::~EvaluationService()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    // Текущее задание тоже становится устаревшим и прерывается
+    ++generation;
+    wake.notify_all();
+    worker.join();
+}
+
+quint64 EvaluationService::request(const ViewportSnapshot &viewport, const QStringList &expressions,
+                                   const QVector<ParametricCurveSpec> &parametric,
+                                   const QStringList &implicit,
+                                   const HeatmapSpec &heatmap, bool analyze)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.generation = ++generation;
+    pending.viewport = viewport;
+    pending.expressions = expressions;
+    pending.parametric = parametric;
+    pending.implicit = implicit;
+    pending.heatmap = heatmap;
+    pending.analyze = analyze;
+    hasPending = true;
+    wake.notify_one();
+    return pending.generation;
+}
+
+void EvaluationService::setCacheMemoryBudget(qint64 bytes)
+{
+    // Рабочий поток применит бюджет к кэшам при следующем задании
+    cacheBudget = bytes;
+}
+
+void EvaluationService::workerLoop()
+{
+    Tracer::setThreadName("EvaluationService");
+    for (;;) {
+        Request job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || hasPending; });
+            if (stopping) {
+                return;
+            }
+            job = pending;
+            hasPending = false;
+        }
+
+        auto cancelled = [this, &job]() {
+            return generation.load() != job.generation;
+        };
+
+        // Убираем функции, которых больше нет на графике
+        for (auto it = functionCache.begin(); it != functionCache.end();) {
+            if (!job.expressions.contains(it.key())) {
+                it = functionCache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto it = implicitCache.begin(); it != implicitCache.end();) {
+            if (!job.implicit.contains(it.key())) {
+                it = implicitCache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        const qint64 budget = cacheBudget.load();
+        for (WorkerFunction &cached : functionCache) {
+            if (cached.samples.memoryBudget() != budget) {
+                cached.samples.setMemoryBudget(budget);
+            }
+        }
+        for (WorkerImplicit &cached : implicitCache) {
+            if (cached.tiles.memoryBudget() != budget) {
+                cached.tiles.setMemoryBudget(budget);
+            }
+        }
+
+        // Пока считаются точные точки, показываем то, что уже есть в кэше
+        EvaluationResult preview;
+        preview.generation = job.generation;
+        preview.viewport = job.viewport;
+        preview.preview = true;
+        for (const QString &expr : job.expressions) {
+            auto it = functionCache.find(expr);
+            if (it == functionCache.end()) {
+                continue;
+            }
+            std::shared_ptr<SampleBuffer> points = acquireBuffer(*it);
+            if (FunctionSampler::cachedPoints(job.viewport, it->samples, *points, &it->scratch)) {
+                preview.curves.insert(expr, points);
+            }
+        }
+        if (!preview.curves.isEmpty()) {
+            QMetaObject::invokeMethod(this, [this, preview]() {
+                publish(preview);
+            }, Qt::QueuedConnection);
+        }
+
+        EvaluationResult result;
+        result.generation = job.generation;
+        result.viewport = job.viewport;
+        int cacheHits = 0;
+        int cacheMisses = 0;
+        int evaluations = 0;
+
+        for (const QString &expr : job.expressions) {
+            if (cancelled()) {
+                break;
+            }
+            auto it = functionCache.find(expr);
+            if (it == functionCache.end()) {
+                it = functionCache.insert(expr, WorkerFunction());
+                it->function = Function(expr);
+                it->samples.setMemoryBudget(budget);
+            }
+            SamplingStats stats;
+            QElapsedTimer timer;
+            timer.start();
+            std::shared_ptr<SampleBuffer> points = acquireBuffer(*it);
+            FunctionSampler::calculatePoints(it->function, job.viewport, *points, cancelled,
+                                             &stats.evaluations, &it->samples, &it->scratch);
+            stats.nanoseconds = timer.nsecsElapsed();
+            stats.points = points->size();
+            stats.nanCount = static_cast<int>(std::count_if(points->ys.begin(), points->ys.end(),
+                                                            [](double y) { return std::isnan(y); }));
+            stats.cacheHits = it->samples.lastStats().hits;
+            stats.cacheMisses = it->samples.lastStats().misses;
+            result.curves.insert(expr, points);
+            result.stats.insert(expr, stats);
+            cacheHits += stats.cacheHits;
+            cacheMisses += stats.cacheMisses;
+            evaluations += stats.evaluations;
+        }
+
+        // Параметрические кривые: ключи, которых нет в задании, удаляются
+        QStringList parametricKeys;
+        for (const ParametricCurveSpec &spec : job.parametric) {
+            parametricKeys.append(spec.key());
+        }
+        for (auto it = parametricCache.begin(); it != parametricCache.end();) {
+            if (!parametricKeys.contains(it.key())) {
+                it = parametricCache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        const double scaleX = job.viewport.size.width() / (job.viewport.xMax - job.viewport.xMin);
+        const double scaleY = job.viewport.size.height() / (job.viewport.yMax - job.viewport.yMin);
+        for (const ParametricCurveSpec &spec : job.parametric) {
+            if (cancelled()) {
+                break;
+            }
+            const QString key = spec.key();
+            auto it = parametricCache.find(key);
+            if (it == parametricCache.end()) {
+                it = parametricCache.insert(key, WorkerParametric());
+                it->components = ParametricComponents(spec);
+            }
+            SamplingStats stats;
+            // Сдвиг области меняет xMax - xMin в последних разрядах, поэтому масштаб
+            // сравнивается с допуском
+            auto sameScale = [](double a, double b) {
+                return std::abs(a - b) <= 1e-9 * std::abs(b);
+            };
+            if (!it->points || !sameScale(it->scaleX, scaleX) || !sameScale(it->scaleY, scaleY)) {
+                QElapsedTimer timer;
+                timer.start();
+                // Прежний буфер может ещё рисоваться в GUI-потоке — пишем в новый
+                auto points = std::make_shared<SampleBuffer>();
+                if (!ParametricSampler::calculatePoints(it->components, spec, scaleX, scaleY, *points, cancelled,
+                                                        &stats.evaluations, &it->scratch)) {
+                    break;
+                }
+                it->points = points;
+                it->scaleX = scaleX;
+                it->scaleY = scaleY;
+                stats.nanoseconds = timer.nsecsElapsed();
+                evaluations += stats.evaluations;
+            }
+            stats.points = it->points->size();
+            result.curves.insert(key, it->points);
+            result.stats.insert(key, stats);
+        }
+
+        // Неявные кривые: при сдвиге области досчитываются только новые плитки сетки
+        for (const QString &expr : job.implicit) {
+            if (cancelled()) {
+                break;
+            }
+            auto it = implicitCache.find(expr);
+            if (it == implicitCache.end()) {
+                it = implicitCache.insert(expr, WorkerImplicit());
+                it->function = ImplicitFunction(expr);
+                it->tiles.setMemoryBudget(budget);
+            }
+            SamplingStats stats;
+            QElapsedTimer timer;
+            timer.start();
+            auto segments = std::make_shared<SampleBuffer>();
+            if (!ImplicitCurveSampler::calculateSegments(it->function, job.viewport, *segments, cancelled,
+                                                         &stats.evaluations, &it->tiles)) {
+                break;
+            }
+            stats.nanoseconds = timer.nsecsElapsed();
+            stats.points = segments->size();
+            stats.cacheHits = it->tiles.lastStats().hits;
+            stats.cacheMisses = it->tiles.lastStats().misses;
+            const QString key = ImplicitFunction::key(expr);
+            result.curves.insert(key, segments);
+            result.stats.insert(key, stats);
+            evaluations += stats.evaluations;
+        }
+
+        // Поле — последним: кривые уже готовы и уходят вместе с каждым промежуточным
+        // изображением, от грубого к точному
+        if (!job.heatmap.isEmpty() && !cancelled()) {
+            if (heatmapFunction.expression() != job.heatmap.expression) {
+                heatmapFunction = ImplicitFunction(job.heatmap.expression);
+                heatmapTiles.clear();
+            }
+            SamplingStats stats;
+            QElapsedTimer timer;
+            timer.start();
+            HeatmapRenderer::render(heatmapFunction, job.heatmap, job.viewport, heatmapTiles,
+                                    [this, &result](const HeatmapImage &image, bool final) {
+                result.heatmap = image;
+                if (!final) {
+                    QMetaObject::invokeMethod(this, [this, result]() {
+                        publish(result);
+                    }, Qt::QueuedConnection);
+                }
+            }, cancelled, &stats.evaluations);
+            stats.nanoseconds = timer.nsecsElapsed();
+            stats.cacheHits = heatmapTiles.lastStats().hits;
+            stats.cacheMisses = heatmapTiles.lastStats().misses;
+            result.stats.insert(job.heatmap.key(), stats);
+            evaluations += stats.evaluations;
+        }
+
+        if (cancelled()) {
+            continue;
+        }
+
+        if (cacheHits + cacheMisses > 0) {
+            qDebug() << "Кэш точек: попаданий" << cacheHits << "из" << cacheHits + cacheMisses
+                     << QString("(%1%),").arg(100.0 * cacheHits / (cacheHits + cacheMisses), 0, 'f', 1)
+                     << "вычислений функций:" << evaluations;
+        }
+
+        // Особые точки ищутся уже после того, как точки отданы: графики появляются,
+        // не дожидаясь анализа, а прежние маркеры остаются до новых
+        result.analyzed = !job.analyze;
+        QMetaObject::invokeMethod(this, [this, result]() {
+            publish(result);
+        }, Qt::QueuedConnection);
+        if (job.analyze && findFeatures(job, result, cancelled)) {
+            QMetaObject::invokeMethod(this, [this, result]() {
+                publish(result);
+            }, Qt::QueuedConnection);
+        }
+    }
+}
+
+bool EvaluationService::findFeatures(const Request &job, EvaluationResult &result,
+                                     const CurveAnalyzer::CancelCheck &cancelled)
+{
+    TraceScope trace("findFeatures", "analysis");
+    // Пересечения уточняются по парам; пары с удалёнными функциями не нужны
+    for (auto it = intersectionCache.begin(); it != intersectionCache.end();) {
+        if (!job.expressions.contains(it.key().first) || !job.expressions.contains(it.key().second)) {
+            it = intersectionCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    auto features = std::make_shared<QVector<CurveFeature>>();
+    for (int i = 0; i < job.expressions.size(); ++i) {
+        const QString &expr = job.expressions[i];
+        auto it = functionCache.find(expr);
+        const CurvePoints points = result.curves.value(expr);
+        if (it == functionCache.end() || !points) {
+            continue;
+        }
+        if (!CurveAnalyzer::analyzeFunction(it->function, *points, job.viewport, *features,
+                                            &it->analysis, cancelled)) {
+            return false;
+        }
+
+        for (int j = i + 1; j < job.expressions.size(); ++j) {
+            const QString &otherExpr = job.expressions[j];
+            auto other = functionCache.find(otherExpr);
+            const CurvePoints otherPoints = result.curves.value(otherExpr);
+            if (other == functionCache.end() || !otherPoints) {
+                continue;
+            }
+            CurveAnalysisCache &cache = intersectionCache[qMakePair(expr, otherExpr)];
+            if (!CurveAnalyzer::findIntersections(it->function, *points, other->function, *otherPoints,
+                                                  job.viewport, *features, &cache, cancelled)) {
+                return false;
+            }
+        }
+    }
+
+    result.features = features;
+    result.analyzed = true;
+    return true;
+}
+
+std::shared_ptr<SampleBuffer> EvaluationService::acquireBuffer(WorkerFunction &function)
+{
+    // Ссылка только у нас — буфер не держат ни результаты, ни слои виджета
+    for (const std::shared_ptr<SampleBuffer> &buffer : function.buffers) {
+        if (buffer.use_count() == 1) {
+            // Последнюю чужую ссылку отпустил GUI-поток; барьер гарантирует, что его
+            // чтения буфера закончились до того, как мы начнём писать
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return buffer;
+        }
+    }
+    function.buffers.push_back(std::make_shared<SampleBuffer>());
+    return function.buffers.back();
+}
+
+void EvaluationService::publish(const EvaluationResult &result)
+{
+    // Результаты могут прийти не по порядку — более старые не показываем
+    if (result.generation < latest.generation) {
+        return;
+    }
+    // Предварительный результат не должен заменить точный того же задания
+    if (result.preview && !latest.preview && result.generation == latest.generation) {
+        return;
+    }
+    if (result.preview) {
+        // Функции, которых нет в кэше, пока рисуем по прежним точкам
+        EvaluationResult merged = result;
+        merged.stats = latest.stats;
+        merged.heatmap = latest.heatmap;
+        for (auto it = latest.curves.constBegin(); it != latest.curves.constEnd(); ++it) {
+            if (!merged.curves.contains(it.key())) {
+                merged.curves.insert(it.key(), it.value());
+            }
+        }
+        merged.features = latest.features;
+        latest = merged;
+    } else {
+        const CurveFeatures features = latest.features;
+        latest = result;
+        // Особые точки этого результата ещё ищутся — пока оставляем прежние
+        if (!result.analyzed) {
+            latest.features = features;
+        }
+    }
+    emit resultReady();
+}
@@ -0,0 +1,155 @@
+#ifndef EVALUATIONSERVICE_H
+#define EVALUATIONSERVICE_H
+
+#include <QObject>
+#include <QHash>
+#include <QPair>
+#include <QStringList>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include "functionsampler.h"
+#include "parametriccurve.h"
+#include "implicitcurve.h"
+#include "heatmap.h"
+#include "curveanalyzer.h"
+
+// Точки одного графика. Буфер неизменяем, пока на него есть ссылки вне
+// EvaluationService; после этого рабочий поток заполняет его заново
+using CurvePoints = std::shared_ptr<const SampleBuffer>;
+
+// Как были получены точки одного графика
+struct SamplingStats {
+    int evaluations = 0;    // вычислений функции
+    int points = 0;
+    int nanCount = 0;       // точек со значением NaN (вне области определения)
+    int cacheHits = 0;      // ячеек SampleCache, взятых из кэша
+    int cacheMisses = 0;    // ячеек, вычисленных заново
+    qint64 nanoseconds = 0; // время calculatePoints
+};
+
+// Готовые точки графиков для одного снимка области просмотра
+struct EvaluationResult {
+    quint64 generation = 0;
+    ViewportSnapshot viewport;
+    QHash<QString, CurvePoints> curves;
+    // Только у точного результата; у предварительного пусто
+    QHash<QString, SamplingStats> stats;
+    // Предварительный результат: точки с соседнего уровня кэша, без вычислений
+    bool preview = false;
+    // Изображение скалярного поля; пока оно досчитывается, приходят и
+    // промежуточные результаты того же задания с более грубым полем
+    HeatmapImage heatmap;
+    // Корни, экстремумы и пересечения функций. Ищутся после того, как точки
+    // отданы: пока analyzed = false, в latestResult() остаются прежние особые точки
+    CurveFeatures features;
+    bool analyzed = false;
+};
+
+// Фоновое вычисление точек графиков.
+// GUI-поток передаёт снимок области просмотра и список выражений; рабочий поток
+// строит для них точки и возвращает результат сигналом resultReady. Новое задание
+// делает все предыдущие устаревшими: рабочий поток бросает их при первой проверке,
+// а из очереди берёт только самое последнее. Объекты Function для вычислений
+// создаются и хранятся в рабочем потоке, GUI-поток их не трогает.
+// Если в кэше точек есть подходящий уровень (например, после зума туда и обратно),
+// сначала сразу отдаётся предварительный результат из кэша, а затем точный.
+class EvaluationService : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EvaluationService(QObject *parent = nullptr);
+    ~EvaluationService() override;
+
+    // Ставит задание в очередь и возвращает его номер. Точки параметрических и
+    // полярных кривых попадают в результат под ключом ParametricCurveSpec::key(),
+    // отрезки неявных кривых F(x, y) = 0 — под ключом ImplicitFunction::key(),
+    // поле heatmap — в EvaluationResult::heatmap. С analyze по точкам функций
+    // ищутся особые точки (EvaluationResult::features)
+    quint64 request(const ViewportSnapshot &viewport, const QStringList &expressions,
+                    const QVector<ParametricCurveSpec> &parametric = QVector<ParametricCurveSpec>(),
+                    const QStringList &implicit = QStringList(),
+                    const HeatmapSpec &heatmap = HeatmapSpec(), bool analyze = false);
+
+    // Последний завершённый результат (только из GUI-потока)
+    const EvaluationResult &latestResult() const { return latest; }
+
+    // Бюджет памяти кэша точек каждой функции, в байтах
+    void setCacheMemoryBudget(qint64 bytes);
+    qint64 cacheMemoryBudget() const { return cacheBudget.load(); }
+
+signals:
+    void resultReady();
+
+private:
+    struct Request {
+        quint64 generation = 0;
+        ViewportSnapshot viewport;
+        QStringList expressions;
+        QVector<ParametricCurveSpec> parametric;
+        QStringList implicit;
+        HeatmapSpec heatmap;
+        bool analyze = false;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool hasPending = false;
+    Request pending;
+    std::atomic<quint64> generation{0};
+    std::atomic<qint64> cacheBudget{SampleCache::DefaultMemoryBudget};
+
+    // Функция рабочего потока вместе с кэшем её точек, рабочими массивами выборки
+    // и буферами результатов, которые переходят из кадра в кадр
+    struct WorkerFunction {
+        Function function;
+        SampleCache samples;
+        SamplerScratch scratch;
+        std::vector<std::shared_ptr<SampleBuffer>> buffers;
+        // Уточнённые корни и экстремумы
+        CurveAnalysisCache analysis;
+    };
+
+    // Параметрическая кривая рабочего потока. Её точки зависят только от масштаба,
+    // поэтому при сдвиге области отдаются прежние, без вычислений
+    struct WorkerParametric {
+        ParametricComponents components;
+        ParametricScratch scratch;
+        CurvePoints points;
+        double scaleX = 0;
+        double scaleY = 0;
+    };
+
+    // Неявная кривая рабочего потока с кэшем плиток сетки
+    struct WorkerImplicit {
+        ImplicitFunction function;
+        ImplicitCurveCache tiles;
+    };
+
+    // Результат, отданный GUI-потоку
+    EvaluationResult latest;
+    // Функции рабочего потока по выражению
+    QHash<QString, WorkerFunction> functionCache;
+    QHash<QString, WorkerParametric> parametricCache;
+    QHash<QString, WorkerImplicit> implicitCache;
+    // Поле и его плитки; плитки сбрасываются при смене выражения
+    ImplicitFunction heatmapFunction;
+    HeatmapCache heatmapTiles;
+    // Уточнённые пересечения по парам выражений
+    QHash<QPair<QString, QString>, CurveAnalysisCache> intersectionCache;
+
+    void workerLoop();
+    // Особые точки функций задания по точкам result; false при отмене
+    bool findFeatures(const Request &job, EvaluationResult &result, const CurveAnalyzer::CancelCheck &cancelled);
+    // Буфер, который уже никто не читает, или новый, если все заняты
+    static std::shared_ptr<SampleBuffer> acquireBuffer(WorkerFunction &function);
+    void publish(const EvaluationResult &result);
+};
+
+#endif // EVALUATIONSERVICE_H
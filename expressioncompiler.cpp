@@ -0,0 +1,814 @@
+#include "expressioncompiler.h"
+#include "mathfunctions.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <locale>
+#include <map>
+#include <sstream>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define EXPRESSION_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define EXPRESSION_HAVE_X86_SIMD 0
+#endif
+
+// AVX2-варианты собираются с атрибутом target, поэтому остальной код
+// (и сам проект) не требует флага -mavx2 и запускается на любом x86-64
+#if EXPRESSION_HAVE_X86_SIMD && defined(__GNUC__)
+#define EXPRESSION_TARGET_AVX2 __attribute__((target("avx2")))
+#define EXPRESSION_HAVE_AVX2 1
+#else
+#define EXPRESSION_TARGET_AVX2
+#define EXPRESSION_HAVE_AVX2 0
+#endif
+
+namespace {
+
+using OpCode = CompiledExpression::OpCode;
+using Instruction = CompiledExpression::Instruction;
+
+// Скалярные обёртки над функциями стандартной библиотеки
+double fnSin(double v) { return std::sin(v); }
+double fnCos(double v) { return std::cos(v); }
+double fnTan(double v) { return std::tan(v); }
+double fnCot(double v) { return cot(v); }
+double fnSqrt(double v) { return std::sqrt(v); }
+double fnAbs(double v) { return std::abs(v); }
+double fnExp(double v) { return std::exp(v); }
+double fnLog(double v) { return std::log(v); }
+double fnLog10(double v) { return std::log10(v); }
+double fnPowOp(double a, double b) { return std::pow(a, b); }
+double fnPow(double a, double b) { return power_wrapper(a, b); }
+double fnPower(double a, double b) { return power(a, b); }
+
+bool isUnary(OpCode op)
+{
+    return op == OpCode::Neg || op >= OpCode::Sin;
+}
+
+// Скалярное значение операции — для свёртки констант
+double applyScalar(OpCode op, double a, double b)
+{
+    switch (op) {
+    case OpCode::Add: return a + b;
+    case OpCode::Sub: return a - b;
+    case OpCode::Mul: return a * b;
+    case OpCode::Div: return a / b;
+    case OpCode::Neg: return -a;
+    case OpCode::PowOp: return fnPowOp(a, b);
+    case OpCode::Pow: return fnPow(a, b);
+    case OpCode::Power: return fnPower(a, b);
+    case OpCode::Sin: return fnSin(a);
+    case OpCode::Cos: return fnCos(a);
+    case OpCode::Tan: return fnTan(a);
+    case OpCode::Cot: return fnCot(a);
+    case OpCode::Sqrt: return fnSqrt(a);
+    case OpCode::Abs: return fnAbs(a);
+    case OpCode::Exp: return fnExp(a);
+    case OpCode::Log: return fnLog(a);
+    case OpCode::Log10: return fnLog10(a);
+    default: return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Разбор выражения в AST
+
+struct ExprNode {
+    OpCode op = OpCode::Const;
+    double value = 0.0;  // для Const
+    int variable = 0;    // для LoadVar
+    std::unique_ptr<ExprNode> left;
+    std::unique_ptr<ExprNode> right;
+    int need = 0;        // число временных регистров (Sethi–Ullman)
+};
+
+using NodePtr = std::unique_ptr<ExprNode>;
+
+struct ParseError {
+    std::string message;
+    int pos;
+};
+
+struct FunctionEntry {
+    const char *name;
+    OpCode op;
+    int arity;
+};
+
+// Функции, которые Function регистрирует в muParser
+const FunctionEntry functionTable[] = {
+    {"pow", OpCode::Pow, 2},
+    {"power", OpCode::Power, 2},
+    {"sin", OpCode::Sin, 1},
+    {"cos", OpCode::Cos, 1},
+    {"tan", OpCode::Tan, 1},
+    {"cot", OpCode::Cot, 1},
+    {"sqrt", OpCode::Sqrt, 1},
+    {"abs", OpCode::Abs, 1},
+    {"exp", OpCode::Exp, 1},
+    {"log", OpCode::Log, 1},
+    {"log10", OpCode::Log10, 1}
+};
+
+NodePtr makeConst(double value)
+{
+    NodePtr node(new ExprNode);
+    node->op = OpCode::Const;
+    node->value = value;
+    return node;
+}
+
+NodePtr makeUnary(OpCode op, NodePtr operand)
+{
+    if (operand->op == OpCode::Const) {
+        operand->value = applyScalar(op, operand->value, 0.0);
+        return operand;
+    }
+    NodePtr node(new ExprNode);
+    node->op = op;
+    node->left = std::move(operand);
+    return node;
+}
+
+NodePtr makeBinary(OpCode op, NodePtr left, NodePtr right)
+{
+    if (left->op == OpCode::Const && right->op == OpCode::Const) {
+        left->value = applyScalar(op, left->value, right->value);
+        return left;
+    }
+    NodePtr node(new ExprNode);
+    node->op = op;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+
+// Рекурсивный спуск с приоритетами muParser:
+// + -  <  * / и унарный минус  <  ^ (правоассоциативный)
+class ExpressionParser
+{
+public:
+    ExpressionParser(const std::string &text, const std::vector<std::string> &variables)
+        : text(text), variables(variables) {}
+
+    NodePtr parse()
+    {
+        NodePtr root = parseAdditive();
+        skipSpaces();
+        if (pos < text.size()) {
+            fail("Неожиданный символ");
+        }
+        return root;
+    }
+
+private:
+    const std::string &text;
+    const std::vector<std::string> &variables;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string &message) const
+    {
+        throw ParseError{message, static_cast<int>(pos)};
+    }
+
+    void skipSpaces()
+    {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+            ++pos;
+        }
+    }
+
+    bool accept(char c)
+    {
+        skipSpaces();
+        if (pos < text.size() && text[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!accept(c)) {
+            fail(std::string("Ожидался символ '") + c + "'");
+        }
+    }
+
+    NodePtr parseAdditive()
+    {
+        NodePtr left = parseMultiplicative();
+        for (;;) {
+            if (accept('+')) {
+                left = makeBinary(OpCode::Add, std::move(left), parseMultiplicative());
+            } else if (accept('-')) {
+                left = makeBinary(OpCode::Sub, std::move(left), parseMultiplicative());
+            } else {
+                return left;
+            }
+        }
+    }
+
+    NodePtr parseMultiplicative()
+    {
+        NodePtr left = parseUnary();
+        for (;;) {
+            if (accept('*')) {
+                left = makeBinary(OpCode::Mul, std::move(left), parseUnary());
+            } else if (accept('/')) {
+                left = makeBinary(OpCode::Div, std::move(left), parseUnary());
+            } else {
+                return left;
+            }
+        }
+    }
+
+    NodePtr parseUnary()
+    {
+        if (accept('-')) {
+            return makeUnary(OpCode::Neg, parseUnary());
+        }
+        if (accept('+')) {
+            return parseUnary();
+        }
+        return parsePower();
+    }
+
+    NodePtr parsePower()
+    {
+        NodePtr base = parsePrimary();
+        if (accept('^')) {
+            // Показатель может содержать унарный минус: x^-2
+            return makeBinary(OpCode::PowOp, std::move(base), parseUnary());
+        }
+        return base;
+    }
+
+    NodePtr parsePrimary()
+    {
+        skipSpaces();
+        if (pos >= text.size()) {
+            fail("Неожиданный конец выражения");
+        }
+
+        char c = text[pos];
+        if (c == '(') {
+            ++pos;
+            NodePtr inner = parseAdditive();
+            expect(')');
+            return inner;
+        }
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            return parseNumber();
+        }
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            return parseIdentifier();
+        }
+        fail("Неожиданный символ");
+    }
+
+    NodePtr parseNumber()
+    {
+        size_t start = pos;
+        while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) ++pos;
+        if (pos < text.size() && text[pos] == '.') {
+            ++pos;
+            while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) ++pos;
+        }
+        if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+            size_t exponent = pos + 1;
+            if (exponent < text.size() && (text[exponent] == '+' || text[exponent] == '-')) ++exponent;
+            if (exponent < text.size() && std::isdigit(static_cast<unsigned char>(text[exponent]))) {
+                pos = exponent;
+                while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) ++pos;
+            }
+        }
+
+        // Разбор не зависит от локали приложения (десятичный разделитель — точка)
+        std::istringstream stream(text.substr(start, pos - start));
+        stream.imbue(std::locale::classic());
+        double value = 0.0;
+        stream >> value;
+        if (stream.fail()) {
+            pos = start;
+            fail("Некорректное число");
+        }
+        return makeConst(value);
+    }
+
+    NodePtr parseIdentifier()
+    {
+        size_t start = pos;
+        while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) {
+            ++pos;
+        }
+        std::string name = text.substr(start, pos - start);
+
+        if (accept('(')) {
+            for (const FunctionEntry &entry : functionTable) {
+                if (name != entry.name) continue;
+                NodePtr first = parseAdditive();
+                if (entry.arity == 1) {
+                    expect(')');
+                    return makeUnary(entry.op, std::move(first));
+                }
+                expect(',');
+                NodePtr second = parseAdditive();
+                expect(')');
+                return makeBinary(entry.op, std::move(first), std::move(second));
+            }
+            pos = start;
+            fail("Неизвестная функция: " + name);
+        }
+
+        for (size_t i = 0; i < variables.size(); ++i) {
+            if (name == variables[i]) {
+                NodePtr node(new ExprNode);
+                node->op = OpCode::LoadVar;
+                node->variable = static_cast<int>(i);
+                return node;
+            }
+        }
+        // Встроенные константы muParser
+        if (name == "_pi") return makeConst(3.141592653589793238462643);
+        if (name == "_e") return makeConst(2.718281828459045235360287);
+
+        pos = start;
+        fail("Неизвестный идентификатор: " + name);
+    }
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Генерация байткода
+
+// Константы и переменные получают выделенные регистры: константы заполняются один раз
+// в прологе, переменные загружаются в начале каждого блока. Промежуточные значения
+// живут во временных регистрах, которые переиспользуются; порядок обхода по
+// Sethi–Ullman минимизирует их число.
+class ExpressionCodeGenerator
+{
+public:
+    explicit ExpressionCodeGenerator(CompiledExpression &target) : out(target) {}
+
+    bool generate(ExprNode &root)
+    {
+        computeNeed(root);
+        std::vector<Instruction> ops;
+        int result = emit(root, ops);
+        if (overflow) {
+            return false;
+        }
+        out.bodyCode = std::move(loads);
+        out.bodyCode.insert(out.bodyCode.end(), ops.begin(), ops.end());
+        out.resultRegister = result;
+        out.registers = static_cast<int>(isTemp.size());
+        return true;
+    }
+
+private:
+    CompiledExpression &out;
+    std::vector<Instruction> loads;
+    std::vector<bool> isTemp;
+    std::vector<int> freeTemps;
+    std::map<std::uint64_t, int> constantRegisters;
+    std::map<int, int> variableRegisters;
+    bool overflow = false;
+
+    static int computeNeed(ExprNode &node)
+    {
+        if (node.op == OpCode::Const || node.op == OpCode::LoadVar) {
+            node.need = 0;
+        } else if (!node.right) {
+            node.need = std::max(1, computeNeed(*node.left));
+        } else {
+            int l = computeNeed(*node.left);
+            int r = computeNeed(*node.right);
+            node.need = l == r ? l + 1 : std::max(l, r);
+        }
+        return node.need;
+    }
+
+    int newRegister(bool temp)
+    {
+        if (static_cast<int>(isTemp.size()) >= CompiledExpression::MaxRegisters) {
+            overflow = true;
+            return 0;
+        }
+        isTemp.push_back(temp);
+        return static_cast<int>(isTemp.size()) - 1;
+    }
+
+    int allocTemp()
+    {
+        if (!freeTemps.empty()) {
+            int reg = freeTemps.back();
+            freeTemps.pop_back();
+            return reg;
+        }
+        return newRegister(true);
+    }
+
+    void release(int reg)
+    {
+        if (isTemp[reg]) {
+            freeTemps.push_back(reg);
+        }
+    }
+
+    static Instruction instruction(OpCode op, int dst, int a = 0, int b = 0, double value = 0.0)
+    {
+        return Instruction{op, static_cast<unsigned char>(dst), static_cast<unsigned char>(a),
+                           static_cast<unsigned char>(b), value};
+    }
+
+    int emit(const ExprNode &node, std::vector<Instruction> &ops)
+    {
+        if (overflow) {
+            return 0;
+        }
+
+        if (node.op == OpCode::Const) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &node.value, sizeof(bits));
+            auto it = constantRegisters.find(bits);
+            if (it != constantRegisters.end()) {
+                return it->second;
+            }
+            int reg = newRegister(false);
+            constantRegisters[bits] = reg;
+            out.prologueCode.push_back(instruction(OpCode::Const, reg, 0, 0, node.value));
+            return reg;
+        }
+
+        if (node.op == OpCode::LoadVar) {
+            auto it = variableRegisters.find(node.variable);
+            if (it != variableRegisters.end()) {
+                return it->second;
+            }
+            int reg = newRegister(false);
+            variableRegisters[node.variable] = reg;
+            loads.push_back(instruction(OpCode::LoadVar, reg, node.variable));
+            return reg;
+        }
+
+        if (isUnary(node.op)) {
+            int a = emit(*node.left, ops);
+            int dst = isTemp[a] ? a : allocTemp();
+            ops.push_back(instruction(node.op, dst, a));
+            return dst;
+        }
+
+        // Сначала вычисляем более «тяжёлое» поддерево
+        int a, b;
+        if (node.right->need > node.left->need) {
+            b = emit(*node.right, ops);
+            a = emit(*node.left, ops);
+        } else {
+            a = emit(*node.left, ops);
+            b = emit(*node.right, ops);
+        }
+        if (overflow) {
+            return 0;
+        }
+
+        int dst;
+        if (isTemp[a]) {
+            dst = a;
+            release(b);
+        } else if (isTemp[b]) {
+            dst = b;
+        } else {
+            dst = allocTemp();
+        }
+        ops.push_back(instruction(node.op, dst, a, b));
+        return dst;
+    }
+};
+
+std::shared_ptr<const CompiledExpression> CompiledExpression::compile(const std::string &expr,
+                                                                      const std::vector<std::string> &variables,
+                                                                      std::string *error,
+                                                                      int *errorPos)
+{
+    try {
+        ExpressionParser parser(expr, variables);
+        NodePtr root = parser.parse();
+
+        auto compiled = std::make_shared<CompiledExpression>();
+        compiled->variables = static_cast<int>(variables.size());
+        ExpressionCodeGenerator generator(*compiled);
+        if (!generator.generate(*root)) {
+            throw ParseError{"Слишком сложное выражение", 0};
+        }
+        return compiled;
+    }
+    catch (const ParseError &e) {
+        if (error) *error = e.message;
+        if (errorPos) *errorPos = e.pos;
+        return nullptr;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Исполнение байткода
+
+namespace {
+
+template <double (*F)(double)>
+void mapUnary(double *d, const double *a, int n)
+{
+    for (int i = 0; i < n; ++i) d[i] = F(a[i]);
+}
+
+template <double (*F)(double, double)>
+void mapBinary(double *d, const double *a, const double *b, int n)
+{
+    for (int i = 0; i < n; ++i) d[i] = F(a[i], b[i]);
+}
+
+// Скалярная реализация векторизуемых операций
+struct ScalarOps {
+    static void add(double *d, const double *a, const double *b, int n) { for (int i = 0; i < n; ++i) d[i] = a[i] + b[i]; }
+    static void sub(double *d, const double *a, const double *b, int n) { for (int i = 0; i < n; ++i) d[i] = a[i] - b[i]; }
+    static void mul(double *d, const double *a, const double *b, int n) { for (int i = 0; i < n; ++i) d[i] = a[i] * b[i]; }
+    static void div(double *d, const double *a, const double *b, int n) { for (int i = 0; i < n; ++i) d[i] = a[i] / b[i]; }
+    static void neg(double *d, const double *a, int n) { for (int i = 0; i < n; ++i) d[i] = -a[i]; }
+    static void abs(double *d, const double *a, int n) { for (int i = 0; i < n; ++i) d[i] = std::abs(a[i]); }
+    static void sqrt(double *d, const double *a, int n) { for (int i = 0; i < n; ++i) d[i] = std::sqrt(a[i]); }
+};
+
+#if EXPRESSION_HAVE_X86_SIMD
+
+// Регистры выровнены на 32 байта, поэтому используются выровненные загрузки;
+// хвост блока, не кратный ширине вектора, досчитывается скалярно
+#define EXPRESSION_SSE2_BINARY(NAME, INTRINSIC, OPERATOR) \
+    static void NAME(double *d, const double *a, const double *b, int n) { \
+        int i = 0; \
+        for (; i + 2 <= n; i += 2) _mm_store_pd(d + i, INTRINSIC(_mm_load_pd(a + i), _mm_load_pd(b + i))); \
+        for (; i < n; ++i) d[i] = a[i] OPERATOR b[i]; \
+    }
+
+struct Sse2Ops {
+    EXPRESSION_SSE2_BINARY(add, _mm_add_pd, +)
+    EXPRESSION_SSE2_BINARY(sub, _mm_sub_pd, -)
+    EXPRESSION_SSE2_BINARY(mul, _mm_mul_pd, *)
+    EXPRESSION_SSE2_BINARY(div, _mm_div_pd, /)
+
+    static void neg(double *d, const double *a, int n) {
+        const __m128d sign = _mm_set1_pd(-0.0);
+        int i = 0;
+        for (; i + 2 <= n; i += 2) _mm_store_pd(d + i, _mm_xor_pd(_mm_load_pd(a + i), sign));
+        for (; i < n; ++i) d[i] = -a[i];
+    }
+    static void abs(double *d, const double *a, int n) {
+        const __m128d sign = _mm_set1_pd(-0.0);
+        int i = 0;
+        for (; i + 2 <= n; i += 2) _mm_store_pd(d + i, _mm_andnot_pd(sign, _mm_load_pd(a + i)));
+        for (; i < n; ++i) d[i] = std::abs(a[i]);
+    }
+    static void sqrt(double *d, const double *a, int n) {
+        int i = 0;
+        for (; i + 2 <= n; i += 2) _mm_store_pd(d + i, _mm_sqrt_pd(_mm_load_pd(a + i)));
+        for (; i < n; ++i) d[i] = std::sqrt(a[i]);
+    }
+};
+
+#undef EXPRESSION_SSE2_BINARY
+
+#endif
+
+#if EXPRESSION_HAVE_AVX2
+
+#define EXPRESSION_AVX2_BINARY(NAME, INTRINSIC, OPERATOR) \
+    EXPRESSION_TARGET_AVX2 static void NAME(double *d, const double *a, const double *b, int n) { \
+        int i = 0; \
+        for (; i + 4 <= n; i += 4) _mm256_store_pd(d + i, INTRINSIC(_mm256_load_pd(a + i), _mm256_load_pd(b + i))); \
+        for (; i < n; ++i) d[i] = a[i] OPERATOR b[i]; \
+    }
+
+struct Avx2Ops {
+    EXPRESSION_AVX2_BINARY(add, _mm256_add_pd, +)
+    EXPRESSION_AVX2_BINARY(sub, _mm256_sub_pd, -)
+    EXPRESSION_AVX2_BINARY(mul, _mm256_mul_pd, *)
+    EXPRESSION_AVX2_BINARY(div, _mm256_div_pd, /)
+
+    EXPRESSION_TARGET_AVX2 static void neg(double *d, const double *a, int n) {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) _mm256_store_pd(d + i, _mm256_xor_pd(_mm256_load_pd(a + i), sign));
+        for (; i < n; ++i) d[i] = -a[i];
+    }
+    EXPRESSION_TARGET_AVX2 static void abs(double *d, const double *a, int n) {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) _mm256_store_pd(d + i, _mm256_andnot_pd(sign, _mm256_load_pd(a + i)));
+        for (; i < n; ++i) d[i] = std::abs(a[i]);
+    }
+    EXPRESSION_TARGET_AVX2 static void sqrt(double *d, const double *a, int n) {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) _mm256_store_pd(d + i, _mm256_sqrt_pd(_mm256_load_pd(a + i)));
+        for (; i < n; ++i) d[i] = std::sqrt(a[i]);
+    }
+};
+
+#undef EXPRESSION_AVX2_BINARY
+
+#endif
+
+// Интерпретатор байткода: каждая инструкция применяется сразу к блоку значений
+template <typename Ops>
+void runProgram(const std::vector<Instruction> &prologue, const std::vector<Instruction> &body,
+                int resultRegister, const double *const *variables, double *ys, int count)
+{
+    constexpr int blockSize = CompiledExpression::BlockSize;
+    alignas(32) double regs[CompiledExpression::MaxRegisters][blockSize];
+
+    for (const Instruction &ins : prologue) {
+        for (int i = 0; i < blockSize; ++i) regs[ins.dst][i] = ins.value;
+    }
+
+    for (int start = 0; start < count; start += blockSize) {
+        const int n = count - start < blockSize ? count - start : blockSize;
+
+        for (const Instruction &ins : body) {
+            double *d = regs[ins.dst];
+            const double *a = regs[ins.a];
+            const double *b = regs[ins.b];
+
+            switch (ins.op) {
+            case OpCode::LoadVar: {
+                const double *src = variables[ins.a] + start;
+                for (int i = 0; i < n; ++i) d[i] = src[i];
+                break;
+            }
+            case OpCode::Add: Ops::add(d, a, b, n); break;
+            case OpCode::Sub: Ops::sub(d, a, b, n); break;
+            case OpCode::Mul: Ops::mul(d, a, b, n); break;
+            case OpCode::Div: Ops::div(d, a, b, n); break;
+            case OpCode::Neg: Ops::neg(d, a, n); break;
+            case OpCode::Abs: Ops::abs(d, a, n); break;
+            case OpCode::Sqrt: Ops::sqrt(d, a, n); break;
+            case OpCode::PowOp: mapBinary<fnPowOp>(d, a, b, n); break;
+            case OpCode::Pow: mapBinary<fnPow>(d, a, b, n); break;
+            case OpCode::Power: mapBinary<fnPower>(d, a, b, n); break;
+            case OpCode::Sin: mapUnary<fnSin>(d, a, n); break;
+            case OpCode::Cos: mapUnary<fnCos>(d, a, n); break;
+            case OpCode::Tan: mapUnary<fnTan>(d, a, n); break;
+            case OpCode::Cot: mapUnary<fnCot>(d, a, n); break;
+            case OpCode::Exp: mapUnary<fnExp>(d, a, n); break;
+            case OpCode::Log: mapUnary<fnLog>(d, a, n); break;
+            case OpCode::Log10: mapUnary<fnLog10>(d, a, n); break;
+            case OpCode::Const: break;
+            }
+        }
+
+        const double *result = regs[resultRegister];
+        for (int i = 0; i < n; ++i) ys[start + i] = result[i];
+    }
+}
+
+} // namespace
+
+void CompiledExpression::evaluate(const double *xs, double *ys, int count) const
+{
+    evaluate(&xs, ys, count, detectedBackend());
+}
+
+void CompiledExpression::evaluate(const double *const *variables, double *ys, int count) const
+{
+    evaluate(variables, ys, count, detectedBackend());
+}
+
+void CompiledExpression::evaluate(const double *const *variables, double *ys, int count, Backend backend) const
+{
+    if (count <= 0) {
+        return;
+    }
+
+    switch (backend) {
+#if EXPRESSION_HAVE_AVX2
+    case Backend::Avx2:
+        runProgram<Avx2Ops>(prologueCode, bodyCode, resultRegister, variables, ys, count);
+        return;
+#endif
+#if EXPRESSION_HAVE_X86_SIMD
+    case Backend::Sse2:
+        runProgram<Sse2Ops>(prologueCode, bodyCode, resultRegister, variables, ys, count);
+        return;
+#endif
+    default:
+        runProgram<ScalarOps>(prologueCode, bodyCode, resultRegister, variables, ys, count);
+        return;
+    }
+}
+
+CompiledExpression::Backend CompiledExpression::detectedBackend()
+{
+    static const Backend backend = [] {
+#if EXPRESSION_HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Backend::Avx2;
+        }
+#endif
+#if EXPRESSION_HAVE_X86_SIMD
+        return Backend::Sse2;
+#else
+        return Backend::Scalar;
+#endif
+    }();
+    return backend;
+}
+
+const char *CompiledExpression::backendName(Backend backend)
+{
+    switch (backend) {
+    case Backend::Avx2: return "avx2";
+    case Backend::Sse2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Кэш скомпилированных выражений
+
+CompiledExpressionCache::CompiledExpressionCache(std::size_t capacity)
+    : capacity(std::max<std::size_t>(1, capacity))
+{
+}
+
+CompiledExpressionCache &CompiledExpressionCache::instance()
+{
+    static CompiledExpressionCache cache;
+    return cache;
+}
+
+std::shared_ptr<const CompiledExpression> CompiledExpressionCache::get(const std::string &expr)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(expr);
+        if (it != index.end()) {
+            ++hits;
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->compiled;
+        }
+        ++misses;
+    }
+
+    // Компилируем без блокировки; если то же выражение успел добавить другой
+    // поток, берём его результат
+    std::shared_ptr<const CompiledExpression> compiled = CompiledExpression::compile(expr);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(expr);
+    if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->compiled;
+    }
+    entries.push_front(Entry{expr, compiled});
+    index.emplace(expr, entries.begin());
+    trim();
+    return compiled;
+}
+
+CompiledExpressionCache::Stats CompiledExpressionCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.size = entries.size();
+    return result;
+}
+
+void CompiledExpressionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    hits = 0;
+    misses = 0;
+}
+
+void CompiledExpressionCache::setCapacity(std::size_t newCapacity)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = std::max<std::size_t>(1, newCapacity);
+    trim();
+}
+
+void CompiledExpressionCache::trim()
+{
+    while (entries.size() > capacity) {
+        index.erase(entries.back().expr);
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef EXPRESSIONCOMPILER_H
+#define EXPRESSIONCOMPILER_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Собственный вычислитель выражений — альтернатива muParser на горячем пути.
+// Строка (результат Function::preprocessExpression) разбирается в AST, затем
+// переводится в байткод с распределёнными регистрами. Байткод исполняется блоками
+// значений переменных: арифметика идёт через SSE2/AVX2 (выбор при запуске по
+// возможностям процессора), на остальных платформах — скалярный вариант.
+// Поддерживается подмножество синтаксиса muParser; если выражение в него не входит,
+// compile() возвращает nullptr, и вызывающий код остаётся на muParser.
+class CompiledExpression
+{
+public:
+    enum class OpCode : unsigned char {
+        Const,      // dst = value (пролог)
+        LoadVar,    // dst = переменная a (начало каждого блока)
+        Add,        // dst = a + b
+        Sub,        // dst = a - b
+        Mul,        // dst = a * b
+        Div,        // dst = a / b
+        Neg,        // dst = -a
+        PowOp,      // dst = a ^ b (оператор muParser, std::pow)
+        Pow,        // dst = pow(a, b) через power_wrapper
+        Power,      // dst = power(a, b)
+        Sin,
+        Cos,
+        Tan,
+        Cot,
+        Sqrt,
+        Abs,
+        Exp,
+        Log,
+        Log10
+    };
+
+    struct Instruction {
+        OpCode op;
+        unsigned char dst;
+        unsigned char a;
+        unsigned char b;
+        double value;
+    };
+
+    enum class Backend {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    // Максимальное число регистров; более сложные выражения не компилируются
+    static constexpr int MaxRegisters = 32;
+    // Количество значений, обрабатываемых за один проход байткода
+    static constexpr int BlockSize = 64;
+
+    // Компилирует выражение с переменными variables (по умолчанию только "x").
+    // При ошибке возвращает nullptr и, если переданы, заполняет текст и позицию ошибки.
+    static std::shared_ptr<const CompiledExpression> compile(const std::string &expr,
+                                                             const std::vector<std::string> &variables = {"x"},
+                                                             std::string *error = nullptr,
+                                                             int *errorPos = nullptr);
+
+    // ys[i] = f(xs[i]) для выражения с одной переменной
+    void evaluate(const double *xs, double *ys, int count) const;
+    // ys[i] = f(variables[0][i], variables[1][i], ...)
+    void evaluate(const double *const *variables, double *ys, int count) const;
+    // То же с явно выбранной реализацией (для сравнения в бенчмарке)
+    void evaluate(const double *const *variables, double *ys, int count, Backend backend) const;
+
+    int registerCount() const { return registers; }
+    int variableCount() const { return variables; }
+    const std::vector<Instruction> &prologue() const { return prologueCode; }
+    const std::vector<Instruction> &program() const { return bodyCode; }
+
+    // Лучшая реализация, доступная на этом процессоре
+    static Backend detectedBackend();
+    static const char *backendName(Backend backend);
+
+private:
+    std::vector<Instruction> prologueCode; // загрузка констант, выполняется один раз
+    std::vector<Instruction> bodyCode;     // загрузка переменных и вычисления, на каждый блок
+    int registers = 0;
+    int variables = 0;
+    int resultRegister = 0;
+
+    friend class ExpressionCodeGenerator;
+};
+
+// Кэш скомпилированных выражений с вытеснением давно не использованных (LRU).
+// Ключ — нормализованный текст выражения (Function::preprocessExpression), поэтому
+// одинаковые кривые, разные виджеты и повторный ввод того же текста при
+// редактировании получают один и тот же CompiledExpression. Неудачная компиляция
+// тоже запоминается, чтобы не повторять её. Потокобезопасен.
+class CompiledExpressionCache
+{
+public:
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::size_t size = 0;
+    };
+
+    static constexpr std::size_t DefaultCapacity = 256;
+
+    explicit CompiledExpressionCache(std::size_t capacity = DefaultCapacity);
+
+    // Общий кэш приложения
+    static CompiledExpressionCache &instance();
+
+    // Скомпилированное выражение с одной переменной x; nullptr, если
+    // собственный вычислитель его не поддерживает
+    std::shared_ptr<const CompiledExpression> get(const std::string &expr);
+
+    Stats stats() const;
+    void clear();
+    void setCapacity(std::size_t capacity);
+
+private:
+    struct Entry {
+        std::string expr;
+        std::shared_ptr<const CompiledExpression> compiled;
+    };
+
+    mutable std::mutex mutex;
+    std::size_t capacity;
+    // В начале списка — последние использованные
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+
+    void trim();
+};
+
+#endif // EXPRESSIONCOMPILER_H
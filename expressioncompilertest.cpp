@@ -0,0 +1,185 @@
+#include <QTextStream>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <vector>
+#include "function.h"
+#include "expressioncompiler.h"
+
+// Собственный вычислитель (CompiledExpression) против muParser. Каждое выражение
+// считается всеми реализациями байткода — скалярной, SSE2 и, если процессор умеет,
+// AVX2 — и сравнивается с muParser, в котором зарегистрированы те же встроенные
+// функции, что и у графиков (Function::prototypeParser). Среди значений x — края
+// областей определения: log и sqrt от нуля и отрицательных чисел, полюса tan и cot,
+// переполнение exp, бесконечности и NaN. Тест падает, если отклонение больше допуска
+// или NaN и бесконечности стоят не там, где у muParser. Выражения вне поддерживаемого
+// подмножества синтаксиса compile() должен отвергать (nullptr).
+
+namespace {
+
+// Допуск: |native - muParser| <= AbsoluteTolerance + RelativeTolerance * |muParser|
+constexpr double RelativeTolerance = 1e-12;
+constexpr double AbsoluteTolerance = 1e-12;
+// Сколько расхождений печатать на одно выражение и реализацию
+constexpr int MaxReportedMismatches = 5;
+
+// Выражения в синтаксисе muParser (результат Function::preprocessExpression)
+const char *const supportedExpressions[] = {
+    "pow(x,2)",
+    "pow(x,0.5)",
+    "pow(x,-3)",
+    "power(x,3)",
+    "power(x,1.5)",
+    "x^2",
+    "x^0.5",
+    "x^-2",
+    "-x^2",
+    "sin(x)",
+    "cos(x)",
+    "tan(x)",
+    "cot(x)",
+    "sqrt(x)",
+    "abs(x)",
+    "exp(x)",
+    "log(x)",
+    "log10(x)",
+    "_pi*x+_e",
+    "sin(_pi*x)/x",
+    "2*pow(x,2)+3*x-1",
+    "sin(x)*cos(2*x)",
+    "exp(-pow(x,2))*log(abs(x)+1)",
+    "sqrt(abs(x))/(1+pow(x,2))+tan(x/3)",
+    "log(x)/log10(x)",
+    "cot(x)*tan(x)",
+    "pow(exp(log(abs(x)+1)),1.5)*log(exp(x/10)+pow(abs(x),0.3))",
+    "(x)+0*x"
+};
+
+// Синтаксис, которого собственный вычислитель не знает: остаётся muParser
+const char *const unsupportedExpressions[] = {
+    "sinh(x)",
+    "max(x,1)",
+    "rnd()",
+    "x>1?1:0",
+    "x==1",
+    "x&&1",
+    "y+1",
+    "x+",
+    "(x+1",
+    "sin(x,1)",
+    "pow(x)",
+    ""
+};
+
+std::vector<double> sampleValues()
+{
+    std::vector<double> xs;
+    for (int i = 0; i <= 2000; ++i) {
+        xs.push_back(-10.0 + 20.0 * i / 2000);
+    }
+    const double pi = 3.141592653589793238462643;
+    const double edges[] = {
+        0.0, -0.0, 1e-300, -1e-300, 1.0, -1.0, 0.5, -0.5,
+        pi / 2, -pi / 2, 3 * pi / 2, pi, -pi,   // полюса tan и cot
+        709.0, 710.0, -745.0, -750.0,           // переполнение и исчезновение exp
+        1e154, 1e308, -1e308,
+        std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::quiet_NaN()
+    };
+    xs.insert(xs.end(), std::begin(edges), std::end(edges));
+    return xs;
+}
+
+// NaN и бесконечности должны совпадать точно, конечные значения — с допуском
+bool matches(double native, double reference)
+{
+    if (std::isnan(native) || std::isnan(reference)) {
+        return std::isnan(native) && std::isnan(reference);
+    }
+    if (std::isinf(native) || std::isinf(reference)) {
+        return native == reference;
+    }
+    return std::abs(native - reference) <= AbsoluteTolerance + RelativeTolerance * std::abs(reference);
+}
+
+} // namespace
+
+int main()
+{
+    QTextStream out(stdout);
+    int failures = 0;
+
+    std::vector<CompiledExpression::Backend> backends = {CompiledExpression::Backend::Scalar};
+#if defined(__x86_64__) || defined(_M_X64)
+    backends.push_back(CompiledExpression::Backend::Sse2);
+#endif
+    if (CompiledExpression::detectedBackend() == CompiledExpression::Backend::Avx2) {
+        backends.push_back(CompiledExpression::Backend::Avx2);
+    } else {
+        out << "avx2: процессор не поддерживает, пропущено\n";
+    }
+
+    const std::vector<double> xs = sampleValues();
+    const int count = static_cast<int>(xs.size());
+    const double *variables[] = {xs.data()};
+
+    for (const char *expr : supportedExpressions) {
+        // Эталон — muParser, по точке за вызов
+        std::vector<double> reference(count);
+        try {
+            mu::Parser parser(Function::prototypeParser());
+            double x = 0.0;
+            parser.DefineVar("x", &x);
+            parser.SetExpr(expr);
+            for (int i = 0; i < count; ++i) {
+                x = xs[i];
+                reference[i] = parser.Eval();
+            }
+        }
+        catch (const mu::Parser::exception_type &e) {
+            out << "FAIL " << expr << ": muParser: " << QString::fromStdString(e.GetMsg()) << '\n';
+            ++failures;
+            continue;
+        }
+
+        std::string error;
+        const std::shared_ptr<const CompiledExpression> compiled = CompiledExpression::compile(expr, {"x"}, &error);
+        if (!compiled) {
+            out << "FAIL " << expr << ": не скомпилировано: " << QString::fromStdString(error) << '\n';
+            ++failures;
+            continue;
+        }
+
+        for (CompiledExpression::Backend backend : backends) {
+            std::vector<double> ys(count);
+            compiled->evaluate(variables, ys.data(), count, backend);
+            int mismatches = 0;
+            for (int i = 0; i < count; ++i) {
+                if (matches(ys[i], reference[i])) {
+                    continue;
+                }
+                if (++mismatches <= MaxReportedMismatches) {
+                    out << "FAIL " << expr << " [" << CompiledExpression::backendName(backend) << "] x = "
+                        << QString::number(xs[i], 'g', 17) << ": " << QString::number(ys[i], 'g', 17)
+                        << ", muParser " << QString::number(reference[i], 'g', 17) << '\n';
+                }
+            }
+            if (mismatches > 0) {
+                ++failures;
+            }
+        }
+    }
+
+    for (const char *expr : unsupportedExpressions) {
+        if (CompiledExpression::compile(expr)) {
+            out << "FAIL " << expr << ": должно остаться на muParser, но скомпилировано\n";
+            ++failures;
+        }
+    }
+
+    out << (failures == 0 ? "OK" : "FAILED") << ": " << std::size(supportedExpressions) << " выражений x "
+        << backends.size() << " реализаций x " << count << " точек, " << std::size(unsupportedExpressions)
+        << " неподдерживаемых; ошибок " << failures << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+#include "expressionnormalizer.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+bool isDigit(QChar c)
+{
+    return c >= QLatin1Char('0') && c <= QLatin1Char('9');
+}
+
+bool isIdentifierStart(QChar c)
+{
+    return (c >= QLatin1Char('a') && c <= QLatin1Char('z')) ||
+           (c >= QLatin1Char('A') && c <= QLatin1Char('Z')) || c == QLatin1Char('_');
+}
+
+bool isIdentifierChar(QChar c)
+{
+    return isIdentifierStart(c) || isDigit(c);
+}
+
+// Однопроходный разбор: каждый символ читается один раз, скобки обрабатываются
+// рекурсивно. Все уровни вложенности пишут в одну выходную строку; для a^b в ней
+// остаются основание, затем ",b)", а начало основания запоминается, и "pow("
+// вставляется по этим позициям одной сборкой в конце. Поэтому основание и
+// вложенные группы не копируются, и время линейно по длине выражения.
+class Normalizer
+{
+public:
+    Normalizer(const QString &text, const QString &variables, std::vector<int> *sources)
+        : text(text), length(text.size()), variables(variables), sources(sources) {}
+
+    QString run()
+    {
+        int pos = 0;
+        out.reserve(length + length / 2);
+        // Лишние закрывающие скобки копируем как есть
+        for (;;) {
+            sequence(pos);
+            if (pos >= length) {
+                break;
+            }
+            put(text[pos], pos);
+            ++pos;
+            last = Token::Other;
+        }
+        return withPowCalls();
+    }
+
+private:
+    // Что стоит в выходной строке непосредственно (без пробела) перед текущей позицией
+    enum class Token {
+        None,
+        Number,
+        Variable,
+        Group,   // закрывающая скобка: группа, вызов функции или pow(...)
+        Other
+    };
+
+    const QString &text;
+    const int length;
+    const QString &variables;
+    QString out;
+    // Для каждого символа out — позиция в text, из-за которой он появился;
+    // nullptr, если карта не нужна
+    std::vector<int> *sources;
+    // Позиции в out, перед которыми вставляется "pow("
+    std::vector<int> powStarts;
+    Token last = Token::None;
+    bool numberEndsWithDigit = false;
+
+    void put(QChar c, int source)
+    {
+        out += c;
+        if (sources) {
+            sources->push_back(source);
+        }
+    }
+
+    // Символы s взяты из text подряд, начиная с source
+    void put(const QString &s, int source)
+    {
+        out += s;
+        if (sources) {
+            for (int i = 0; i < s.size(); ++i) {
+                sources->push_back(source + i);
+            }
+        }
+    }
+
+    QString readWhile(int &pos, bool (*accept)(QChar)) const
+    {
+        const int start = pos;
+        while (pos < length && accept(text[pos])) {
+            ++pos;
+        }
+        return text.mid(start, pos - start);
+    }
+
+    // Однобуквенная переменная; заглавная буква приводится к строчной
+    bool isVariable(QChar c) const
+    {
+        return variables.contains(c.toLower());
+    }
+
+    static bool isNumberChar(QChar c)
+    {
+        return isDigit(c) || c == QLatin1Char('.');
+    }
+
+    static bool hasDigit(const QString &number)
+    {
+        for (QChar c : number) {
+            if (isDigit(c)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // pos указывает на '('; дописывает группу целиком и встаёт за ')'
+    void group(int &pos)
+    {
+        put(QLatin1Char('('), pos);
+        ++pos;
+        sequence(pos);
+        if (pos < length) {
+            put(QLatin1Char(')'), pos);
+            ++pos;
+            last = Token::Group;
+        }
+        // Незакрытая скобка остаётся как есть, muParser сообщит об ошибке
+    }
+
+    // Может ли с pos начинаться показатель степени: число, переменная или скобка
+    bool isExponentStart(int pos) const
+    {
+        if (pos >= length) {
+            return false;
+        }
+        const QChar c = text[pos];
+        // x2 в показателе: показатель — x, а цифры пойдут множителем (x*2)
+        return isNumberChar(c) || c == QLatin1Char('(') ||
+               (isVariable(c) && (pos + 1 >= length || !isIdentifierChar(text[pos + 1]) || isDigit(text[pos + 1])));
+    }
+
+    // Дописывает показатель, начинающийся с pos (см. isExponentStart), и встаёт
+    // за него; last описывает его конец
+    void exponent(int &pos)
+    {
+        const QChar c = text[pos];
+        if (isNumberChar(c)) {
+            const int start = pos;
+            const QString number = readWhile(pos, isNumberChar);
+            put(number, start);
+            last = Token::Number;
+            numberEndsWithDigit = isDigit(number.back());
+        } else if (c == QLatin1Char('(')) {
+            group(pos);
+        } else {
+            put(c.toLower(), pos);
+            ++pos;
+            last = Token::Variable;
+        }
+    }
+
+    // Разбирает последовательность до конца строки или до ')' (не включая её)
+    void sequence(int &pos)
+    {
+        // Начало в out операнда, который может стать основанием степени
+        int baseStart = -1;
+        last = Token::None;
+
+        while (pos < length) {
+            const QChar c = text[pos];
+
+            if (c.isSpace()) {
+                put(c, pos);
+                ++pos;
+                last = Token::None;
+                continue;
+            }
+
+            // Конец группы; лишнюю ')' на верхнем уровне допишет run()
+            if (c == QLatin1Char(')')) {
+                return;
+            }
+
+            // Вставленный знак умножения относится к позиции следующего операнда
+            const int start = pos;
+
+            if (isNumberChar(c)) {
+                const QString number = readWhile(pos, isNumberChar);
+                // x.5 -> x*.5
+                if (last == Token::Variable && hasDigit(number)) {
+                    put(QLatin1Char('*'), start);
+                }
+                baseStart = out.size();
+                put(number, start);
+                last = Token::Number;
+                numberEndsWithDigit = isDigit(number.back());
+                continue;
+            }
+
+            if (isIdentifierStart(c)) {
+                const QString identifier = readWhile(pos, isIdentifierChar);
+                bool variable = isVariable(identifier[0]);
+                for (int i = 1; variable && i < identifier.size(); ++i) {
+                    variable = isDigit(identifier[i]);
+                }
+
+                if (variable) {
+                    // 2x -> 2*x, )x -> )*x
+                    if ((last == Token::Number && numberEndsWithDigit) || last == Token::Group) {
+                        put(QLatin1Char('*'), start);
+                    }
+                    baseStart = out.size();
+                    put(identifier[0].toLower(), start);
+                    last = Token::Variable;
+                    // x2 -> x*2
+                    if (identifier.size() > 1) {
+                        put(QLatin1Char('*'), start + 1);
+                        baseStart = out.size();
+                        put(identifier.mid(1), start + 1);
+                        last = Token::Number;
+                        numberEndsWithDigit = true;
+                    }
+                } else if (pos < length && text[pos] == QLatin1Char('(')) {
+                    // Вызов функции целиком может быть основанием степени
+                    baseStart = out.size();
+                    put(identifier, start);
+                    group(pos);
+                } else {
+                    put(identifier, start);
+                    baseStart = -1;
+                    last = Token::Other;
+                }
+                continue;
+            }
+
+            if (c == QLatin1Char('(')) {
+                // )( -> )*(, x( -> x*(, 2( -> 2*(
+                if (last == Token::Group || last == Token::Variable || last == Token::Number) {
+                    put(QLatin1Char('*'), start);
+                }
+                baseStart = out.size();
+                group(pos);
+                continue;
+            }
+
+            if (c == QLatin1Char('^') && baseStart >= 0) {
+                int next = pos + 1;
+                while (next < length && text[next].isSpace()) {
+                    ++next;
+                }
+                if (isExponentStart(next)) {
+                    // Пробелы между основанием и ^ в pow(...) не попадают
+                    while (out.size() > baseStart && out.back().isSpace()) {
+                        out.chop(1);
+                        if (sources) {
+                            sources->pop_back();
+                        }
+                    }
+                    powStarts.push_back(baseStart);
+                    // Запятая и закрывающая скобка pow относятся к позиции ^
+                    put(QLatin1Char(','), pos);
+                    exponent(next);
+                    put(QLatin1Char(')'), pos);
+                    pos = next;
+                    // Результат сам основанием не становится: a^b^c -> pow(a,b)^c.
+                    // last остаётся от показателя, чтобы x^2x дало pow(x,2)*x
+                    baseStart = -1;
+                    continue;
+                }
+            }
+
+            put(c, pos);
+            ++pos;
+            baseStart = -1;
+            last = Token::Other;
+        }
+    }
+
+    // Вставляет "pow(" перед запомненными основаниями. Внутренние степени
+    // запоминаются раньше внешних, поэтому позиции сначала упорядочиваются.
+    // В карте позиций "pow(" относится к началу основания
+    QString withPowCalls()
+    {
+        if (powStarts.empty()) {
+            return out;
+        }
+        std::sort(powStarts.begin(), powStarts.end());
+        const QLatin1String pow("pow(");
+        QString result;
+        result.reserve(out.size() + int(powStarts.size()) * pow.size());
+        std::vector<int> resultSources;
+        if (sources) {
+            resultSources.reserve(sources->size() + powStarts.size() * pow.size());
+        }
+        int copied = 0;
+        for (int start : powStarts) {
+            result.append(out.constData() + copied, start - copied);
+            result += pow;
+            if (sources) {
+                resultSources.insert(resultSources.end(), sources->begin() + copied, sources->begin() + start);
+                resultSources.insert(resultSources.end(), pow.size(), (*sources)[start]);
+            }
+            copied = start;
+        }
+        result.append(out.constData() + copied, out.size() - copied);
+        if (sources) {
+            resultSources.insert(resultSources.end(), sources->begin() + copied, sources->end());
+            sources->swap(resultSources);
+        }
+        return result;
+    }
+};
+
+} // namespace
+
+QString ExpressionNormalizer::normalize(const QString &expr, const QString &variables,
+                                       std::vector<int> *sourcePositions)
+{
+    if (sourcePositions) {
+        sourcePositions->clear();
+    }
+    return Normalizer(expr, variables, sourcePositions).run();
+}
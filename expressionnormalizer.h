@@ -0,0 +1,28 @@
+#ifndef EXPRESSIONNORMALIZER_H
+#define EXPRESSIONNORMALIZER_H
+
+#include <QString>
+#include <vector>
+
+// Приведение введённого пользователем выражения к синтаксису muParser за один
+// проход по строке, без регулярных выражений:
+//  - неявное умножение: 2x -> 2*x, x2 -> x*2, x.5 -> x*.5, 2(...) -> 2*(...),
+//    )( -> )*(, )x -> )*x, x( -> x*(;
+//  - переменная X приводится к x;
+//  - то же для других однобуквенных переменных из variables (у неявных кривых — x и y);
+//  - a^b -> pow(a,b), где a — число, x, скобка или вызов функции, а b — число,
+//    x или скобка. Скобки могут быть вложенными, степени внутри них тоже
+//    переписываются. Цепочка a^b^c даёт pow(a,b)^c, как и прежняя обработка.
+// Имена функций не трогаются: x внутри имени (exp, max) переменной не считается.
+class ExpressionNormalizer
+{
+public:
+    // sourcePositions, если задан, получает для каждого символа результата позицию
+    // в expr, из которой он получен: вставленный знак * — позицию следующего операнда,
+    // "pow(" — начала основания, запятая и скобка pow — позицию ^. По ней позиция
+    // ошибки muParser переводится обратно во введённый текст
+    static QString normalize(const QString &expr, const QString &variables = QStringLiteral("x"),
+                             std::vector<int> *sourcePositions = nullptr);
+};
+
+#endif // EXPRESSIONNORMALIZER_H
@@ -0,0 +1,133 @@
+#include <QTextStream>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include "expressionnormalizer.h"
+#include "legacynormalizer.h"
+
+// ExpressionNormalizer::normalize по таблице входов и ожидаемых выходов. Для
+// обычных строк прежняя обработка регулярными выражениями (legacynormalizer.h)
+// должна давать то же самое. Строки с пометкой divergence — задокументированные
+// расхождения: там прежняя обработка ошибалась, и тест проверяет, что она
+// по-прежнему даёт другое, а нормализатор — исправленный результат.
+// Отдельно проверяется карта позиций результата во введённом тексте.
+
+namespace {
+
+struct Case {
+    const char *input;
+    const char *expected;
+    bool divergence;
+};
+
+const Case cases[] = {
+    // Неявное умножение
+    {"x", "x", false},
+    {"2x", "2*x", false},
+    {"2.5x", "2.5*x", false},
+    {".5x", ".5*x", false},
+    {"x2", "x*2", false},
+    {"x.5", "x*.5", false},
+    {"x(x+1)", "x*(x+1)", false},
+    {"(x+1)(x-1)", "(x+1)*(x-1)", false},
+    {"(x+1)x", "(x+1)*x", false},
+    {"(x+1)(x-1)x", "(x+1)*(x-1)*x", false},
+    {"2x^2 + 3x - 1", "2*pow(x,2) + 3*x - 1", false},
+    {"sin(x)*cos(2x)", "sin(x)*cos(2*x)", false},
+    // Регистр: X приводится к x, имена функций не трогаются
+    {"X", "x", false},
+    {"SIN(X)", "SIN(x)", false},
+    {"sin(X)", "sin(x)", false},
+    {"X^3 - 2.5x + x.5", "pow(x,3) - 2.5*x + x*.5", false},
+    // Степени
+    {"x^2", "pow(x,2)", false},
+    {"x ^ 2", "pow(x,2)", false},
+    {"2^x", "pow(2,x)", false},
+    {"3x^2", "3*pow(x,2)", false},
+    {"x^(x+1)", "pow(x,(x+1))", false},
+    {"(x-1)^(x+1)", "pow((x-1),(x+1))", false},
+    {"x^2^3", "pow(x,2)^3", false},
+    {"x^2x", "pow(x,2)*x", false},
+    {"exp(-x^2)*log(abs(x)+1)", "exp(-pow(x,2))*log(abs(x)+1)", false},
+    {"sqrt(abs(x))/(1+x^2) + tan(x/3)", "sqrt(abs(x))/(1+pow(x,2)) + tan(x/3)", false},
+    // Число остаётся как есть
+    {"2.5", "2.5", false},
+    // Задокументированные расхождения с прежней обработкой:
+    // число перед скобкой (было 2(x+1))
+    {"2(x+1)", "2*(x+1)", true},
+    // вложенные скобки в основании и показателе (было без pow / x^(2) внутри)
+    {"(x+(1))^2", "pow((x+(1)),2)", true},
+    {"2^(x^(2))", "pow(2,(pow(x,(2))))", true},
+    {"((x+1)*2)^2", "pow(((x+1)*2),2)", true},
+    // вызов функции в основании степени (было sinpow((x),2))
+    {"sin(x)^2", "pow(sin(x),2)", true},
+    {"abs(x)^0.5", "pow(abs(x),0.5)", true},
+    // x внутри имени функции (было max*(x,1))
+    {"max(x,1)", "max(x,1)", true}
+};
+
+// Символ результата с номером output должен происходить из позиции source входа
+struct PositionCase {
+    const char *input;
+    int output;
+    int source;
+};
+
+const PositionCase positionCases[] = {
+    {"2x^2+*3", 11, 5},         // 2*pow(x,2)+*3: лишний * после вставок
+    {"2x^2+*3", 1, 1},          // вставленный * — позиция x
+    {"2x^2+*3", 2, 1},          // pow( — начало основания
+    {"sin(x)^2 + 3x", 18, 12},  // pow(sin(x),2) + 3*x: x после вставок
+    {"x ^ 2", 5, 2},            // pow(x,2): запятая — позиция ^
+    {"X2", 2, 1}                // x*2: цифры после вставленного *
+};
+
+} // namespace
+
+int main()
+{
+    QTextStream out(stdout);
+    int failures = 0;
+
+    for (const Case &c : cases) {
+        const QString input = QString::fromUtf8(c.input);
+        const QString expected = QString::fromUtf8(c.expected);
+        std::vector<int> sources;
+        const QString normalized = ExpressionNormalizer::normalize(input, QStringLiteral("x"), &sources);
+        if (normalized != expected) {
+            out << "FAIL " << input << ": " << normalized << ", ожидалось " << expected << '\n';
+            ++failures;
+        }
+        if (static_cast<int>(sources.size()) != normalized.size() ||
+            std::any_of(sources.begin(), sources.end(), [&](int p) { return p < 0 || p >= input.size(); })) {
+            out << "FAIL " << input << ": карта позиций не соответствует результату\n";
+            ++failures;
+        }
+        const QString legacy = legacyNormalizeExpression(input);
+        if (!c.divergence && legacy != expected) {
+            out << "FAIL " << input << ": прежняя обработка даёт " << legacy
+                << ", расхождение не задокументировано\n";
+            ++failures;
+        }
+        if (c.divergence && legacy == expected) {
+            out << "FAIL " << input << ": помечено расхождением, но прежняя обработка совпадает\n";
+            ++failures;
+        }
+    }
+
+    for (const PositionCase &c : positionCases) {
+        const QString input = QString::fromUtf8(c.input);
+        std::vector<int> sources;
+        const QString normalized = ExpressionNormalizer::normalize(input, QStringLiteral("x"), &sources);
+        const int source = c.output < static_cast<int>(sources.size()) ? sources[c.output] : -1;
+        if (source != c.source) {
+            out << "FAIL " << input << ": символ " << c.output << " в " << normalized << " из позиции "
+                << source << ", ожидалась " << c.source << '\n';
+            ++failures;
+        }
+    }
+
+    out << (failures == 0 ? "OK" : "FAILED") << ": " << std::size(cases) << " выражений, "
+        << std::size(positionCases) << " позиций; ошибок " << failures << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#include "expressionvalidator.h"
+#include <QMetaObject>
+#include "expressionnormalizer.h"
+#include "tracer.h"
+
+namespace {
+
+// Позиция ошибки muParser в обработанном выражении "(<нормализованное>)+0*x"
+// переводится во введённый текст по карте позиций нормализатора: вставленные
+// знаки * и pow(...) сдвигают позиции тем сильнее, чем дальше от начала
+int sourcePosition(const QString &expression, int processedPosition)
+{
+    if (processedPosition < 0) {
+        return -1;
+    }
+    std::vector<int> sources;
+    ExpressionNormalizer::normalize(expression, QStringLiteral("x"), &sources);
+    const int index = processedPosition - 1;
+    if (index < 0) {
+        return 0;
+    }
+    // Хвост ")+0*x" — ошибка в конце введённого текста
+    if (index >= static_cast<int>(sources.size())) {
+        return static_cast<int>(expression.size());
+    }
+    return sources[index];
+}
+
+} // namespace
+
+ExpressionValidator::ExpressionValidator(QObject *parent)
+    : QObject(parent)
+{
+    worker = std::thread(&ExpressionValidator::workerLoop, this);
+}
+
+ExpressionValidator::~ExpressionValidator()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+quint64 ExpressionValidator::validate(quintptr key, const QString &expression)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Request &request = pending[key];
+    request.ticket = ++nextTicket;
+    request.expression = expression;
+    wake.notify_one();
+    return request.ticket;
+}
+
+void ExpressionValidator::workerLoop()
+{
+    Tracer::setThreadName("ExpressionValidator");
+    for (;;) {
+        quintptr key;
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (stopping) {
+                return;
+            }
+            auto first = pending.begin();
+            key = first->first;
+            request = first->second;
+            pending.erase(first);
+        }
+
+        TraceScope trace("validate", "input");
+        ValidationResult result = check(request.expression);
+        result.ticket = request.ticket;
+        result.key = key;
+
+        QMetaObject::invokeMethod(this, [this, result]() {
+            emit validated(result);
+        }, Qt::QueuedConnection);
+    }
+}
+
+ValidationResult ExpressionValidator::check(const QString &expression)
+{
+    ValidationResult result;
+    result.expression = expression;
+    result.function = std::make_shared<Function>(expression);
+    Function &function = *result.function;
+
+    // То, что собрал собственный вычислитель, muParser тоже разберёт
+    if (function.compiled) {
+        result.valid = true;
+        return result;
+    }
+
+    try {
+        // Пробное вычисление при x=0
+        mu::Parser &parser = function.muParser();
+        parser.SetExpr(function.processedExpression);
+        function.xValues[0] = 0.0;
+        parser.Eval();
+        result.valid = true;
+    }
+    catch (const mu::Parser::exception_type &e) {
+        result.error = QString::fromStdString(e.GetMsg());
+        result.errorPosition = sourcePosition(expression, static_cast<int>(e.GetPos()));
+    }
+    catch (const std::exception &e) {
+        result.error = QString::fromUtf8(e.what());
+    }
+    catch (...) {
+        result.error = "Неизвестная ошибка";
+    }
+
+    if (!result.valid) {
+        result.function.reset();
+    }
+    return result;
+}
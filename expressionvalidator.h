@@ -0,0 +1,63 @@
+#ifndef EXPRESSIONVALIDATOR_H
+#define EXPRESSIONVALIDATOR_H
+
+#include <QObject>
+#include <QString>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "function.h"
+
+// Результат проверки выражения
+struct ValidationResult {
+    quint64 ticket = 0;
+    quintptr key = 0;
+    QString expression;
+    bool valid = false;
+    QString error;
+    // Позиция ошибки в исходном тексте: muParser сообщает её для обработанного
+    // выражения, она переводится обратно по карте позиций нормализатора.
+    // -1, если неизвестна
+    int errorPosition = -1;
+    // Готовая функция: разбор и компиляция уже выполнены в рабочем потоке
+    std::shared_ptr<Function> function;
+};
+
+// Проверка и компиляция выражений в фоновом потоке.
+// Для каждого ключа (например, поля ввода) в очереди хранится только последний
+// запрос: пока поток занят, промежуточные варианты текста вытесняются следующими.
+// Результат возвращается сигналом validated в потоке, где создан объект.
+class ExpressionValidator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ExpressionValidator(QObject *parent = nullptr);
+    ~ExpressionValidator() override;
+
+    // Ставит выражение в очередь и возвращает номер запроса
+    quint64 validate(quintptr key, const QString &expression);
+
+signals:
+    void validated(const ValidationResult &result);
+
+private:
+    struct Request {
+        quint64 ticket = 0;
+        QString expression;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    quint64 nextTicket = 0;
+    std::map<quintptr, Request> pending;
+
+    void workerLoop();
+    static ValidationResult check(const QString &expression);
+};
+
+#endif // EXPRESSIONVALIDATOR_H
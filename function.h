@@ -0,0 +1,268 @@
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <QString>
+#include <QColor>
+#include <muParser.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <QDebug>
+#include "mathfunctions.h"
+#include "expressioncompiler.h"
+#include "expressionnormalizer.h"
+#include "workstealingpool.h"
+#include "tracer.h"
+
+struct Function {
+    QString expression;
+    QColor color;
+    // Толщина линии графика
+    qreal width = 2.5;
+    // Результат preprocessExpression, чтобы копии не разбирали выражение заново
+    std::string processedExpression;
+    // Парсер muParser; если выражение скомпилировано собственным вычислителем,
+    // создаётся только по требованию (см. muParser())
+    mutable std::shared_ptr<mu::Parser> parser;
+    // Буфер значений x, к которому привязана переменная парсера (пакетный режим muParser)
+    mutable std::vector<double> xValues;
+    // Скомпилированное выражение собственного вычислителя; nullptr, если выражение
+    // не поддерживается им — тогда вычисления идут через muParser
+    std::shared_ptr<const CompiledExpression> compiled;
+
+    // Копия парсера со своим буфером x для одного слота пула потоков
+    struct WorkerParser {
+        std::unique_ptr<mu::Parser> parser;
+        std::vector<double> xValues;
+    };
+    // Создаются по требованию в evaluateParallel, при копировании не переносятся
+    mutable std::vector<std::shared_ptr<WorkerParser>> workerParsers;
+
+    // Использовать собственный вычислитель, когда выражение удалось скомпилировать
+    inline static bool nativeEvaluatorEnabled = true;
+    // Делить evaluateParallel между потоками общего пула. Выключается, когда
+    // параллельность задаётся снаружи (задания batchrender на своём пуле)
+    inline static bool parallelEvaluationEnabled = true;
+    // Размер блока точек, который считается одной задачей пула потоков
+    static constexpr int ParallelChunkSize = 4096;
+
+    // Встроенные функции, доступные в выражениях
+    static void defineBuiltins(mu::Parser &parser) {
+        static constexpr struct {
+            const char *name;
+            double (*function)(double);
+        } unary[] = {
+            {"sin", static_cast<double (*)(double)>(std::sin)},
+            {"cos", static_cast<double (*)(double)>(std::cos)},
+            {"tan", static_cast<double (*)(double)>(std::tan)},
+            {"sqrt", static_cast<double (*)(double)>(std::sqrt)},
+            {"abs", static_cast<double (*)(double)>(std::abs)},
+            {"exp", static_cast<double (*)(double)>(std::exp)},
+            {"log", static_cast<double (*)(double)>(std::log)},
+            {"log10", static_cast<double (*)(double)>(std::log10)},
+            {"cot", cot}
+        };
+        static constexpr struct {
+            const char *name;
+            double (*function)(double, double);
+        } binary[] = {
+            {"pow", power_wrapper},
+            {"power", power}
+        };
+
+        for (const auto &builtin : unary) {
+            parser.DefineFun(builtin.name, builtin.function);
+        }
+        for (const auto &builtin : binary) {
+            parser.DefineFun(builtin.name, builtin.function);
+        }
+    }
+
+    // Парсер-прототип с настройками и встроенными функциями; новые парсеры —
+    // его копии, без повторной регистрации функций
+    static const mu::Parser &prototypeParser() {
+        static const mu::Parser prototype = []() {
+            mu::Parser parser;
+            parser.SetDecSep('.');
+            parser.SetThousandsSep(' ');
+            defineBuiltins(parser);
+            return parser;
+        }();
+        return prototype;
+    }
+
+    // Приведение выражения к синтаксису muParser (см. ExpressionNormalizer).
+    // Нейтральный член с x в конце нужен, чтобы переменная x была у любого выражения
+    static QString preprocessExpression(const QString &expr) {
+        return QString("(%1)+0*x").arg(ExpressionNormalizer::normalize(expr));
+    }
+
+    Function(const QString &expr = QString(), const QColor &col = Qt::blue)
+        : expression(expr), color(col), xValues(1, 0.0)
+    {
+        if (expression.isEmpty()) {
+            return;
+        }
+        processedExpression = preprocessExpression(expression).toStdString();
+        compiled = CompiledExpressionCache::instance().get(processedExpression);
+        // Выражение вне возможностей собственного вычислителя — сразу готовим muParser
+        if (!compiled) {
+            createParser();
+        }
+    }
+
+    Function(const Function &other)
+        : expression(other.expression), color(other.color), width(other.width),
+          processedExpression(other.processedExpression), xValues(1, 0.0),
+          compiled(other.compiled)
+    {
+        if (other.parser) {
+            try {
+                // Копия уже настроенного парсера; переменную x привязываем к своему буферу
+                parser = std::make_shared<mu::Parser>(*other.parser);
+                parser->DefineVar("x", xValues.data());
+            }
+            catch (const mu::Parser::exception_type &e) {
+                qDebug() << "Ошибка при копировании функции:" << QString::fromStdString(e.GetMsg());
+                parser.reset();
+            }
+        }
+    }
+
+    // При перемещении буфер xValues переезжает вместе с данными,
+    // поэтому привязка переменной парсера остаётся верной
+    Function(Function &&other) noexcept = default;
+    Function &operator=(Function &&other) noexcept = default;
+
+    Function &operator=(const Function &other)
+    {
+        if (this != &other) {
+            Function copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    // Парсер muParser для этой функции (создаётся при первом обращении)
+    mu::Parser &muParser() const {
+        if (!parser) {
+            createParser();
+        }
+        return *parser;
+    }
+
+    // Пакетное вычисление функции: ys[i] = f(xs[i]) для i в [0, count).
+    // Значения x копируются в собственный буфер, и весь массив считается одним
+    // вызовом пакетного режима muParser, без записи переменной и try/catch на каждую точку.
+    // Если выражение скомпилировано собственным вычислителем, muParser не используется.
+    // Возвращает false, если вычисление не удалось (тогда ys заполняется NaN).
+    bool evaluateBatch(const double *xs, double *ys, int count) const {
+        if (count <= 0) {
+            return true;
+        }
+        TraceScope trace("evaluateBatch", "evaluation", count);
+        if (compiled && nativeEvaluatorEnabled) {
+            compiled->evaluate(xs, ys, count);
+            return true;
+        }
+        return evaluateWithParser(muParser(), xValues, xs, ys, count);
+    }
+
+    // Параллельное вычисление: массив делится на блоки по ParallelChunkSize точек,
+    // которые разбирает пул потоков. Скомпилированный вычислитель не имеет изменяемого
+    // состояния и используется всеми потоками сразу; для muParser у каждого слота пула
+    // своя копия парсера. Каждый блок пишет результаты на свои места в ys, поэтому
+    // порядок точек сохраняется. Один и тот же Function нельзя вычислять из разных
+    // потоков одновременно.
+    bool evaluateParallel(const double *xs, double *ys, int count) const {
+        if (!parallelEvaluationEnabled) {
+            return evaluateBatch(xs, ys, count);
+        }
+        WorkStealingPool &pool = WorkStealingPool::instance();
+        if (count < 2 * ParallelChunkSize || pool.threadCount() == 0) {
+            return evaluateBatch(xs, ys, count);
+        }
+
+        const bool native = compiled && nativeEvaluatorEnabled;
+        if (!native) {
+            // Копии создаются заранее в вызывающем потоке, пока основной парсер не занят
+            try {
+                while (static_cast<int>(workerParsers.size()) < pool.slotCount()) {
+                    auto worker = std::make_shared<WorkerParser>();
+                    worker->parser.reset(new mu::Parser(muParser()));
+                    worker->xValues.assign(1, 0.0);
+                    worker->parser->DefineVar("x", worker->xValues.data());
+                    workerParsers.push_back(worker);
+                }
+            }
+            catch (const mu::Parser::exception_type &e) {
+                qDebug() << "Ошибка копирования парсера:" << QString::fromStdString(e.GetMsg());
+                return evaluateBatch(xs, ys, count);
+            }
+        }
+
+        const int chunks = (count + ParallelChunkSize - 1) / ParallelChunkSize;
+        std::atomic<bool> ok(true);
+        pool.run(chunks, [&](int chunk, int slot) {
+            const int begin = chunk * ParallelChunkSize;
+            const int n = std::min(ParallelChunkSize, count - begin);
+            TraceScope trace("evaluateChunk", "evaluation", n);
+            if (native) {
+                compiled->evaluate(xs + begin, ys + begin, n);
+            } else {
+                WorkerParser &worker = *workerParsers[slot];
+                if (!evaluateWithParser(*worker.parser, worker.xValues, xs + begin, ys + begin, n)) {
+                    ok = false;
+                }
+            }
+        });
+        return ok;
+    }
+
+    // Пакетный режим muParser: переменная x парсера привязана к buffer
+    static bool evaluateWithParser(mu::Parser &parser, std::vector<double> &buffer,
+                                   const double *xs, double *ys, int count) {
+        try {
+            double *oldData = buffer.data();
+            if (static_cast<int>(buffer.size()) < count) {
+                buffer.resize(count);
+            }
+            // Буфер переехал в памяти — перепривязываем к нему переменную x
+            if (buffer.data() != oldData) {
+                parser.DefineVar("x", buffer.data());
+            }
+            std::copy(xs, xs + count, buffer.begin());
+            parser.Eval(ys, count);
+            return true;
+        }
+        catch (const mu::Parser::exception_type &e) {
+            qDebug() << "Ошибка пакетного вычисления функции:" << QString::fromStdString(e.GetMsg());
+        }
+        catch (...) {
+            qDebug() << "Неизвестная ошибка при пакетном вычислении функции";
+        }
+        std::fill(ys, ys + count, std::numeric_limits<double>::quiet_NaN());
+        return false;
+    }
+
+private:
+    void createParser() const {
+        parser = std::make_shared<mu::Parser>(prototypeParser());
+        try {
+            // Определяем переменную до установки выражения
+            xValues.assign(1, 0.0);
+            parser->DefineVar("x", xValues.data());
+            if (!processedExpression.empty()) {
+                parser->SetExpr(processedExpression);
+            }
+        }
+        catch (const mu::Parser::exception_type &e) {
+            qDebug() << "Ошибка при инициализации парсера:" << QString::fromStdString(e.GetMsg());
+        }
+    }
+};
+
+#endif // FUNCTION_H
@@ -14,22 +14,12 @@ FunctionItem::FunctionItem(const QString &function, const QColor &color, QWidget
     functionInput = new QLineEdit(this);
     functionInput->setPlaceholderText("Введите функцию");
     functionInput->setText(function);
-    functionInput->setStyleSheet(
-        "QLineEdit {"
-        "    padding: 5px 10px;"
-        "    border: 2px solid #B0BEC5;"
-        "    border-radius: 5px;"
-        "    background-color: white;"
-        "    font-size: 13px;"
-        "    color: black;"
-        "}"
-        "QLineEdit:hover {"
-        "    border-color: #2196F3;"
-        "}"
-        "QLineEdit:focus {"
-        "    border-color: #2196F3;"
-        "}"
-    );
+    updateInputStyle(false);
+
+    // Правки копятся, пока пользователь печатает
+    editTimer = new QTimer(this);
+    editTimer->setSingleShot(true);
+    editTimer->setInterval(EditDebounceMs);
 
     // Создаем кнопку выбора цвета
     colorButton = new QPushButton(this);
@@ -57,7 +47,8 @@ FunctionItem::FunctionItem(const QString &function, const QColor &color, QWidget
     layout->addWidget(removeButton);
 
     // Подключаем сигналы
-    connect(functionInput, &QLineEdit::textChanged, [this]() {
+    connect(functionInput, &QLineEdit::textChanged, editTimer, qOverload<>(&QTimer::start));
+    connect(editTimer, &QTimer::timeout, this, [this]() {
         emit functionChanged(this);
     });
     connect(colorButton, &QPushButton::clicked, this, &FunctionItem::onColorButtonClicked);
@@ -109,4 +100,38 @@ void FunctionItem::updateColorButtonStyle()
         "}"
     ).arg(currentColor.name());
     colorButton->setStyleSheet(style);
-} 
\ No newline at end of file
+} 
+
+void FunctionItem::setValidationStatus(const QString &error, int position)
+{
+    if (error.isEmpty()) {
+        functionInput->setToolTip(QString());
+    } else if (position >= 0) {
+        functionInput->setToolTip(QString("Ошибка в позиции %1: %2").arg(position + 1).arg(error));
+    } else {
+        functionInput->setToolTip(QString("Ошибка: %1").arg(error));
+    }
+    updateInputStyle(!error.isEmpty());
+}
+
+void FunctionItem::updateInputStyle(bool error)
+{
+    // При ошибке рамка поля красная, текст ошибки — во всплывающей подсказке
+    QString style = QString(
+        "QLineEdit {"
+        "    padding: 5px 10px;"
+        "    border: 2px solid %1;"
+        "    border-radius: 5px;"
+        "    background-color: white;"
+        "    font-size: 13px;"
+        "    color: black;"
+        "}"
+        "QLineEdit:hover {"
+        "    border-color: %2;"
+        "}"
+        "QLineEdit:focus {"
+        "    border-color: %2;"
+        "}"
+    ).arg(error ? "#E53935" : "#B0BEC5", error ? "#E53935" : "#2196F3");
+    functionInput->setStyleSheet(style);
+}
@@ -6,6 +6,7 @@
 #include <QPushButton>
 #include <QHBoxLayout>
 #include <QColor>
+#include <QTimer>
 
 class FunctionItem : public QWidget
 {
@@ -17,8 +18,14 @@ public:
     QColor color() const;
     void setFunction(const QString &function);
     void setColor(const QColor &color);
+    // Результат проверки выражения: пустая строка — ошибок нет
+    void setValidationStatus(const QString &error, int position = -1);
+
+    // Пауза после последнего нажатия, после которой выражение отправляется дальше
+    static constexpr int EditDebounceMs = 150;
 
 signals:
+    // Испускается после паузы в наборе, а не на каждое нажатие
     void functionChanged(FunctionItem *item);
     void colorChanged(FunctionItem *item);
     void removeClicked(FunctionItem *item);
@@ -31,8 +38,10 @@ private:
     QPushButton *colorButton;
     QPushButton *removeButton;
     QColor currentColor;
+    QTimer *editTimer;
 
     void updateColorButtonStyle();
+    void updateInputStyle(bool error);
 };
 
 #endif // FUNCTIONITEM_H 
\ No newline at end of file
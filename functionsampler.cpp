@@ -0,0 +1,410 @@
+#include "functionsampler.h"
+#include <algorithm>
+#include "tracer.h"
+
+namespace {
+
+// Нужно ли делить отрезок [a, b] с серединой m.
+// Делим, если середина отклоняется от прямой между концами больше чем на допуск
+// в пикселях, или если на отрезке проходит граница области определения (полюс,
+// разрыв). Критерий не зависит от положения области просмотра, только от масштаба.
+bool needsRefinement(double ya, double ym, double yb, double yScale)
+{
+    const bool finiteA = std::isfinite(ya);
+    const bool finiteM = std::isfinite(ym);
+    const bool finiteB = std::isfinite(yb);
+    if (!finiteA && !finiteM && !finiteB) {
+        return false;
+    }
+    if (!(finiteA && finiteM && finiteB)) {
+        return true;
+    }
+    const double deviation = std::abs(ym - (ya + yb) * 0.5) * yScale;
+    return deviation > FunctionSampler::Tolerance;
+}
+
+// Номер плитки и позиция ячейки в ней (деление с округлением вниз)
+qint64 tileOf(qint64 cell)
+{
+    return cell >= 0 ? cell / SampleCache::TileCells : -((-cell + SampleCache::TileCells - 1) / SampleCache::TileCells);
+}
+
+int offsetOf(qint64 cell)
+{
+    return static_cast<int>(cell - tileOf(cell) * SampleCache::TileCells);
+}
+
+qint64 cellBytes(const std::vector<double> &xs)
+{
+    return static_cast<qint64>(xs.capacity()) * 2 * sizeof(double);
+}
+} // namespace
+
+SamplerScratch::Cell &SamplerScratch::addPending(qint64 index)
+{
+    if (spare.empty()) {
+        pending.emplace_back();
+    } else {
+        pending.push_back(std::move(spare.back()));
+        spare.pop_back();
+    }
+    Cell &cell = pending.back();
+    cell.index = index;
+    return cell;
+}
+
+void SamplerScratch::releasePending()
+{
+    for (Cell &cell : pending) {
+        spare.push_back(std::move(cell));
+    }
+    pending.clear();
+}
+
+void SampleCache::clear()
+{
+    tiles.clear();
+    bytes = 0;
+}
+
+void SampleCache::setMemoryBudget(qint64 newBudget)
+{
+    budget = newBudget;
+    evict();
+}
+
+const SampleCache::Cell *SampleCache::findCell(int xLevel, int yLevel, qint64 index) const
+{
+    auto tile = tiles.constFind(SampleTileKey{xLevel, yLevel, tileOf(index)});
+    if (tile == tiles.constEnd()) {
+        return nullptr;
+    }
+    const Cell &cell = tile->cells[offsetOf(index)];
+    return cell.xs.empty() ? nullptr : &cell;
+}
+
+void SampleCache::storeCell(int xLevel, int yLevel, qint64 index, Cell &&cell)
+{
+    Tile &tile = tiles[SampleTileKey{xLevel, yLevel, tileOf(index)}];
+    Cell &stored = tile.cells[offsetOf(index)];
+    const qint64 delta = cellBytes(cell.xs) - cellBytes(stored.xs);
+    stored = std::move(cell);
+    tile.bytes += delta;
+    tile.lastUse = useCounter;
+    bytes += delta;
+}
+
+void SampleCache::touch(int xLevel, int yLevel, qint64 firstCell, qint64 lastCell)
+{
+    ++useCounter;
+    for (qint64 t = tileOf(firstCell); t <= tileOf(lastCell); ++t) {
+        auto tile = tiles.find(SampleTileKey{xLevel, yLevel, t});
+        if (tile != tiles.end()) {
+            tile->lastUse = useCounter;
+        }
+    }
+}
+
+void SampleCache::evict()
+{
+    if (bytes <= budget) {
+        return;
+    }
+    // Удаляем плитки, к которым дольше всего не обращались; текущие не трогаем
+    QVector<QPair<quint64, SampleTileKey>> order;
+    order.reserve(tiles.size());
+    for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        if (it->lastUse != useCounter) {
+            order.append({it->lastUse, it.key()});
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const QPair<quint64, SampleTileKey> &a,
+                                             const QPair<quint64, SampleTileKey> &b) {
+        return a.first < b.first;
+    });
+    for (const auto &entry : order) {
+        if (bytes <= budget) {
+            break;
+        }
+        auto tile = tiles.find(entry.second);
+        bytes -= tile->bytes;
+        tiles.erase(tile);
+    }
+}
+
+bool FunctionSampler::levelsFor(const ViewportSnapshot &viewport, int &xLevel, int &yLevel)
+{
+    const int width = viewport.size.width();
+    const int height = viewport.size.height();
+    if (width <= 0 || height <= 0 || !(viewport.xMax > viewport.xMin) || !(viewport.yMax > viewport.yMin)) {
+        return false;
+    }
+    // Шаг округляется вниз до степени двойки, масштаб по y — вверх:
+    // точек получается не меньше, а допуск не больше, чем без округления
+    const double rawStep = (viewport.xMax - viewport.xMin) / std::max(2, width / PixelStep);
+    const double yScale = height / (viewport.yMax - viewport.yMin);
+    if (!std::isfinite(rawStep) || !std::isfinite(yScale) || rawStep <= 0 || yScale <= 0) {
+        return false;
+    }
+    xLevel = static_cast<int>(std::floor(std::log2(rawStep)));
+    yLevel = static_cast<int>(std::ceil(std::log2(yScale)));
+    return true;
+}
+
+bool FunctionSampler::cellRange(const ViewportSnapshot &viewport, int xLevel, qint64 &firstCell, qint64 &lastCell)
+{
+    const double step = std::ldexp(1.0, xLevel);
+    // Дальше этого double уже не различает соседние узлы сетки
+    const double firstIndex = std::floor(viewport.xMin / step);
+    const double lastIndex = std::ceil(viewport.xMax / step) - 1;
+    if (!(std::abs(firstIndex) < 1e15) || !(std::abs(lastIndex) < 1e15)) {
+        return false;
+    }
+    firstCell = static_cast<qint64>(firstIndex);
+    lastCell = std::max(firstCell, static_cast<qint64>(lastIndex));
+    return true;
+}
+
+bool FunctionSampler::assemble(const SampleCache &cache, int xLevel, int yLevel,
+                               qint64 firstCell, qint64 lastCell, SampleBuffer &points)
+{
+    // Собираем ячейки подряд; общий конец соседних ячеек берём один раз
+    points.clear();
+    for (qint64 k = firstCell; k <= lastCell; ++k) {
+        const SampleCache::Cell *cell = cache.findCell(xLevel, yLevel, k);
+        if (!cell) {
+            points.clear();
+            return false;
+        }
+        const size_t count = k == lastCell ? cell->xs.size() : cell->xs.size() - 1;
+        points.xs.insert(points.xs.end(), cell->xs.begin(), cell->xs.begin() + count);
+        points.ys.insert(points.ys.end(), cell->ys.begin(), cell->ys.begin() + count);
+    }
+    return true;
+}
+
+bool FunctionSampler::cachedPoints(const ViewportSnapshot &viewport, const SampleCache &cache,
+                                   SampleBuffer &points, SamplerScratch *scratch)
+{
+    points.clear();
+    int xLevel, yLevel;
+    if (!levelsFor(viewport, xLevel, yLevel)) {
+        return false;
+    }
+
+    SamplerScratch localScratch;
+    if (!scratch) {
+        scratch = &localScratch;
+    }
+
+    // Уровни, которые есть в кэше, — от ближайшего к нужному
+    std::vector<std::pair<int, int>> &levels = scratch->levels;
+    levels.clear();
+    for (auto it = cache.tiles.constBegin(); it != cache.tiles.constEnd(); ++it) {
+        const std::pair<int, int> level(it.key().xLevel, it.key().yLevel);
+        if (std::find(levels.begin(), levels.end(), level) == levels.end()) {
+            levels.push_back(level);
+        }
+    }
+    std::sort(levels.begin(), levels.end(), [xLevel, yLevel](const std::pair<int, int> &a,
+                                                             const std::pair<int, int> &b) {
+        const int da = std::abs(a.first - xLevel) * 2 + std::abs(a.second - yLevel);
+        const int db = std::abs(b.first - xLevel) * 2 + std::abs(b.second - yLevel);
+        return da < db;
+    });
+
+    for (const std::pair<int, int> &level : levels) {
+        qint64 firstCell, lastCell;
+        if (!cellRange(viewport, level.first, firstCell, lastCell)) {
+            continue;
+        }
+        if (assemble(cache, level.first, level.second, firstCell, lastCell, points)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SampleBuffer FunctionSampler::calculatePoints(const Function &func,
+                                              const ViewportSnapshot &viewport,
+                                              const CancelCheck &cancelled,
+                                              int *evaluations,
+                                              SampleCache *cache)
+{
+    SampleBuffer points;
+    calculatePoints(func, viewport, points, cancelled, evaluations, cache);
+    return points;
+}
+
+bool FunctionSampler::calculatePoints(const Function &func,
+                                      const ViewportSnapshot &viewport,
+                                      SampleBuffer &points,
+                                      const CancelCheck &cancelled,
+                                      int *evaluations,
+                                      SampleCache *cache,
+                                      SamplerScratch *scratch)
+{
+    TraceScope trace("calculatePoints", "sampling");
+    points.clear();
+    if (evaluations) {
+        *evaluations = 0;
+    }
+
+    SampleCache localCache;
+    if (!cache) {
+        cache = &localCache;
+    }
+    cache->last = SampleCache::Stats();
+
+    SamplerScratch localScratch;
+    if (!scratch) {
+        scratch = &localScratch;
+    }
+    scratch->releasePending();
+
+    int xLevel, yLevel;
+    qint64 firstCell, lastCell;
+    if (!levelsFor(viewport, xLevel, yLevel) || !cellRange(viewport, xLevel, firstCell, lastCell)) {
+        return true;
+    }
+    const double step = std::ldexp(1.0, xLevel);
+    const double yScale = std::ldexp(1.0, yLevel);
+    cache->touch(xLevel, yLevel, firstCell, lastCell);
+
+    auto evaluate = [&](const std::vector<double> &xs, std::vector<double> &ys) {
+        ys.resize(xs.size());
+        // Между пакетами проверяем, не устарело ли задание
+        for (int begin = 0; begin < static_cast<int>(xs.size()); begin += SliceSize) {
+            if (cancelled && cancelled()) {
+                return false;
+            }
+            const int count = std::min(SliceSize, static_cast<int>(xs.size()) - begin);
+            func.evaluateParallel(xs.data() + begin, ys.data() + begin, count);
+        }
+        if (evaluations) {
+            *evaluations += static_cast<int>(xs.size());
+        }
+        return true;
+    };
+
+    // Ячейки, которых нет в кэше
+    std::vector<SamplerScratch::Cell> &pending = scratch->pending;
+    for (qint64 k = firstCell; k <= lastCell; ++k) {
+        if (cache->findCell(xLevel, yLevel, k)) {
+            ++cache->last.hits;
+        } else {
+            scratch->addPending(k);
+        }
+    }
+    cache->last.misses = static_cast<int>(pending.size());
+
+    if (!pending.empty()) {
+        // Концы отрезков: берём у соседних ячеек из кэша, остальные вычисляем
+        std::vector<double> &baseX = scratch->baseX;
+        std::vector<double> &baseY = scratch->baseY;
+        std::vector<double *> &baseTargets = scratch->baseTargets;
+        baseX.clear();
+        baseTargets.clear();
+        for (SamplerScratch::Cell &cell : pending) {
+            cell.xs.assign({cell.index * step, (cell.index + 1) * step});
+            cell.ys.assign(2, 0.0);
+            cell.refine.assign({1, 0});
+        }
+        for (size_t i = 0; i < pending.size(); ++i) {
+            SamplerScratch::Cell &cell = pending[i];
+            const bool sharedWithPrevious = i > 0 && pending[i - 1].index == cell.index - 1;
+            if (const SampleCache::Cell *left = cache->findCell(xLevel, yLevel, cell.index - 1)) {
+                cell.ys[0] = left->ys.back();
+            } else if (!sharedWithPrevious) {
+                baseX.push_back(cell.xs[0]);
+                baseTargets.push_back(&cell.ys[0]);
+            }
+            if (const SampleCache::Cell *right = cache->findCell(xLevel, yLevel, cell.index + 1)) {
+                cell.ys[1] = right->ys.front();
+            } else {
+                baseX.push_back(cell.xs[1]);
+                baseTargets.push_back(&cell.ys[1]);
+            }
+        }
+        if (!evaluate(baseX, baseY)) {
+            return false;
+        }
+        for (size_t i = 0; i < baseTargets.size(); ++i) {
+            *baseTargets[i] = baseY[i];
+        }
+        // Общий узел с предыдущей новой ячейкой
+        for (size_t i = 1; i < pending.size(); ++i) {
+            if (pending[i - 1].index == pending[i].index - 1) {
+                pending[i].ys[0] = pending[i - 1].ys[1];
+            }
+        }
+
+        // Уточняем по уровням, чтобы середины всех отрезков уровня считались одним пакетом.
+        // Ячейка шириной PixelStep/2..PixelStep пикселей получает не больше
+        // MaxSamplesPerPixel точек на пиксель
+        const int cellBudget = MaxSamplesPerPixel * PixelStep / 2;
+        std::vector<double> &midX = scratch->midX;
+        std::vector<double> &midY = scratch->midY;
+        std::vector<double> &nextX = scratch->nextX;
+        std::vector<double> &nextY = scratch->nextY;
+        std::vector<char> &nextRefine = scratch->nextRefine;
+        for (int depth = 0; depth < MaxDepth; ++depth) {
+            midX.clear();
+            for (const SamplerScratch::Cell &cell : pending) {
+                int budget = cellBudget - static_cast<int>(cell.xs.size());
+                for (size_t i = 0; i + 1 < cell.xs.size() && budget > 0; ++i) {
+                    if (cell.refine[i]) {
+                        midX.push_back((cell.xs[i] + cell.xs[i + 1]) * 0.5);
+                        --budget;
+                    }
+                }
+            }
+            if (midX.empty()) {
+                break;
+            }
+            if (!evaluate(midX, midY)) {
+                return false;
+            }
+
+            size_t mid = 0;
+            for (SamplerScratch::Cell &cell : pending) {
+                nextX.clear();
+                nextY.clear();
+                nextRefine.clear();
+                int budget = cellBudget - static_cast<int>(cell.xs.size());
+                for (size_t i = 0; i < cell.xs.size(); ++i) {
+                    nextX.push_back(cell.xs[i]);
+                    nextY.push_back(cell.ys[i]);
+                    if (i + 1 < cell.xs.size() && cell.refine[i] && budget > 0) {
+                        const bool split = needsRefinement(cell.ys[i], midY[mid], cell.ys[i + 1], yScale);
+                        nextRefine.push_back(split);
+                        nextX.push_back(midX[mid]);
+                        nextY.push_back(midY[mid]);
+                        nextRefine.push_back(split);
+                        ++mid;
+                        --budget;
+                    } else {
+                        nextRefine.push_back(0);
+                    }
+                }
+                // Массивы меняются местами: память ячейки остаётся в scratch
+                cell.xs.swap(nextX);
+                cell.ys.swap(nextY);
+                cell.refine.swap(nextRefine);
+            }
+        }
+
+        for (const SamplerScratch::Cell &cell : pending) {
+            // В кэш идёт копия точно по размеру, рабочие массивы остаются для следующего вызова
+            SampleCache::Cell stored;
+            stored.xs.assign(cell.xs.begin(), cell.xs.end());
+            stored.ys.assign(cell.ys.begin(), cell.ys.end());
+            cache->storeCell(xLevel, yLevel, cell.index, std::move(stored));
+        }
+    }
+
+    assemble(*cache, xLevel, yLevel, firstCell, lastCell, points);
+    cache->evict();
+    trace.setValue(points.size());
+    return true;
+}
@@ -0,0 +1,197 @@
+#ifndef FUNCTIONSAMPLER_H
+#define FUNCTIONSAMPLER_H
+
+#include <QVector>
+#include <QPair>
+#include <QSize>
+#include <QHash>
+#include <functional>
+#include <vector>
+#include "function.h"
+#include "samplebuffer.h"
+
+// Неизменяемый снимок области просмотра: всё, что нужно для вычисления точек
+// без обращения к виджету (в том числе из фонового потока)
+struct ViewportSnapshot {
+    double xMin = -10.0;
+    double xMax = 10.0;
+    double yMin = -10.0;
+    double yMax = 10.0;
+    QSize size;
+
+    bool operator==(const ViewportSnapshot &other) const {
+        return xMin == other.xMin && xMax == other.xMax &&
+               yMin == other.yMin && yMax == other.yMax && size == other.size;
+    }
+    bool operator!=(const ViewportSnapshot &other) const {
+        return !(*this == other);
+    }
+};
+
+// Ключ плитки в пирамиде точек: уровни шага по x и масштаба по y и номер плитки
+struct SampleTileKey {
+    int xLevel;
+    int yLevel;
+    qint64 tile;
+
+    bool operator==(const SampleTileKey &other) const {
+        return xLevel == other.xLevel && yLevel == other.yLevel && tile == other.tile;
+    }
+};
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+inline size_t qHash(const SampleTileKey &key, size_t seed = 0)
+#else
+inline uint qHash(const SampleTileKey &key, uint seed = 0)
+#endif
+{
+    return qHash(key.tile, seed) ^ static_cast<decltype(seed)>(key.xLevel * 31 + key.yLevel * 131071);
+}
+
+// Пирамида точек одной функции. Шаг начальной сетки округляется до степени двойки
+// (step = 2^xLevel), вертикальный масштаб — тоже (2^yLevel), и точки привязаны
+// к узлам x = k * step: отрезок [k * step, (k + 1) * step] вместе с уточняющими
+// точками образует ячейку k. Ячейки хранятся плитками по TileCells штук на каждом
+// уровне. При сдвиге области просмотра уровень не меняется, и вычисляются только
+// открывшиеся ячейки; при возврате к прежнему масштабу (зум туда и обратно) ячейки
+// берутся с уже вычисленного уровня. Когда объём превышает бюджет памяти, дольше
+// всего не использовавшиеся плитки удаляются.
+class SampleCache
+{
+public:
+    struct Stats {
+        int hits = 0;    // ячеек взято из кэша
+        int misses = 0;  // ячеек вычислено заново
+    };
+
+    static constexpr int TileCells = 64;
+    static constexpr qint64 DefaultMemoryBudget = 16 * 1024 * 1024;
+
+    void clear();
+    int tileCount() const { return tiles.size(); }
+    qint64 memoryUsage() const { return bytes; }
+    qint64 memoryBudget() const { return budget; }
+    void setMemoryBudget(qint64 bytes);
+    // Статистика последнего вызова calculatePoints
+    const Stats &lastStats() const { return last; }
+
+private:
+    friend class FunctionSampler;
+
+    // Точки ячейки вместе с обоими концами отрезка, упорядочены по x;
+    // пустая ячейка ещё не вычислена
+    struct Cell {
+        std::vector<double> xs;
+        std::vector<double> ys;
+    };
+
+    struct Tile {
+        std::vector<Cell> cells = std::vector<Cell>(TileCells);
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    QHash<SampleTileKey, Tile> tiles;
+    qint64 bytes = 0;
+    qint64 budget = DefaultMemoryBudget;
+    quint64 useCounter = 0;
+    Stats last;
+
+    const Cell *findCell(int xLevel, int yLevel, qint64 index) const;
+    void storeCell(int xLevel, int yLevel, qint64 index, Cell &&cell);
+    void touch(int xLevel, int yLevel, qint64 firstCell, qint64 lastCell);
+    void evict();
+};
+
+// Рабочие массивы FunctionSampler для одной функции. Живут дольше вызова
+// calculatePoints: при следующем кадре их память используется снова, и в
+// установившемся режиме (сдвиг, зум по уже вычисленным уровням) выборка не
+// выделяет память, кроме как под новые ячейки SampleCache.
+class SamplerScratch
+{
+private:
+    friend class FunctionSampler;
+
+    // Ячейка в процессе уточнения
+    struct Cell {
+        qint64 index = 0;
+        std::vector<double> xs;
+        std::vector<double> ys;
+        std::vector<char> refine;  // refine[i] — нужно ли проверить отрезок (i, i + 1)
+    };
+
+    std::vector<Cell> pending;
+    // Ячейки прошлых вызовов, чьи массивы можно занять снова
+    std::vector<Cell> spare;
+    std::vector<double> baseX, baseY;
+    std::vector<double *> baseTargets;
+    std::vector<double> midX, midY;
+    std::vector<double> nextX, nextY;
+    std::vector<char> nextRefine;
+    std::vector<std::pair<int, int>> levels;
+
+    Cell &addPending(qint64 index);
+    void releasePending();
+};
+
+// Адаптивное вычисление точек графика функции для заданной области просмотра.
+// Начальная сетка редкая (одна точка на PixelStep/2..PixelStep пикселей, шаг —
+// степень двойки, узлы кратны шагу);
+// отрезки, на которых середина графика отклоняется от прямой больше чем на
+// Tolerance пикселя, а также отрезки с полюсами и разрывами рекурсивно делятся
+// пополам. Каждый отрезок начальной сетки уточняется независимо и получает не больше
+// MaxSamplesPerPixel точек на пиксель, поэтому результат для него зависит только
+// от уровней масштаба и может храниться в SampleCache.
+class FunctionSampler
+{
+public:
+    // Возвращает true, если вычисление нужно прервать (результат больше не нужен)
+    using CancelCheck = std::function<bool()>;
+
+    // Шаг начальной сетки в пикселях
+    static constexpr int PixelStep = 4;
+    // Допустимое отклонение от линейной интерполяции, в пикселях
+    static constexpr double Tolerance = 0.25;
+    // Максимальная глубина деления: отрезок начальной сетки делится до 1/1024
+    static constexpr int MaxDepth = 10;
+    // Жёсткий предел числа точек на пиксель ширины
+    static constexpr int MaxSamplesPerPixel = 16;
+    // Количество точек, вычисляемых между проверками отмены
+    static constexpr int SliceSize = 8 * Function::ParallelChunkSize;
+
+    // Точки упорядочены по x и записываются в points; прежнее содержимое стирается,
+    // но память буфера остаётся за ним. При отмене возвращает false, points пуст.
+    // В evaluations, если передан, записывается число вычислений функции.
+    // С cache точки уже вычисленных ячеек берутся из него, новые ячейки в него добавляются.
+    // scratch — рабочие массивы, которые стоит передавать между кадрами.
+    static bool calculatePoints(const Function &func,
+                                const ViewportSnapshot &viewport,
+                                SampleBuffer &points,
+                                const CancelCheck &cancelled = CancelCheck(),
+                                int *evaluations = nullptr,
+                                SampleCache *cache = nullptr,
+                                SamplerScratch *scratch = nullptr);
+
+    // То же для разового вычисления: новый буфер на каждый вызов
+    static SampleBuffer calculatePoints(const Function &func,
+                                        const ViewportSnapshot &viewport,
+                                        const CancelCheck &cancelled = CancelCheck(),
+                                        int *evaluations = nullptr,
+                                        SampleCache *cache = nullptr);
+
+    // Точки только из кэша, без вычислений: берётся ближайший к нужному по шагу уровень,
+    // на котором вычислены все ячейки области. Если такого нет, возвращает false.
+    static bool cachedPoints(const ViewportSnapshot &viewport, const SampleCache &cache,
+                             SampleBuffer &points, SamplerScratch *scratch = nullptr);
+
+private:
+    // Уровни пирамиды для области просмотра; false, если область вырождена
+    static bool levelsFor(const ViewportSnapshot &viewport, int &xLevel, int &yLevel);
+    // Ячейки уровня xLevel, покрывающие область по x
+    static bool cellRange(const ViewportSnapshot &viewport, int xLevel, qint64 &firstCell, qint64 &lastCell);
+    // Точки подряд идущих ячеек; false и пустой points, если какой-то ячейки нет в кэше
+    static bool assemble(const SampleCache &cache, int xLevel, int yLevel,
+                         qint64 firstCell, qint64 lastCell, SampleBuffer &points);
+};
+
+#endif // FUNCTIONSAMPLER_H
@@ -0,0 +1,386 @@
+#include "heatmap.h"
+#include <QDebug>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include "workstealingpool.h"
+#include "tracer.h"
+
+Colormap::Colormap(const QVector<QColor> &stops)
+    : lut(Size)
+{
+    for (int i = 0; i < Size; ++i) {
+        if (stops.size() < 2) {
+            lut[i] = stops.isEmpty() ? qRgb(0, 0, 0) : stops.first().rgb();
+            continue;
+        }
+        const double position = double(i) / (Size - 1) * (stops.size() - 1);
+        const int left = std::min(static_cast<int>(position), stops.size() - 2);
+        const double t = position - left;
+        const QColor &a = stops[left];
+        const QColor &b = stops[left + 1];
+        lut[i] = qRgb(qRound(a.red() + (b.red() - a.red()) * t),
+                      qRound(a.green() + (b.green() - a.green()) * t),
+                      qRound(a.blue() + (b.blue() - a.blue()) * t));
+    }
+}
+
+const Colormap &Colormap::viridis()
+{
+    static const Colormap colormap({QColor(0x44, 0x01, 0x54), QColor(0x48, 0x27, 0x77), QColor(0x3e, 0x4a, 0x89),
+                                    QColor(0x31, 0x68, 0x8e), QColor(0x26, 0x82, 0x8e), QColor(0x1f, 0x9e, 0x89),
+                                    QColor(0x35, 0xb7, 0x79), QColor(0x6d, 0xcd, 0x59), QColor(0xb4, 0xde, 0x2c),
+                                    QColor(0xfd, 0xe7, 0x25)});
+    return colormap;
+}
+
+QRgb Colormap::color(double t) const
+{
+    const int index = static_cast<int>(std::clamp(t, 0.0, 1.0) * (Size - 1) + 0.5);
+    return lut[index];
+}
+
+void HeatmapCache::clear()
+{
+    tiles.clear();
+    bytes = 0;
+}
+
+void HeatmapCache::setMemoryBudget(qint64 newBudget)
+{
+    budget = newBudget;
+    evict();
+}
+
+void HeatmapCache::evict()
+{
+    if (bytes <= budget) {
+        return;
+    }
+    // Удаляем плитки, к которым дольше всего не обращались; текущие не трогаем
+    QVector<QPair<quint64, ImplicitTileKey>> order;
+    order.reserve(tiles.size());
+    for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        if (it->lastUse != useCounter) {
+            order.append({it->lastUse, it.key()});
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const QPair<quint64, ImplicitTileKey> &a,
+                                             const QPair<quint64, ImplicitTileKey> &b) {
+        return a.first < b.first;
+    });
+    for (const auto &entry : order) {
+        if (bytes <= budget) {
+            break;
+        }
+        auto tile = tiles.find(entry.second);
+        bytes -= static_cast<qint64>(tile->values.capacity() * sizeof(float));
+        tiles.erase(tile);
+    }
+}
+
+bool HeatmapRenderer::tileRange(const ViewportSnapshot &viewport, int offset, TileRange &range)
+{
+    const int width = viewport.size.width();
+    const int height = viewport.size.height();
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    // Размер пикселя поля — ближайшая к пикселю экрана степень двойки
+    const double rawStepX = (viewport.xMax - viewport.xMin) / width;
+    const double rawStepY = (viewport.yMax - viewport.yMin) / height;
+    if (!std::isfinite(rawStepX) || !std::isfinite(rawStepY) || rawStepX <= 0 || rawStepY <= 0) {
+        return false;
+    }
+    range.xLevel = static_cast<int>(std::lround(std::log2(rawStepX))) + offset;
+    range.yLevel = static_cast<int>(std::lround(std::log2(rawStepY))) + offset;
+
+    // Дальше этого double уже не различает соседние плитки
+    const double tileWidth = std::ldexp(double(TileSize), range.xLevel);
+    const double tileHeight = std::ldexp(double(TileSize), range.yLevel);
+    const double bounds[4] = {std::floor(viewport.xMin / tileWidth), std::ceil(viewport.xMax / tileWidth) - 1,
+                              std::floor(viewport.yMin / tileHeight), std::ceil(viewport.yMax / tileHeight) - 1};
+    for (double bound : bounds) {
+        if (!(std::abs(bound) < 1e15)) {
+            return false;
+        }
+    }
+    range.firstColumn = static_cast<qint64>(bounds[0]);
+    range.lastColumn = std::max(range.firstColumn, static_cast<qint64>(bounds[1]));
+    range.firstRow = static_cast<qint64>(bounds[2]);
+    range.lastRow = std::max(range.firstRow, static_cast<qint64>(bounds[3]));
+    return true;
+}
+
+void HeatmapRenderer::calculateTile(const ImplicitFunction &function, const ImplicitTileKey &key,
+                                    HeatmapCache::Tile &tile, int slot)
+{
+    TraceScope trace("calculateHeatmapTile", "sampling", TileSize * TileSize);
+    const double stepX = std::ldexp(1.0, key.xLevel);
+    const double stepY = std::ldexp(1.0, key.yLevel);
+    constexpr int count = TileSize * TileSize;
+
+    // Значения в центрах пикселей поля
+    std::vector<double> xs(count), ys(count), values(count);
+    for (int j = 0; j < TileSize; ++j) {
+        for (int i = 0; i < TileSize; ++i) {
+            xs[j * TileSize + i] = (key.column * TileSize + i + 0.5) * stepX;
+            ys[j * TileSize + i] = (key.row * TileSize + j + 0.5) * stepY;
+        }
+    }
+    function.evaluate(xs.data(), ys.data(), values.data(), count, slot);
+
+    tile.values.resize(count);
+    tile.hasValues = false;
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    for (int i = 0; i < count; ++i) {
+        const float value = static_cast<float>(values[i]);
+        tile.values[i] = value;
+        if (std::isfinite(value)) {
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+            tile.hasValues = true;
+        }
+    }
+    tile.minValue = lo;
+    tile.maxValue = hi;
+}
+
+HeatmapImage HeatmapRenderer::compose(const HeatmapSpec &spec, const ViewportSnapshot &viewport,
+                                      HeatmapCache &cache, const Colormap &colormap)
+{
+    TraceScope trace("composeHeatmap", "paint");
+    HeatmapImage result;
+    result.viewport = viewport;
+    const int passes = static_cast<int>(std::size(ProgressiveLevels));
+    TileRange ranges[std::size(ProgressiveLevels)];
+    for (int pass = 0; pass < passes; ++pass) {
+        if (!tileRange(viewport, ProgressiveLevels[pass], ranges[pass])) {
+            return result;
+        }
+    }
+    const TileRange &finest = ranges[passes - 1];
+
+    auto forEachTile = [&cache](const TileRange &range, const std::function<void(const ImplicitTileKey &,
+                                                                                  const HeatmapCache::Tile &)> &visit) {
+        for (qint64 row = range.firstRow; row <= range.lastRow; ++row) {
+            for (qint64 column = range.firstColumn; column <= range.lastColumn; ++column) {
+                const ImplicitTileKey key{range.xLevel, range.yLevel, column, row};
+                auto tile = cache.tiles.constFind(key);
+                if (tile != cache.tiles.constEnd()) {
+                    visit(key, *tile);
+                }
+            }
+        }
+    };
+
+    // Диапазон шкалы — по самому точному уровню, где уже есть плитки
+    double lo = spec.minValue;
+    double hi = spec.maxValue;
+    if (spec.autoRange) {
+        lo = std::numeric_limits<double>::infinity();
+        hi = -std::numeric_limits<double>::infinity();
+        for (int pass = passes - 1; pass >= 0 && !(lo <= hi); --pass) {
+            forEachTile(ranges[pass], [&lo, &hi](const ImplicitTileKey &, const HeatmapCache::Tile &tile) {
+                if (tile.hasValues) {
+                    lo = std::min(lo, double(tile.minValue));
+                    hi = std::max(hi, double(tile.maxValue));
+                }
+            });
+        }
+        if (!(lo <= hi)) {
+            return result;
+        }
+    }
+    if (!(hi > lo)) {
+        hi = lo + 1.0;
+    }
+    result.minValue = lo;
+    result.maxValue = hi;
+
+    // Плитка покрыта, если на самом точном уровне есть все плитки под ней
+    auto coveredByFinest = [&cache, &finest](const ImplicitTileKey &key, int offset) {
+        const qint64 factor = qint64(1) << offset;
+        const qint64 firstColumn = std::max(key.column * factor, finest.firstColumn);
+        const qint64 lastColumn = std::min((key.column + 1) * factor - 1, finest.lastColumn);
+        const qint64 firstRow = std::max(key.row * factor, finest.firstRow);
+        const qint64 lastRow = std::min((key.row + 1) * factor - 1, finest.lastRow);
+        for (qint64 row = firstRow; row <= lastRow; ++row) {
+            for (qint64 column = firstColumn; column <= lastColumn; ++column) {
+                if (!cache.tiles.contains(ImplicitTileKey{finest.xLevel, finest.yLevel, column, row})) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // От грубых уровней к точным: точные плитки рисуются поверх грубых
+    struct DrawItem {
+        const HeatmapCache::Tile *tile;
+        QRect target;
+    };
+    std::vector<DrawItem> items;
+    const double width = viewport.size.width();
+    const double height = viewport.size.height();
+    const double kx = width / (viewport.xMax - viewport.xMin);
+    const double ky = height / (viewport.yMax - viewport.yMin);
+    for (int pass = 0; pass < passes; ++pass) {
+        const int offset = ProgressiveLevels[pass];
+        const TileRange &range = ranges[pass];
+        const double tileWidth = std::ldexp(double(TileSize), range.xLevel);
+        const double tileHeight = std::ldexp(double(TileSize), range.yLevel);
+        forEachTile(range, [&](const ImplicitTileKey &key, const HeatmapCache::Tile &tile) {
+            if (pass < passes - 1 && coveredByFinest(key, offset)) {
+                return;
+            }
+            // Края округляются одинаково у соседних плиток, поэтому между ними нет щелей
+            const int left = qRound((key.column * tileWidth - viewport.xMin) * kx);
+            const int right = qRound(((key.column + 1) * tileWidth - viewport.xMin) * kx);
+            const int top = qRound(height - ((key.row + 1) * tileHeight - viewport.yMin) * ky);
+            const int bottom = qRound(height - (key.row * tileHeight - viewport.yMin) * ky);
+            items.push_back(DrawItem{&tile, QRect(left, top, right - left, bottom - top)});
+        });
+    }
+
+    // Раскраска через таблицу цветов — параллельно по плиткам, сведение — по порядку
+    std::vector<QImage> images(items.size());
+    const QRgb *lut = colormap.table();
+    const double scale = (Colormap::Size - 1) / (hi - lo);
+    WorkStealingPool::instance().run(static_cast<int>(items.size()), [&](int index, int) {
+        QImage image(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+        const float *values = items[index].tile->values.data();
+        for (int j = 0; j < TileSize; ++j) {
+            // Строки плитки идут снизу вверх, строки изображения — сверху вниз
+            const float *row = values + (TileSize - 1 - j) * TileSize;
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(j));
+            for (int i = 0; i < TileSize; ++i) {
+                const double t = (row[i] - lo) * scale;
+                if (!std::isfinite(t)) {
+                    line[i] = 0;
+                    continue;
+                }
+                line[i] = lut[static_cast<int>(std::clamp(t, 0.0, double(Colormap::Size - 1)) + 0.5)];
+            }
+        }
+        images[index] = image;
+    });
+
+    result.image = QImage(viewport.size, QImage::Format_ARGB32_Premultiplied);
+    result.image.fill(Qt::transparent);
+    QPainter painter(&result.image);
+    for (size_t i = 0; i < items.size(); ++i) {
+        painter.drawImage(items[i].target, images[i]);
+    }
+    return result;
+}
+
+QVector<ImplicitTileKey> HeatmapRenderer::missingTiles(const TileRange &range, HeatmapCache &cache)
+{
+    QVector<ImplicitTileKey> missing;
+    for (qint64 row = range.firstRow; row <= range.lastRow; ++row) {
+        for (qint64 column = range.firstColumn; column <= range.lastColumn; ++column) {
+            const ImplicitTileKey key{range.xLevel, range.yLevel, column, row};
+            auto tile = cache.tiles.find(key);
+            if (tile != cache.tiles.end()) {
+                tile->lastUse = cache.useCounter;
+                ++cache.last.hits;
+            } else {
+                missing.append(key);
+            }
+        }
+    }
+    return missing;
+}
+
+bool HeatmapRenderer::calculateTiles(const ImplicitFunction &function, const QVector<ImplicitTileKey> &missing,
+                                     HeatmapCache &cache, const CancelCheck &cancelled, int &evaluated)
+{
+    std::vector<HeatmapCache::Tile> computed(missing.size());
+    std::vector<char> done(missing.size(), 0);
+    WorkStealingPool::instance().run(missing.size(), [&](int index, int slot) {
+        if (cancelled && cancelled()) {
+            return;
+        }
+        calculateTile(function, missing[index], computed[index], slot);
+        done[index] = 1;
+    });
+    // Досчитанные плитки сохраняем и при отмене: следующему заданию они пригодятся
+    for (int i = 0; i < missing.size(); ++i) {
+        if (!done[i]) {
+            continue;
+        }
+        HeatmapCache::Tile &tile = cache.tiles[missing[i]];
+        tile = std::move(computed[i]);
+        tile.lastUse = cache.useCounter;
+        cache.bytes += static_cast<qint64>(tile.values.capacity() * sizeof(float));
+        ++cache.last.misses;
+        evaluated += TileSize * TileSize;
+    }
+    return !(cancelled && cancelled());
+}
+
+bool HeatmapRenderer::render(const ImplicitFunction &function, const HeatmapSpec &spec,
+                             const ViewportSnapshot &viewport, HeatmapCache &cache, const Publish &publish,
+                             const CancelCheck &cancelled, int *evaluations, const Colormap &colormap)
+{
+    TraceScope trace("renderHeatmap", "sampling");
+    if (evaluations) {
+        *evaluations = 0;
+    }
+    TileRange finest;
+    if (spec.isEmpty() || !tileRange(viewport, 0, finest)) {
+        return true;
+    }
+    try {
+        function.prepareSlots(WorkStealingPool::instance().slotCount());
+    }
+    catch (const mu::Parser::exception_type &e) {
+        qDebug() << "Ошибка разбора поля:" << QString::fromStdString(e.GetMsg());
+        return true;
+    }
+    ++cache.useCounter;
+    cache.last = HeatmapCache::Stats();
+
+    // Область уже целиком есть на точном уровне — грубые уровни не нужны
+    const QVector<ImplicitTileKey> finestMissing = missingTiles(finest, cache);
+    int evaluated = 0;
+    const int passes = static_cast<int>(std::size(ProgressiveLevels));
+    for (int pass = finestMissing.isEmpty() ? passes - 1 : 0; pass < passes; ++pass) {
+        const bool final = pass == passes - 1;
+        TileRange range;
+        if (!tileRange(viewport, ProgressiveLevels[pass], range)) {
+            continue;
+        }
+        const bool completed = calculateTiles(function, final ? finestMissing : missingTiles(range, cache),
+                                              cache, cancelled, evaluated);
+        if (evaluations) {
+            *evaluations = evaluated;
+        }
+        if (!completed) {
+            cache.evict();
+            return false;
+        }
+        if (publish) {
+            publish(compose(spec, viewport, cache, colormap), final);
+        }
+    }
+    cache.evict();
+    return true;
+}
+
+HeatmapImage HeatmapRenderer::renderFinal(const ImplicitFunction &function, const HeatmapSpec &spec,
+                                          const ViewportSnapshot &viewport, HeatmapCache &cache,
+                                          int *evaluations, const Colormap &colormap)
+{
+    HeatmapImage image;
+    render(function, spec, viewport, cache, [&image](const HeatmapImage &result, bool final) {
+        if (final) {
+            image = result;
+        }
+    }, CancelCheck(), evaluations, colormap);
+    return image;
+}
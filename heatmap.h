@@ -0,0 +1,161 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <vector>
+#include "functionsampler.h"
+#include "implicitcurve.h"
+
+// Цветовая шкала в виде таблицы: значение переводится в цвет одним обращением
+// к массиву, без интерполяции на каждый пиксель
+class Colormap
+{
+public:
+    static constexpr int Size = 256;
+
+    // Цвета таблицы линейно интерполируются между опорными, расставленными равномерно
+    explicit Colormap(const QVector<QColor> &stops);
+
+    // Перцептивно равномерная шкала viridis (от тёмно-фиолетового к жёлтому)
+    static const Colormap &viridis();
+
+    // t от 0 до 1; значения вне диапазона прижимаются к краям
+    QRgb color(double t) const;
+    const QRgb *table() const { return lut.constData(); }
+
+private:
+    QVector<QRgb> lut;
+};
+
+// Скалярное поле f(x, y), которое рисуется цветом под графиками
+struct HeatmapSpec {
+    QString expression;
+    // Диапазон шкалы — по значениям в области просмотра или заданный
+    bool autoRange = true;
+    double minValue = -1.0;
+    double maxValue = 1.0;
+
+    bool isEmpty() const { return expression.isEmpty(); }
+    // Подпись в статистике; она же ключ в EvaluationResult::stats
+    QString key() const { return QString("f(x, y) = %1").arg(expression); }
+
+    bool operator==(const HeatmapSpec &other) const {
+        return expression == other.expression && autoRange == other.autoRange &&
+               minValue == other.minValue && maxValue == other.maxValue;
+    }
+    bool operator!=(const HeatmapSpec &other) const {
+        return !(*this == other);
+    }
+};
+
+// Изображение поля для области просмотра viewport; пиксели вне области
+// определения f прозрачны
+struct HeatmapImage {
+    QImage image;
+    ViewportSnapshot viewport;
+    double minValue = 0.0;
+    double maxValue = 0.0;
+
+    bool isNull() const { return image.isNull(); }
+};
+
+// Плитки значений поля. Пиксель поля на уровне (xLevel, yLevel) — прямоугольник
+// 2^xLevel x 2^yLevel единиц графика, плитка — TileSize x TileSize пикселей,
+// границы плиток кратны их размеру. Плитки не зависят от положения области
+// просмотра и переживают и сдвиг, и зум: при возврате к прежнему масштабу они
+// берутся готовыми, а при новом масштабе до досчёта показываются соседние уровни.
+// При превышении бюджета памяти удаляются плитки, к которым дольше всего не обращались.
+class HeatmapCache
+{
+public:
+    struct Stats {
+        int hits = 0;    // плиток взято из кэша
+        int misses = 0;  // плиток вычислено заново
+    };
+
+    static constexpr qint64 DefaultMemoryBudget = 64 * 1024 * 1024;
+
+    void clear();
+    int tileCount() const { return tiles.size(); }
+    qint64 memoryUsage() const { return bytes; }
+    qint64 memoryBudget() const { return budget; }
+    void setMemoryBudget(qint64 bytes);
+    // Статистика последнего вызова HeatmapRenderer::render
+    const Stats &lastStats() const { return last; }
+
+private:
+    friend class HeatmapRenderer;
+
+    struct Tile {
+        // Строки снизу вверх (по возрастанию y)
+        std::vector<float> values;
+        float minValue = 0;
+        float maxValue = 0;
+        bool hasValues = false;     // есть ли конечные значения
+        quint64 lastUse = 0;
+    };
+
+    QHash<ImplicitTileKey, Tile> tiles;
+    qint64 bytes = 0;
+    qint64 budget = DefaultMemoryBudget;
+    quint64 useCounter = 0;
+    Stats last;
+
+    void evict();
+};
+
+// Построение изображения поля от грубого к точному. Для каждого уровня из
+// ProgressiveLevels (пиксель поля — 8, 2 и 1 пиксель экрана) досчитываются
+// недостающие плитки области, и сведённое изображение сразу отдаётся в publish:
+// новая область сначала появляется грубой, а при сдвиге досчитываются только
+// открывшиеся полосы. Плитки считаются параллельно в пуле потоков, значения —
+// пакетно собственным вычислителем (SIMD) или muParser.
+class HeatmapRenderer
+{
+public:
+    using CancelCheck = std::function<bool()>;
+    // Изображение после очередного уровня; final — после самого точного
+    using Publish = std::function<void(const HeatmapImage &image, bool final)>;
+
+    static constexpr int TileSize = 64;
+    static constexpr int ProgressiveLevels[] = {3, 1, 0};
+
+    // false при отмене; досчитанные к этому моменту плитки остаются в кэше
+    static bool render(const ImplicitFunction &function, const HeatmapSpec &spec,
+                       const ViewportSnapshot &viewport, HeatmapCache &cache, const Publish &publish,
+                       const CancelCheck &cancelled = CancelCheck(), int *evaluations = nullptr,
+                       const Colormap &colormap = Colormap::viridis());
+    // Сразу точное изображение, без промежуточных (пакетная отрисовка)
+    static HeatmapImage renderFinal(const ImplicitFunction &function, const HeatmapSpec &spec,
+                                    const ViewportSnapshot &viewport, HeatmapCache &cache,
+                                    int *evaluations = nullptr, const Colormap &colormap = Colormap::viridis());
+
+private:
+    struct TileRange {
+        int xLevel;
+        int yLevel;
+        qint64 firstColumn;
+        qint64 lastColumn;
+        qint64 firstRow;
+        qint64 lastRow;
+    };
+
+    // Плитки уровня offset (над уровнем, где пиксель поля близок к пикселю экрана)
+    static bool tileRange(const ViewportSnapshot &viewport, int offset, TileRange &range);
+    // Недостающие плитки диапазона; найденные отмечаются как использованные
+    static QVector<ImplicitTileKey> missingTiles(const TileRange &range, HeatmapCache &cache);
+    // Параллельный досчёт плиток; false при отмене
+    static bool calculateTiles(const ImplicitFunction &function, const QVector<ImplicitTileKey> &missing,
+                               HeatmapCache &cache, const CancelCheck &cancelled, int &evaluated);
+    static void calculateTile(const ImplicitFunction &function, const ImplicitTileKey &key,
+                              HeatmapCache::Tile &tile, int slot);
+    static HeatmapImage compose(const HeatmapSpec &spec, const ViewportSnapshot &viewport,
+                                HeatmapCache &cache, const Colormap &colormap);
+};
+
+#endif // HEATMAP_H
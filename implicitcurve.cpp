@@ -0,0 +1,437 @@
+#include "implicitcurve.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "function.h"
+#include "expressionnormalizer.h"
+#include "workstealingpool.h"
+#include "tracer.h"
+
+namespace {
+
+// Номер плитки по номеру ячейки (деление с округлением вниз)
+qint64 tileOf(qint64 cell)
+{
+    const qint64 size = ImplicitCurveSampler::TileCells;
+    return cell >= 0 ? cell / size : -((-cell + size - 1) / size);
+}
+
+// Ячейка квадродерева; значения F в углах против часовой стрелки,
+// начиная с (x, y): (x, y), (x + w, y), (x + w, y + h), (x, y + h)
+struct QuadCell {
+    double x;
+    double y;
+    double w;
+    double h;
+    double v[4];
+};
+
+// Кривая проходит через ячейку, если F в углах разного знака.
+// Ячейки с NaN в углах (вне области определения) не рассматриваются
+bool crosses(const double *v)
+{
+    bool positive = false;
+    bool negative = false;
+    for (int i = 0; i < 4; ++i) {
+        if (!std::isfinite(v[i])) {
+            return false;
+        }
+        (v[i] > 0 ? positive : negative) = true;
+    }
+    return positive && negative;
+}
+
+// Marching squares для одной ячейки: точки пересечения кривой с рёбрами
+// (линейная интерполяция) и один или два отрезка между ними
+void marchCell(const QuadCell &cell, std::vector<double> &segments)
+{
+    const double px[4] = {cell.x, cell.x + cell.w, cell.x + cell.w, cell.x};
+    const double py[4] = {cell.y, cell.y, cell.y + cell.h, cell.y + cell.h};
+    double ex[4], ey[4];
+    bool has[4];
+    int count = 0;
+    for (int e = 0; e < 4; ++e) {
+        const int a = e;
+        const int b = (e + 1) % 4;
+        has[e] = (cell.v[a] > 0) != (cell.v[b] > 0);
+        if (has[e]) {
+            const double t = cell.v[a] / (cell.v[a] - cell.v[b]);
+            ex[e] = px[a] + (px[b] - px[a]) * t;
+            ey[e] = py[a] + (py[b] - py[a]) * t;
+            ++count;
+        }
+    }
+
+    auto add = [&](int e1, int e2) {
+        segments.insert(segments.end(), {ex[e1], ey[e1], ex[e2], ey[e2]});
+    };
+    if (count == 2) {
+        int first = -1;
+        for (int e = 0; e < 4; ++e) {
+            if (!has[e]) {
+                continue;
+            }
+            if (first < 0) {
+                first = e;
+            } else {
+                add(first, e);
+            }
+        }
+    } else if (count == 4) {
+        // Седло: знак в центре (среднее по углам) решает, какие углы соединены
+        const double center = 0.25 * (cell.v[0] + cell.v[1] + cell.v[2] + cell.v[3]);
+        if ((center > 0) == (cell.v[0] > 0)) {
+            add(0, 1);
+            add(2, 3);
+        } else {
+            add(3, 0);
+            add(1, 2);
+        }
+    }
+}
+
+} // namespace
+
+ImplicitFunction::ImplicitFunction(const QString &expression)
+    : text(expression)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    // Нейтральные члены, чтобы у любого выражения были обе переменные
+    processedExpression = QString("(%1)+0*x+0*y")
+                              .arg(ExpressionNormalizer::normalize(text, QStringLiteral("xy")))
+                              .toStdString();
+    compiled = CompiledExpression::compile(processedExpression, {"x", "y"});
+}
+
+ImplicitFunction::ImplicitFunction(const ImplicitFunction &other)
+    : text(other.text)
+    , processedExpression(other.processedExpression)
+    , compiled(other.compiled)
+{
+}
+
+ImplicitFunction &ImplicitFunction::operator=(const ImplicitFunction &other)
+{
+    if (this != &other) {
+        ImplicitFunction copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+QString ImplicitFunction::key(const QString &expression)
+{
+    return QString("%1 = 0").arg(expression);
+}
+
+std::unique_ptr<ImplicitFunction::SlotParser> ImplicitFunction::createParser() const
+{
+    std::unique_ptr<SlotParser> slot(new SlotParser);
+    slot->parser.reset(new mu::Parser(Function::prototypeParser()));
+    slot->xs.assign(1, 0.0);
+    slot->ys.assign(1, 0.0);
+    slot->parser->DefineVar("x", slot->xs.data());
+    slot->parser->DefineVar("y", slot->ys.data());
+    slot->parser->SetExpr(processedExpression);
+    return slot;
+}
+
+mu::Parser &ImplicitFunction::muParser() const
+{
+    prepareSlots(1);
+    SlotParser &slot = *parsers[0];
+    slot.xs[0] = 0.0;
+    slot.ys[0] = 0.0;
+    return *slot.parser;
+}
+
+void ImplicitFunction::prepareSlots(int slotCount) const
+{
+    if (compiled && Function::nativeEvaluatorEnabled) {
+        return;
+    }
+    while (static_cast<int>(parsers.size()) < slotCount) {
+        parsers.push_back(createParser());
+    }
+}
+
+void ImplicitFunction::evaluate(const double *xs, const double *ys, double *out, int count, int slot) const
+{
+    if (count <= 0) {
+        return;
+    }
+    if (compiled && Function::nativeEvaluatorEnabled) {
+        const double *variables[] = {xs, ys};
+        compiled->evaluate(variables, out, count);
+        return;
+    }
+
+    try {
+        SlotParser &parser = *parsers.at(slot);
+        if (static_cast<int>(parser.xs.size()) < count) {
+            // Буферы переехали в памяти — перепривязываем к ним переменные
+            parser.xs.resize(count);
+            parser.ys.resize(count);
+            parser.parser->DefineVar("x", parser.xs.data());
+            parser.parser->DefineVar("y", parser.ys.data());
+        }
+        std::copy(xs, xs + count, parser.xs.begin());
+        std::copy(ys, ys + count, parser.ys.begin());
+        parser.parser->Eval(out, count);
+        return;
+    }
+    catch (const mu::Parser::exception_type &e) {
+        qDebug() << "Ошибка вычисления неявной кривой:" << QString::fromStdString(e.GetMsg());
+    }
+    catch (const std::exception &e) {
+        qDebug() << "Стандартная ошибка C++:" << e.what();
+    }
+    std::fill(out, out + count, std::numeric_limits<double>::quiet_NaN());
+}
+
+void ImplicitCurveCache::clear()
+{
+    tiles.clear();
+    bytes = 0;
+}
+
+void ImplicitCurveCache::setMemoryBudget(qint64 newBudget)
+{
+    budget = newBudget;
+    evict();
+}
+
+void ImplicitCurveCache::evict()
+{
+    if (bytes <= budget) {
+        return;
+    }
+    // Удаляем плитки, к которым дольше всего не обращались; текущие не трогаем
+    QVector<QPair<quint64, ImplicitTileKey>> order;
+    order.reserve(tiles.size());
+    for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        if (it->lastUse != useCounter) {
+            order.append({it->lastUse, it.key()});
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const QPair<quint64, ImplicitTileKey> &a,
+                                             const QPair<quint64, ImplicitTileKey> &b) {
+        return a.first < b.first;
+    });
+    for (const auto &entry : order) {
+        if (bytes <= budget) {
+            break;
+        }
+        auto tile = tiles.find(entry.second);
+        bytes -= static_cast<qint64>(tile->segments.capacity() * sizeof(double));
+        tiles.erase(tile);
+    }
+}
+
+bool ImplicitCurveSampler::levelsFor(const ViewportSnapshot &viewport, int &xLevel, int &yLevel)
+{
+    const int width = viewport.size.width();
+    const int height = viewport.size.height();
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    // Шаги округляются вниз до степени двойки: ячейка не крупнее CellPixels
+    const double rawStepX = (viewport.xMax - viewport.xMin) * CellPixels / width;
+    const double rawStepY = (viewport.yMax - viewport.yMin) * CellPixels / height;
+    if (!std::isfinite(rawStepX) || !std::isfinite(rawStepY) || rawStepX <= 0 || rawStepY <= 0) {
+        return false;
+    }
+    xLevel = static_cast<int>(std::floor(std::log2(rawStepX)));
+    yLevel = static_cast<int>(std::floor(std::log2(rawStepY)));
+    return true;
+}
+
+int ImplicitCurveSampler::calculateTile(const ImplicitFunction &function, const ImplicitTileKey &key,
+                                        std::vector<double> &segments, int slot)
+{
+    TraceScope trace("calculateImplicitTile", "sampling");
+    const double stepX = std::ldexp(1.0, key.xLevel);
+    const double stepY = std::ldexp(1.0, key.yLevel);
+    const int nodes = TileCells + 1;
+
+    // Узлы редкой сетки плитки
+    std::vector<double> xs(nodes * nodes), ys(nodes * nodes), values(nodes * nodes);
+    for (int j = 0; j < nodes; ++j) {
+        for (int i = 0; i < nodes; ++i) {
+            xs[j * nodes + i] = (key.column * TileCells + i) * stepX;
+            ys[j * nodes + i] = (key.row * TileCells + j) * stepY;
+        }
+    }
+    function.evaluate(xs.data(), ys.data(), values.data(), nodes * nodes, slot);
+    int evaluations = nodes * nodes;
+
+    std::vector<QuadCell> cells, next;
+    for (int j = 0; j < TileCells; ++j) {
+        for (int i = 0; i < TileCells; ++i) {
+            const int n = j * nodes + i;
+            QuadCell cell{xs[n], ys[n], stepX, stepY,
+                          {values[n], values[n + 1], values[n + nodes + 1], values[n + nodes]}};
+            if (crosses(cell.v)) {
+                cells.push_back(cell);
+            }
+        }
+    }
+
+    // Квадродерево: у каждой ячейки со сменой знака досчитываются середины рёбер
+    // и центр, и дальше идут только дочерние ячейки со сменой знака.
+    // Все точки одного уровня вычисляются одним пакетом
+    for (int depth = 0; depth < RefineDepth && !cells.empty(); ++depth) {
+        const int count = static_cast<int>(cells.size()) * 5;
+        xs.resize(count);
+        ys.resize(count);
+        values.resize(count);
+        for (size_t k = 0; k < cells.size(); ++k) {
+            const QuadCell &c = cells[k];
+            const double mx = c.x + 0.5 * c.w;
+            const double my = c.y + 0.5 * c.h;
+            const double px[5] = {mx, c.x + c.w, mx, c.x, mx};
+            const double py[5] = {c.y, my, c.y + c.h, my, my};
+            std::copy(px, px + 5, xs.begin() + 5 * k);
+            std::copy(py, py + 5, ys.begin() + 5 * k);
+        }
+        function.evaluate(xs.data(), ys.data(), values.data(), count, slot);
+        evaluations += count;
+
+        next.clear();
+        for (size_t k = 0; k < cells.size(); ++k) {
+            const QuadCell &c = cells[k];
+            // Середины нижнего, правого, верхнего и левого рёбер и центр
+            const double *m = values.data() + 5 * k;
+            const double hw = 0.5 * c.w;
+            const double hh = 0.5 * c.h;
+            const QuadCell children[4] = {
+                {c.x, c.y, hw, hh, {c.v[0], m[0], m[4], m[3]}},
+                {c.x + hw, c.y, hw, hh, {m[0], c.v[1], m[1], m[4]}},
+                {c.x + hw, c.y + hh, hw, hh, {m[4], m[1], c.v[2], m[2]}},
+                {c.x, c.y + hh, hw, hh, {m[3], m[4], m[2], c.v[3]}}
+            };
+            for (const QuadCell &child : children) {
+                if (crosses(child.v)) {
+                    next.push_back(child);
+                }
+            }
+        }
+        cells.swap(next);
+    }
+
+    segments.clear();
+    for (const QuadCell &cell : cells) {
+        marchCell(cell, segments);
+    }
+    trace.setValue(static_cast<qint64>(segments.size() / 4));
+    return evaluations;
+}
+
+bool ImplicitCurveSampler::calculateSegments(const ImplicitFunction &function, const ViewportSnapshot &viewport,
+                                             SampleBuffer &segments, const CancelCheck &cancelled,
+                                             int *evaluations, ImplicitCurveCache *cache)
+{
+    TraceScope trace("calculateImplicit", "sampling");
+    segments.clear();
+    if (evaluations) {
+        *evaluations = 0;
+    }
+    int xLevel = 0;
+    int yLevel = 0;
+    if (function.expression().isEmpty() || !levelsFor(viewport, xLevel, yLevel)) {
+        return true;
+    }
+
+    // Дальше этого double уже не различает соседние узлы сетки
+    const double stepX = std::ldexp(1.0, xLevel);
+    const double stepY = std::ldexp(1.0, yLevel);
+    const double bounds[4] = {std::floor(viewport.xMin / stepX), std::ceil(viewport.xMax / stepX) - 1,
+                              std::floor(viewport.yMin / stepY), std::ceil(viewport.yMax / stepY) - 1};
+    for (double bound : bounds) {
+        if (!(std::abs(bound) < 1e15)) {
+            return true;
+        }
+    }
+    const qint64 firstColumn = tileOf(static_cast<qint64>(bounds[0]));
+    const qint64 lastColumn = tileOf(std::max(static_cast<qint64>(bounds[0]), static_cast<qint64>(bounds[1])));
+    const qint64 firstRow = tileOf(static_cast<qint64>(bounds[2]));
+    const qint64 lastRow = tileOf(std::max(static_cast<qint64>(bounds[2]), static_cast<qint64>(bounds[3])));
+
+    ImplicitCurveCache local;
+    ImplicitCurveCache &tiles = cache ? *cache : local;
+    ++tiles.useCounter;
+    tiles.last = ImplicitCurveCache::Stats();
+
+    QVector<ImplicitTileKey> visible;
+    QVector<ImplicitTileKey> missing;
+    for (qint64 row = firstRow; row <= lastRow; ++row) {
+        for (qint64 column = firstColumn; column <= lastColumn; ++column) {
+            const ImplicitTileKey key{xLevel, yLevel, column, row};
+            visible.append(key);
+            auto tile = tiles.tiles.find(key);
+            if (tile != tiles.tiles.end()) {
+                tile->lastUse = tiles.useCounter;
+                ++tiles.last.hits;
+            } else {
+                missing.append(key);
+            }
+        }
+    }
+
+    // Недостающие плитки — задачи пула потоков; у каждого слота свой парсер
+    WorkStealingPool &pool = WorkStealingPool::instance();
+    std::vector<std::vector<double>> results(missing.size());
+    std::vector<int> tileEvaluations(missing.size(), -1);
+    try {
+        function.prepareSlots(pool.slotCount());
+    }
+    catch (const mu::Parser::exception_type &e) {
+        qDebug() << "Ошибка разбора неявной кривой:" << QString::fromStdString(e.GetMsg());
+        return true;
+    }
+    pool.run(missing.size(), [&](int index, int slot) {
+        if (cancelled && cancelled()) {
+            return;
+        }
+        tileEvaluations[index] = calculateTile(function, missing[index], results[index], slot);
+    });
+
+    // Досчитанные плитки сохраняем и при отмене: следующему заданию они пригодятся
+    int evaluated = 0;
+    for (int i = 0; i < missing.size(); ++i) {
+        if (tileEvaluations[i] < 0) {
+            continue;
+        }
+        evaluated += tileEvaluations[i];
+        ImplicitCurveCache::Tile &tile = tiles.tiles[missing[i]];
+        tile.segments = std::move(results[i]);
+        tile.lastUse = tiles.useCounter;
+        tiles.bytes += static_cast<qint64>(tile.segments.capacity() * sizeof(double));
+        ++tiles.last.misses;
+    }
+    if (evaluations) {
+        *evaluations = evaluated;
+    }
+    if (cancelled && cancelled()) {
+        tiles.evict();
+        return false;
+    }
+
+    for (const ImplicitTileKey &key : visible) {
+        auto found = tiles.tiles.constFind(key);
+        if (found == tiles.tiles.constEnd()) {
+            continue;
+        }
+        const std::vector<double> &tile = found->segments;
+        for (size_t i = 0; i + 3 < tile.size(); i += 4) {
+            segments.append(tile[i], tile[i + 1]);
+            segments.append(tile[i + 2], tile[i + 3]);
+        }
+    }
+    tiles.evict();
+    trace.setValue(segments.size() / 2);
+    return true;
+}
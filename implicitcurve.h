@@ -0,0 +1,154 @@
+#ifndef IMPLICITCURVE_H
+#define IMPLICITCURVE_H
+
+#include <QString>
+#include <QHash>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <muParser.h>
+#include "expressioncompiler.h"
+#include "functionsampler.h"
+#include "samplebuffer.h"
+
+// Левая часть уравнения неявной кривой F(x, y) = 0, например x^2 + y^2 - 4.
+// Выражение приводится к синтаксису muParser так же, как у Function, но с двумя
+// переменными. Если собственный вычислитель его поддерживает, вычисления идут
+// через него из любых потоков сразу; иначе у каждого слота пула свой muParser.
+class ImplicitFunction
+{
+public:
+    explicit ImplicitFunction(const QString &expression = QString());
+    ImplicitFunction(const ImplicitFunction &other);
+    ImplicitFunction &operator=(const ImplicitFunction &other);
+    ImplicitFunction(ImplicitFunction &&other) noexcept = default;
+    ImplicitFunction &operator=(ImplicitFunction &&other) noexcept = default;
+
+    const QString &expression() const { return text; }
+    bool isCompiled() const { return compiled != nullptr; }
+    // Подпись на графике; она же ключ отрезков кривой в EvaluationResult
+    QString key() const { return key(text); }
+    static QString key(const QString &expression);
+
+    // Парсер для проверки выражения; переменные x и y привязаны к значениям 0
+    mu::Parser &muParser() const;
+
+    // Готовит парсеры для slotCount слотов; вызывается до параллельного evaluate
+    void prepareSlots(int slotCount) const;
+    // out[i] = F(xs[i], ys[i]). slot — слот пула потоков, из которого идёт вызов.
+    // При ошибке muParser out заполняется NaN
+    void evaluate(const double *xs, const double *ys, double *out, int count, int slot = 0) const;
+
+private:
+    struct SlotParser {
+        std::unique_ptr<mu::Parser> parser;
+        std::vector<double> xs;
+        std::vector<double> ys;
+    };
+
+    QString text;
+    std::string processedExpression;
+    std::shared_ptr<const CompiledExpression> compiled;
+    // Слот 0 — также парсер muParser(); при копировании не переносятся
+    mutable std::vector<std::unique_ptr<SlotParser>> parsers;
+
+    std::unique_ptr<SlotParser> createParser() const;
+};
+
+// Ключ плитки неявной кривой: уровни шага сетки по x и y и номер плитки
+struct ImplicitTileKey {
+    int xLevel;
+    int yLevel;
+    qint64 column;
+    qint64 row;
+
+    bool operator==(const ImplicitTileKey &other) const {
+        return xLevel == other.xLevel && yLevel == other.yLevel &&
+               column == other.column && row == other.row;
+    }
+};
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+inline size_t qHash(const ImplicitTileKey &key, size_t seed = 0)
+#else
+inline uint qHash(const ImplicitTileKey &key, uint seed = 0)
+#endif
+{
+    return qHash(key.column, seed) ^ qHash(key.row * 1000003, seed) ^
+           static_cast<decltype(seed)>(key.xLevel * 31 + key.yLevel * 131071);
+}
+
+// Отрезки неявной кривой по плиткам сетки. Результат плитки зависит только
+// от уровней шага, поэтому при сдвиге области вычисляются лишь открывшиеся плитки.
+// Как и в SampleCache, при превышении бюджета памяти удаляются плитки,
+// к которым дольше всего не обращались.
+class ImplicitCurveCache
+{
+public:
+    struct Stats {
+        int hits = 0;    // плиток взято из кэша
+        int misses = 0;  // плиток вычислено заново
+    };
+
+    static constexpr qint64 DefaultMemoryBudget = 8 * 1024 * 1024;
+
+    void clear();
+    int tileCount() const { return tiles.size(); }
+    qint64 memoryUsage() const { return bytes; }
+    qint64 memoryBudget() const { return budget; }
+    void setMemoryBudget(qint64 bytes);
+    // Статистика последнего вызова calculateSegments
+    const Stats &lastStats() const { return last; }
+
+private:
+    friend class ImplicitCurveSampler;
+
+    struct Tile {
+        // Отрезки четвёрками x0, y0, x1, y1
+        std::vector<double> segments;
+        quint64 lastUse = 0;
+    };
+
+    QHash<ImplicitTileKey, Tile> tiles;
+    qint64 bytes = 0;
+    qint64 budget = DefaultMemoryBudget;
+    quint64 useCounter = 0;
+    Stats last;
+
+    void evict();
+};
+
+// Построение неявной кривой: F вычисляется на редкой сетке (ячейка CellPixels/2..CellPixels
+// пикселей, шаги по x и y — степени двойки, узлы кратны шагу), ячейки со сменой
+// знака F в углах делятся квадродеревом RefineDepth раз, до долей пикселя, и в
+// получившихся ячейках отрезки кривой строятся методом marching squares с линейной
+// интерполяцией по рёбрам. Сетка разбита на плитки по TileCells x TileCells ячеек;
+// плитки считаются параллельно в пуле потоков.
+// Замкнутая кривая, целиком помещающаяся внутри одной ячейки редкой сетки
+// (меньше CellPixels/2 пикселей), может быть пропущена: смены знака в углах нет.
+class ImplicitCurveSampler
+{
+public:
+    using CancelCheck = std::function<bool()>;
+
+    static constexpr int CellPixels = 8;
+    // 8 пикселей -> 0.5 пикселя
+    static constexpr int RefineDepth = 4;
+    static constexpr int TileCells = 32;
+
+    // Отрезки кривой в области просмотра записываются в segments парами точек:
+    // точки 2k и 2k + 1 — концы k-го отрезка. При отмене возвращает false, segments пуст
+    static bool calculateSegments(const ImplicitFunction &function, const ViewportSnapshot &viewport,
+                                  SampleBuffer &segments, const CancelCheck &cancelled = CancelCheck(),
+                                  int *evaluations = nullptr, ImplicitCurveCache *cache = nullptr);
+
+private:
+    // Уровни сетки для области просмотра; false, если область вырождена
+    static bool levelsFor(const ViewportSnapshot &viewport, int &xLevel, int &yLevel);
+    // Отрезки одной плитки; возвращает число вычислений F
+    static int calculateTile(const ImplicitFunction &function, const ImplicitTileKey &key,
+                             std::vector<double> &segments, int slot);
+};
+
+#endif // IMPLICITCURVE_H
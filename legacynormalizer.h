@@ -0,0 +1,40 @@
+#ifndef LEGACYNORMALIZER_H
+#define LEGACYNORMALIZER_H
+
+#include <QRegularExpression>
+#include <QString>
+
+// Прежняя обработка выражения регулярными выражениями, до ExpressionNormalizer.
+// В программе не используется: это эталон для теста нормализатора и точка
+// отсчёта в замерах. Возвращает выражение без обёртки (...)+0*x.
+inline QString legacyNormalizeExpression(const QString &expr)
+{
+    QString result = expr;
+    bool isNumber;
+    result.toDouble(&isNumber);
+    if (isNumber) {
+        return result;
+    }
+    result.replace(QRegularExpression("(\\d+)([xX])"), "\\1*\\2");
+    result.replace(QRegularExpression("(\\d*\\.\\d+)([xX])"), "\\1*\\2");
+    result.replace(QRegularExpression("([xX])(\\d+)"), "\\1*\\2");
+    result.replace(QRegularExpression("([xX])(\\d*\\.\\d+)"), "\\1*\\2");
+    result.replace(")(", ")*(");
+    result.replace(")x", ")*x");
+    result.replace(")X", ")*X");
+    result.replace("x(", "x*(");
+    result.replace("X(", "X*(");
+    result.replace("X", "x");
+
+    QRegularExpression powerRegex("([\\d.]+|x|\\([^)]+\\))\\s*\\^\\s*([\\d.]+|x|\\([^)]+\\))");
+    int pos = 0;
+    QRegularExpressionMatch match;
+    while ((match = powerRegex.match(result, pos)).hasMatch()) {
+        QString replacement = QString("pow(%1,%2)").arg(match.captured(1), match.captured(2));
+        result.replace(match.capturedStart(), match.capturedLength(), replacement);
+        pos = match.capturedStart() + replacement.length();
+    }
+    return result;
+}
+
+#endif // LEGACYNORMALIZER_H
@@ -1,10 +1,22 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "tracer.h"
 
 int main(int argc, char *argv[])
 {
+    // FUNCTION_PLOTTER_TRACE=trace.json — записать трассу сессии (см. Tracer)
+    Tracer::startFromEnvironment();
+    Tracer::setThreadName("GUI");
+
     QApplication app(argc, argv);
-    MainWindow window;
-    window.show();
-    return app.exec();
-} 
\ No newline at end of file
+    int result;
+    {
+        MainWindow window;
+        window.show();
+        result = app.exec();
+    }
+    // Окно закрыто, его рабочие потоки остановлены — трассу можно сохранить
+    Tracer::stop();
+    return result;
+}
+ 
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
+    , validator(new ExpressionValidator(this))
 {
     // Инициализируем набор цветов по умолчанию
     defaultColors = {
@@ -22,6 +23,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     setupMainLayout();
     setupSidePanel();
+
+    connect(validator, &ExpressionValidator::validated, this, &MainWindow::onFunctionValidated);
     
     resize(1200, 800);
     setWindowTitle("Построение графиков функций");
@@ -136,37 +139,71 @@ void MainWindow::onAddFunctionClicked()
 
 void MainWindow::onFunctionChanged(FunctionItem *item)
 {
-    QString oldFunction = item->property("lastFunction").toString();
     QString newFunction = item->function();
-    QColor color = item->color();
-    
-    if (!oldFunction.isEmpty()) {
-        plotWidget->updateFunction(oldFunction, newFunction, color);
-    } else {
-        plotWidget->addFunction(newFunction, color);
+    if (newFunction.isEmpty()) {
+        // Поле очищено — убираем график, проверять нечего
+        plotWidget->removeFunction(functionHandle(item));
+        item->setProperty("functionHandle", QVariant());
+        item->setProperty("validationTicket", QVariant());
+        item->setValidationStatus(QString());
+        return;
     }
-    
-    item->setProperty("lastFunction", newFunction);
+
+    // Разбор и пробное вычисление — в фоновом потоке; GUI-поток только запоминает
+    // номер запроса, чтобы потом отбросить устаревшие ответы
+    quint64 ticket = validator->validate(reinterpret_cast<quintptr>(item), newFunction);
+    item->setProperty("validationTicket", ticket);
 }
 
-void MainWindow::onColorChanged(FunctionItem *item)
+void MainWindow::onFunctionValidated(const ValidationResult &result)
 {
-    QString function = item->function();
-    QColor color = item->color();
-    if (!function.isEmpty()) {
-        plotWidget->updateFunction(function, function, color);
+    // Ищем поле ввода, для которого это последний ответ
+    FunctionItem *item = nullptr;
+    for (int i = 0; i < functionsList->count(); ++i) {
+        FunctionItem *candidate = qobject_cast<FunctionItem *>(functionsList->itemAt(i)->widget());
+        if (candidate && reinterpret_cast<quintptr>(candidate) == result.key &&
+            candidate->property("validationTicket").toULongLong() == result.ticket) {
+            item = candidate;
+            break;
+        }
+    }
+    if (!item) {
+        return;
+    }
+
+    if (!result.valid) {
+        item->setValidationStatus(result.error, result.errorPosition);
+        return;
+    }
+    item->setValidationStatus(QString());
+
+    // Функция уже на графике — меняем только выражение, дескриптор и стиль остаются
+    Function function = std::move(*result.function);
+    if (!plotWidget->setFunctionExpression(functionHandle(item), std::move(function))) {
+        function.color = item->color();
+        FunctionHandle handle = plotWidget->addFunction(std::move(function));
+        item->setProperty("functionHandle", handle.toId());
     }
 }
 
+void MainWindow::onColorChanged(FunctionItem *item)
+{
+    // Только перерисовка слоя функции, точки заново не вычисляются
+    plotWidget->setFunctionColor(functionHandle(item), item->color());
+}
+
 void MainWindow::onRemoveFunction(FunctionItem *item)
 {
-    QString function = item->function();
-    if (!function.isEmpty()) {
-        plotWidget->removeFunction(function);
-    }
+    plotWidget->removeFunction(functionHandle(item));
     functionsList->removeWidget(item);
     item->deleteLater();
-    }
+}
+
+FunctionHandle MainWindow::functionHandle(FunctionItem *item) const
+{
+    // Пустой дескриптор, если выражение поля ещё ни разу не попало на график
+    return FunctionHandle::fromId(item->property("functionHandle").toULongLong());
+}
 
 MainWindow::~MainWindow()
 {
@@ -8,6 +8,7 @@
 #include <QScrollArea>
 #include "plotwidget.h"
 #include "functionitem.h"
+#include "expressionvalidator.h"
 
 class MainWindow : public QMainWindow
 {
@@ -22,9 +23,12 @@ private slots:
     void onFunctionChanged(FunctionItem *item);
     void onColorChanged(FunctionItem *item);
     void onRemoveFunction(FunctionItem *item);
+    void onFunctionValidated(const ValidationResult &result);
 
 private:
     PlotWidget *plotWidget;
+    // Разбор и проверка вводимых выражений вне GUI-потока
+    ExpressionValidator *validator;
     QWidget *sidePanel;
     QVBoxLayout *functionsList;
     QPushButton *addFunctionButton;
@@ -38,6 +42,8 @@ private:
     void setupSidePanel();
     void setupMainLayout();
     QColor getNextColor();
+    // Дескриптор функции поля ввода на графике (свойство "functionHandle")
+    FunctionHandle functionHandle(FunctionItem *item) const;
 };
 
 #endif // MAINWINDOW_H 
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef MATHFUNCTIONS_H
+#define MATHFUNCTIONS_H
+
+#include <cmath>
+#include <limits>
+
+// Вспомогательные математические функции, общие для muParser и собственного
+// вычислителя выражений (CompiledExpression), чтобы оба давали одинаковый результат.
+
+// Функция pow: для отрицательного основания и дробного показателя возвращает NaN
+static inline double power_wrapper(double v1, double v2) {
+    if (v1 < 0 && std::floor(v2) != v2) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return std::pow(v1, v2);
+}
+
+// Функция для вычисления котангенса
+static inline double cot(double x) {
+    double tanVal = std::tan(x);
+    if (tanVal == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 1.0 / tanVal;
+}
+
+// Функция для вычисления степени с поддержкой отрицательных чисел
+static inline double power(double base, double exponent) {
+    if (base < 0) {
+        // Для отрицательного основания проверяем, является ли показатель целым числом
+        if (std::abs(exponent - std::round(exponent)) < 1e-10) {
+            return std::pow(base, exponent);
+        }
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return std::pow(base, exponent);
+}
+
+#endif // MATHFUNCTIONS_H
@@ -0,0 +1,262 @@
+#include "parametriccurve.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "workstealingpool.h"
+#include "tracer.h"
+
+namespace {
+
+bool isIdentifierStart(QChar c)
+{
+    return (c >= QLatin1Char('a') && c <= QLatin1Char('z')) ||
+           (c >= QLatin1Char('A') && c <= QLatin1Char('Z')) || c == QLatin1Char('_');
+}
+
+bool isIdentifierChar(QChar c)
+{
+    return isIdentifierStart(c) || (c >= QLatin1Char('0') && c <= QLatin1Char('9'));
+}
+
+// Расстояние от точки m до прямой ab в пикселях
+double distanceToChord(double ax, double ay, double bx, double by, double mx, double my)
+{
+    const double dx = bx - ax;
+    const double dy = by - ay;
+    const double length = std::hypot(dx, dy);
+    if (length == 0) {
+        return std::hypot(mx - ax, my - ay);
+    }
+    return std::abs(dy * (mx - ax) - dx * (my - ay)) / length;
+}
+
+} // namespace
+
+ParametricCurveSpec ParametricCurveSpec::parametric(const QString &x, const QString &y, double tMin, double tMax)
+{
+    ParametricCurveSpec spec;
+    spec.kind = Kind::Parametric;
+    spec.xExpression = x;
+    spec.yExpression = y;
+    spec.tMin = tMin;
+    spec.tMax = tMax;
+    return spec;
+}
+
+ParametricCurveSpec ParametricCurveSpec::polar(const QString &r, double thetaMin, double thetaMax)
+{
+    ParametricCurveSpec spec;
+    spec.kind = Kind::Polar;
+    spec.xExpression = r;
+    spec.tMin = thetaMin;
+    spec.tMax = thetaMax;
+    return spec;
+}
+
+QString ParametricCurveSpec::key() const
+{
+    const QString range = QString("[%1, %2]").arg(tMin, 0, 'g', 6).arg(tMax, 0, 'g', 6);
+    if (kind == Kind::Polar) {
+        return QString("r = %1, θ ∈ %2").arg(xExpression, range);
+    }
+    return QString("(%1, %2), t ∈ %3").arg(xExpression, yExpression, range);
+}
+
+ParametricComponents::ParametricComponents(const ParametricCurveSpec &spec)
+    : first(ParametricSampler::substituteParameter(spec.xExpression))
+    , polar(spec.kind == ParametricCurveSpec::Kind::Polar)
+{
+    if (!polar) {
+        second = Function(ParametricSampler::substituteParameter(spec.yExpression));
+    }
+}
+
+QString ParametricSampler::substituteParameter(const QString &expr)
+{
+    QString result;
+    result.reserve(expr.size());
+    int pos = 0;
+    while (pos < expr.size()) {
+        const QChar c = expr[pos];
+        if (c == QChar(0x03B8)) {
+            result += QLatin1Char('x');
+            ++pos;
+            continue;
+        }
+        if (!isIdentifierStart(c)) {
+            result += c;
+            ++pos;
+            continue;
+        }
+
+        const int start = pos;
+        while (pos < expr.size() && isIdentifierChar(expr[pos])) {
+            ++pos;
+        }
+        const QString identifier = expr.mid(start, pos - start);
+        // t2 -> x2: множитель после параметра разберёт ExpressionNormalizer
+        bool parameter = identifier[0] == QLatin1Char('t');
+        for (int i = 1; parameter && i < identifier.size(); ++i) {
+            parameter = identifier[i].isDigit();
+        }
+        if (parameter) {
+            result += QLatin1Char('x') + identifier.mid(1);
+        } else if (identifier == QLatin1String("theta")) {
+            result += QLatin1Char('x');
+        } else {
+            result += identifier;
+        }
+    }
+    return result;
+}
+
+void ParametricSampler::evaluate(const ParametricComponents &curve, const double *ts, double *xs, double *ys,
+                                 int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    // Из r(θ) в декартовы координаты; r лежит в xs
+    auto toCartesian = [ts, xs, ys](int begin, int n) {
+        for (int i = begin; i < begin + n; ++i) {
+            const double r = xs[i];
+            xs[i] = r * std::cos(ts[i]);
+            ys[i] = r * std::sin(ts[i]);
+        }
+    };
+
+    const bool native = Function::nativeEvaluatorEnabled && curve.first.compiled &&
+                        (curve.polar || curve.second.compiled);
+    if (!native) {
+        // У muParser своё состояние на слот пула, поэтому компоненты идут по очереди
+        curve.first.evaluateParallel(ts, xs, count);
+        if (curve.polar) {
+            toCartesian(0, count);
+        } else {
+            curve.second.evaluateParallel(ts, ys, count);
+        }
+        return;
+    }
+
+    // Блок t — одна задача: обе компоненты считаются по одним и тем же t подряд
+    const int chunks = (count + Function::ParallelChunkSize - 1) / Function::ParallelChunkSize;
+    WorkStealingPool::instance().run(chunks, [&](int chunk, int) {
+        const int begin = chunk * Function::ParallelChunkSize;
+        const int n = std::min(Function::ParallelChunkSize, count - begin);
+        TraceScope trace("evaluateParametricChunk", "evaluation", n);
+        curve.first.compiled->evaluate(ts + begin, xs + begin, n);
+        if (curve.polar) {
+            toCartesian(begin, n);
+        } else {
+            curve.second.compiled->evaluate(ts + begin, ys + begin, n);
+        }
+    });
+}
+
+bool ParametricSampler::calculatePoints(const ParametricComponents &curve, const ParametricCurveSpec &spec,
+                                        double scaleX, double scaleY, SampleBuffer &points,
+                                        const CancelCheck &cancelled, int *evaluations,
+                                        ParametricScratch *scratch)
+{
+    TraceScope trace("calculateParametric", "sampling");
+    ParametricScratch local;
+    ParametricScratch &s = scratch ? *scratch : local;
+    points.clear();
+    int evaluated = 0;
+    if (evaluations) {
+        *evaluations = 0;
+    }
+    if (!(spec.tMax > spec.tMin) || !(scaleX > 0) || !(scaleY > 0)) {
+        return true;
+    }
+
+    const int segments = InitialSegments;
+    s.t.resize(segments + 1);
+    s.x.resize(segments + 1);
+    s.y.resize(segments + 1);
+    for (int i = 0; i <= segments; ++i) {
+        s.t[i] = spec.tMin + (spec.tMax - spec.tMin) * i / segments;
+    }
+    evaluate(curve, s.t.data(), s.x.data(), s.y.data(), segments + 1);
+    evaluated += segments + 1;
+    // Каждый отрезок начальной сетки проверяется хотя бы одной серединой
+    s.refine.assign(segments, 1);
+
+    // Нужно ли делить отрезок (a, b), если середина родителя отошла от хорды на deviation
+    auto needsRefine = [scaleX, scaleY](double ax, double ay, double bx, double by, double deviation) {
+        const bool aFinite = std::isfinite(ax) && std::isfinite(ay);
+        const bool bFinite = std::isfinite(bx) && std::isfinite(by);
+        if (aFinite != bFinite) {
+            // Граница области определения: уточняем, где кривая обрывается
+            return true;
+        }
+        if (!aFinite) {
+            return false;
+        }
+        return deviation > Tolerance ||
+               std::hypot((bx - ax) * scaleX, (by - ay) * scaleY) > MaxSegmentPixels;
+    };
+
+    for (int depth = 0; depth < MaxDepth; ++depth) {
+        if (cancelled && cancelled()) {
+            return false;
+        }
+
+        s.midT.clear();
+        for (size_t i = 0; i < s.refine.size(); ++i) {
+            if (s.refine[i]) {
+                s.midT.push_back(0.5 * (s.t[i] + s.t[i + 1]));
+            }
+        }
+        if (s.midT.empty() || s.t.size() + s.midT.size() > size_t(MaxPoints)) {
+            break;
+        }
+        const int midCount = static_cast<int>(s.midT.size());
+        s.midX.resize(midCount);
+        s.midY.resize(midCount);
+        evaluate(curve, s.midT.data(), s.midX.data(), s.midY.data(), midCount);
+        evaluated += midCount;
+
+        s.nextT.clear();
+        s.nextX.clear();
+        s.nextY.clear();
+        s.nextRefine.clear();
+        int mid = 0;
+        for (size_t i = 0; i < s.refine.size(); ++i) {
+            s.nextT.push_back(s.t[i]);
+            s.nextX.push_back(s.x[i]);
+            s.nextY.push_back(s.y[i]);
+            if (!s.refine[i]) {
+                s.nextRefine.push_back(0);
+                continue;
+            }
+            const double ax = s.x[i], ay = s.y[i];
+            const double bx = s.x[i + 1], by = s.y[i + 1];
+            const double mx = s.midX[mid], my = s.midY[mid];
+            const double deviation = distanceToChord(ax * scaleX, ay * scaleY, bx * scaleX, by * scaleY,
+                                                     mx * scaleX, my * scaleY);
+            const double parentDeviation = std::isfinite(deviation) ? deviation : 0.0;
+            s.nextT.push_back(s.midT[mid]);
+            s.nextX.push_back(mx);
+            s.nextY.push_back(my);
+            s.nextRefine.push_back(needsRefine(ax, ay, mx, my, parentDeviation));
+            s.nextRefine.push_back(needsRefine(mx, my, bx, by, parentDeviation));
+            ++mid;
+        }
+        s.nextT.push_back(s.t.back());
+        s.nextX.push_back(s.x.back());
+        s.nextY.push_back(s.y.back());
+        s.t.swap(s.nextT);
+        s.x.swap(s.nextX);
+        s.y.swap(s.nextY);
+        s.refine.swap(s.nextRefine);
+    }
+
+    points.xs.assign(s.x.begin(), s.x.end());
+    points.ys.assign(s.y.begin(), s.y.end());
+    if (evaluations) {
+        *evaluations = evaluated;
+    }
+    trace.setValue(points.size());
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef PARAMETRICCURVE_H
+#define PARAMETRICCURVE_H
+
+#include <QString>
+#include <QVector>
+#include <QtMath>
+#include <functional>
+#include <vector>
+#include "function.h"
+#include "samplebuffer.h"
+
+// Кривая, заданная не как y = f(x): параметрическая (x(t), y(t)) или полярная r(θ).
+// В выражениях параметр записывается как t (у полярной можно также theta или θ);
+// неявное умножение работает так же, как для x: 2t, t2, 3(t+1).
+struct ParametricCurveSpec {
+    enum class Kind {
+        Parametric,
+        Polar
+    };
+
+    Kind kind = Kind::Parametric;
+    QString xExpression;    // x(t), у полярной кривой — r(θ)
+    QString yExpression;    // y(t); у полярной не используется
+    double tMin = 0.0;
+    double tMax = 2 * M_PI;
+
+    static ParametricCurveSpec parametric(const QString &x, const QString &y, double tMin, double tMax);
+    static ParametricCurveSpec polar(const QString &r, double thetaMin, double thetaMax);
+
+    // Подпись на графике; она же ключ точек кривой в EvaluationResult
+    QString key() const;
+
+    bool operator==(const ParametricCurveSpec &other) const {
+        return kind == other.kind && xExpression == other.xExpression &&
+               yExpression == other.yExpression && tMin == other.tMin && tMax == other.tMax;
+    }
+    bool operator!=(const ParametricCurveSpec &other) const {
+        return !(*this == other);
+    }
+};
+
+// Выражения компонент, переведённые в Function. Function знает только переменную x,
+// поэтому параметр в тексте выражения переименовывается в x
+struct ParametricComponents {
+    Function first;     // x(t) или r(θ)
+    Function second;    // y(t); у полярной кривой пуст
+    bool polar = false;
+
+    explicit ParametricComponents(const ParametricCurveSpec &spec = ParametricCurveSpec());
+};
+
+// Рабочие массивы ParametricSampler, переиспользуемые между вызовами
+class ParametricScratch
+{
+private:
+    friend class ParametricSampler;
+
+    std::vector<double> t, x, y;
+    std::vector<char> refine;
+    std::vector<double> midT, midX, midY;
+    std::vector<double> nextT, nextX, nextY;
+    std::vector<char> nextRefine;
+};
+
+// Адаптивная выборка кривой по параметру. Начальная сетка — InitialSegments
+// равных шагов по t; отрезок делится пополам, если его середина отходит от хорды
+// больше чем на Tolerance пикселя или если сама хорда длиннее MaxSegmentPixels.
+// Второе условие учитывает длину дуги: число точек растёт с длиной кривой
+// на экране, и быстро осциллирующая кривая (Лиссажу, роза) не теряет витков
+// между редкими узлами сетки.
+// Точки считаются в координатах графика и зависят только от масштаба области
+// просмотра, но не от её положения: при сдвиге графика их можно не пересчитывать.
+// Обе компоненты вычисляются одним заданием пула потоков, по блокам t.
+class ParametricSampler
+{
+public:
+    using CancelCheck = std::function<bool()>;
+
+    static constexpr int InitialSegments = 1024;
+    static constexpr double Tolerance = 0.25;
+    static constexpr double MaxSegmentPixels = 8.0;
+    static constexpr int MaxDepth = 12;
+    // Предел числа точек одной кривой
+    static constexpr int MaxPoints = 1 << 21;
+
+    // Точки упорядочены по t (по x они не упорядочены). scaleX и scaleY — пикселей
+    // на единицу графика. При отмене возвращает false, points пуст
+    static bool calculatePoints(const ParametricComponents &curve, const ParametricCurveSpec &spec,
+                                double scaleX, double scaleY, SampleBuffer &points,
+                                const CancelCheck &cancelled = CancelCheck(),
+                                int *evaluations = nullptr, ParametricScratch *scratch = nullptr);
+
+    // xs[i], ys[i] — точка кривой при параметре ts[i]
+    static void evaluate(const ParametricComponents &curve, const double *ts, double *xs, double *ys, int count);
+
+    // Переименовывает параметр (t, theta, θ) в x, не трогая имена функций (sqrt, atan)
+    static QString substituteParameter(const QString &expr);
+};
+
+#endif // PARAMETRICCURVE_H
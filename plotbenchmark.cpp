@@ -0,0 +1,436 @@
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include "function.h"
+#include "functionsampler.h"
+#include "curvedecimator.h"
+#include "slotmap.h"
+#include "dataseries.h"
+#include "legacynormalizer.h"
+#include "streamingseries.h"
+
+// Замер стоимости вычисления одной точки графика:
+// поточечный вызов (как раньше в calculatePoints) против пакетного evaluateBatch,
+// а также собственный вычислитель (CompiledExpression) на каждой из реализаций
+// с максимальным относительным отклонением от muParser.
+// Отдельная таблица — масштабирование evaluateParallel по ядрам на «тяжёлых» выражениях.
+// Затем — число вычислений адаптивной выборки против прежней сетки width*8
+// (и сколько точек остаётся после M4-прореживания)
+// и число вычислений при зуме туда и обратно с пирамидой точек и без неё,
+// число выделений памяти при сдвиге с переиспользуемыми буферами.
+// Затем — время и число выделений памяти на создание, копирование
+// и перемещение Function.
+// Затем — однопроходный ExpressionNormalizer против прежней обработки
+// регулярными выражениями: время и совпадение результатов.
+// Затем — открытие и выборка точек ряда данных (DataSeries) разного размера.
+// В конце — пропускная способность кольцевого буфера StreamingSeries.
+
+// Счётчик выделений памяти во всей программе
+static std::atomic<long long> allocationCount{0};
+
+void *operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+// Выровненные выделения (буферы SampleBuffer)
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    ++allocationCount;
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    if (void *memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+static void silentMessageHandler(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+template <typename Body>
+static double measureNsPerSample(int samples, int repeats, Body body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        body();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return ns / (double(samples) * repeats);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // Отладочный вывод парсера искажает замеры
+    qInstallMessageHandler(silentMessageHandler);
+
+    const QStringList expressions = {
+        "x",
+        "2x^2 + 3x - 1",
+        "sin(x)*cos(2x)",
+        "exp(-x^2)*log(abs(x)+1)",
+        "sqrt(abs(x))/(1+x^2) + tan(x/3)"
+    };
+
+    // Ширина 4K-экрана, 8 точек на пиксель — как в calculatePoints
+    const int samples = 3840 * 8;
+    const int repeats = 20;
+
+    QVector<double> xs(samples);
+    QVector<double> ys(samples);
+    for (int i = 0; i < samples; ++i) {
+        xs[i] = -10.0 + 20.0 * i / samples;
+    }
+
+    QTextStream out(stdout);
+    out << "expression;per_sample_ns;batch_ns;speedup;native_scalar_ns;native_sse2_ns;native_avx2_ns;max_rel_diff\n";
+
+    const CompiledExpression::Backend backends[] = {
+        CompiledExpression::Backend::Scalar,
+        CompiledExpression::Backend::Sse2,
+        CompiledExpression::Backend::Avx2
+    };
+
+    for (const QString &expr : expressions) {
+        Function func(expr);
+
+        // Эталон и поточечный/пакетный режимы — через muParser
+        Function::nativeEvaluatorEnabled = false;
+        QVector<double> reference(samples);
+        func.evaluateBatch(xs.constData(), reference.data(), samples);
+
+        double perSample = measureNsPerSample(samples, repeats, [&]() {
+            for (int i = 0; i < samples; ++i) {
+                func.evaluateBatch(&xs[i], &ys[i], 1);
+            }
+        });
+
+        double batch = measureNsPerSample(samples, repeats, [&]() {
+            func.evaluateBatch(xs.constData(), ys.data(), samples);
+        });
+        Function::nativeEvaluatorEnabled = true;
+
+        out << expr << ';'
+            << QString::number(perSample, 'f', 2) << ';'
+            << QString::number(batch, 'f', 2) << ';'
+            << QString::number(perSample / batch, 'f', 2);
+
+        if (!func.compiled) {
+            out << ";;;;\n";
+            continue;
+        }
+
+        const double *variables[] = { xs.constData() };
+        double maxDiff = 0.0;
+        for (CompiledExpression::Backend backend : backends) {
+            // Без AVX2 в процессоре эта реализация падает с SIGILL — столбец остаётся пустым
+            if (backend == CompiledExpression::Backend::Avx2 &&
+                CompiledExpression::detectedBackend() != CompiledExpression::Backend::Avx2) {
+                out << ';';
+                continue;
+            }
+            double native = measureNsPerSample(samples, repeats, [&]() {
+                func.compiled->evaluate(variables, ys.data(), samples, backend);
+            });
+            out << ';' << QString::number(native, 'f', 2);
+
+            for (int i = 0; i < samples; ++i) {
+                if (std::isnan(reference[i]) && std::isnan(ys[i])) continue;
+                double diff = std::abs(ys[i] - reference[i]) / (1.0 + std::abs(reference[i]));
+                if (!(diff <= maxDiff)) maxDiff = diff;
+            }
+        }
+        out << ';' << QString::number(maxDiff, 'g', 3) << '\n';
+    }
+
+    const QStringList heavyExpressions = {
+        "pow(exp(log(abs(x)+1)),1.5)*log(exp(x/10)+pow(abs(x),0.3))",
+        "exp(sin(pow(abs(x),0.7)))/log(2+pow(cos(x),2))"
+    };
+    const int threads = WorkStealingPool::instance().slotCount();
+
+    out << "\nexpression;backend;batch_ns;parallel_ns;threads;speedup\n";
+    for (const QString &expr : heavyExpressions) {
+        Function func(expr);
+        for (bool native : {false, true}) {
+            if (native && !func.compiled) continue;
+            Function::nativeEvaluatorEnabled = native;
+
+            double batch = measureNsPerSample(samples, repeats, [&]() {
+                func.evaluateBatch(xs.constData(), ys.data(), samples);
+            });
+            double parallel = measureNsPerSample(samples, repeats, [&]() {
+                func.evaluateParallel(xs.constData(), ys.data(), samples);
+            });
+
+            out << expr << ';' << (native ? "native" : "muparser") << ';'
+                << QString::number(batch, 'f', 2) << ';'
+                << QString::number(parallel, 'f', 2) << ';'
+                << threads << ';'
+                << QString::number(batch / parallel, 'f', 2) << '\n';
+        }
+    }
+    Function::nativeEvaluatorEnabled = true;
+
+    const QStringList samplingExpressions = {
+        "x",
+        "x^2",
+        "sin(x)",
+        "1/x",
+        "tan(x)",
+        "sin(1/x)"
+    };
+    ViewportSnapshot viewport;
+    viewport.size = QSize(3840, 2160);
+
+    out << "\nexpression;uniform_evaluations;adaptive_evaluations;points;reduction;decimated_points;decimate_ns\n";
+    for (const QString &expr : samplingExpressions) {
+        Function func(expr);
+        int evaluations = 0;
+        SampleBuffer points = FunctionSampler::calculatePoints(func, viewport, FunctionSampler::CancelCheck(), &evaluations);
+        const int uniform = viewport.size.width() * 8 + 1;
+        SampleBuffer decimated;
+        double decimate = measureNsPerSample(points.size(), repeats, [&]() {
+            decimated = CurveDecimator::decimate(points, viewport);
+        });
+        out << expr << ';' << uniform << ';' << evaluations << ';' << points.size() << ';'
+            << QString::number(double(uniform) / evaluations, 'f', 2) << ';'
+            << decimated.size() << ';' << QString::number(decimate, 'f', 2) << '\n';
+    }
+
+    // Десять шагов колеса вперёд и обратно вокруг центра
+    out << "\nexpression;zoom_steps;evaluations_uncached;evaluations_cached;tiles;cache_bytes\n";
+    for (const QString &expr : samplingExpressions) {
+        Function func(expr);
+        SampleCache cache;
+        int uncached = 0;
+        int cached = 0;
+        int steps = 0;
+        for (int direction : {1, -1}) {
+            for (int i = 0; i < 10; ++i, ++steps) {
+                const double scale = std::pow(1.2, direction > 0 ? -(i + 1) : i - 9);
+                ViewportSnapshot step = viewport;
+                step.xMin *= scale;
+                step.xMax *= scale;
+                step.yMin *= scale;
+                step.yMax *= scale;
+                int evaluations = 0;
+                FunctionSampler::calculatePoints(func, step, FunctionSampler::CancelCheck(), &evaluations);
+                uncached += evaluations;
+                FunctionSampler::calculatePoints(func, step, FunctionSampler::CancelCheck(), &evaluations, &cache);
+                cached += evaluations;
+            }
+        }
+        out << expr << ';' << steps << ';' << uncached << ';' << cached << ';'
+            << cache.tileCount() << ';' << cache.memoryUsage() << '\n';
+    }
+
+    // Сдвиг на 60 кадров влево и обратно с буфером, кэшем и рабочими массивами,
+    // которые живут между кадрами. Первый проход заполняет кэш, повторный
+    // (установившийся режим) не должен выделять память вовсе
+    out << "\nexpression;frames;allocations_first_pass;allocations_steady\n";
+    for (const QString &expr : samplingExpressions) {
+        Function func(expr);
+        SampleCache cache;
+        SamplerScratch scratch;
+        SampleBuffer points;
+        const int frames = 60;
+        auto pass = [&]() {
+            const long long before = allocationCount.load();
+            for (int direction : {1, -1}) {
+                for (int i = 0; i < frames / 2; ++i) {
+                    const double shift = 0.05 * (direction > 0 ? i : frames / 2 - 1 - i);
+                    ViewportSnapshot step = viewport;
+                    step.xMin -= shift;
+                    step.xMax -= shift;
+                    FunctionSampler::calculatePoints(func, step, points, FunctionSampler::CancelCheck(),
+                                                     nullptr, &cache, &scratch);
+                }
+            }
+            return allocationCount.load() - before;
+        };
+        const long long first = pass();
+        const long long steady = pass();
+        out << expr << ';' << frames << ';' << first << ';' << steady << '\n';
+    }
+
+    // muParser-only: sinh собственный вычислитель не поддерживает
+    const QStringList lifecycleExpressions = {
+        "sin(x)*cos(2x)",
+        "sinh(x)+x^2"
+    };
+    const int lifecycleRepeats = 2000;
+
+    out << "\nexpression;operation;ns;allocations\n";
+    for (const QString &expr : lifecycleExpressions) {
+        const Function prototype(expr);
+        auto report = [&](const char *operation, auto body) {
+            const long long before = allocationCount.load();
+            double ns = measureNsPerSample(1, lifecycleRepeats, body);
+            const double allocations = double(allocationCount.load() - before) / lifecycleRepeats;
+            out << expr << ';' << operation << ';' << QString::number(ns, 'f', 0) << ';'
+                << QString::number(allocations, 'f', 1) << '\n';
+        };
+
+        report("construct", [&]() {
+            Function func(expr);
+        });
+        report("copy", [&]() {
+            Function copy(prototype);
+        });
+        Function assigned;
+        report("copy_assign", [&]() {
+            assigned = prototype;
+        });
+        Function source(prototype);
+        report("move", [&]() {
+            Function moved(std::move(source));
+            source = std::move(moved);
+        });
+        // То же, что делают PlotWidget::addFunction и removeFunction
+        SlotMap<Function> functions;
+        report("add_to_map", [&]() {
+            Function func(expr);
+            functions.remove(functions.insert(std::move(func)));
+        });
+    }
+    const CompiledExpressionCache::Stats cacheStats = CompiledExpressionCache::instance().stats();
+    out << "compiled_cache;hits=" << cacheStats.hits << ";misses=" << cacheStats.misses
+        << ";size=" << cacheStats.size << '\n';
+
+    // Последние четыре строки прежняя обработка портила (вложенные скобки, вызов
+    // функции в основании степени, x внутри имени max), их расхождение ожидаемо
+    const QStringList normalizeExpressions = {
+        "2x^2 + 3x - 1",
+        "sin(x)*cos(2x)",
+        "exp(-x^2)*log(abs(x)+1)",
+        "sqrt(abs(x))/(1+x^2) + tan(x/3)",
+        "(x+1)(x-1)x",
+        "X^3 - 2.5x + x.5",
+        "(x-1)^(x+1)",
+        "x^2^3",
+        "((x+1)*2)^2",
+        "sin(x)^2",
+        "abs(x)^0.5",
+        "max(x,1)"
+    };
+    const int normalizeRepeats = 2000;
+
+    out << "\nexpression;legacy_ns;normalizer_ns;speedup;same;legacy;normalizer\n";
+    for (const QString &expr : normalizeExpressions) {
+        QString legacy;
+        QString normalized;
+        double legacyNs = measureNsPerSample(1, normalizeRepeats, [&]() {
+            legacy = QString("(%1)+0*x").arg(legacyNormalizeExpression(expr));
+        });
+        double normalizerNs = measureNsPerSample(1, normalizeRepeats, [&]() {
+            normalized = Function::preprocessExpression(expr);
+        });
+        out << expr << ';' << QString::number(legacyNs, 'f', 0) << ';'
+            << QString::number(normalizerNs, 'f', 0) << ';'
+            << QString::number(legacyNs / normalizerNs, 'f', 1) << ';'
+            << (legacy == normalized ? "yes" : "no") << ';' << legacy << ';' << normalized << '\n';
+    }
+
+    // Ряд данных из файла, отображённого в память: построение пирамиды при открытии
+    // и выборка точек для всей области и для узкого окна. Точек на выходе — O(ширины)
+    // при любом размере ряда
+    out << "\nseries_points;open_ms;extract_full_ns;extract_zoom_ns;points_full;points_zoom\n";
+    for (qint64 count : {qint64(100000), qint64(1000000), qint64(4000000)}) {
+        std::vector<double> seriesX(count);
+        std::vector<double> seriesY(count);
+        for (qint64 i = 0; i < count; ++i) {
+            seriesX[i] = -10.0 + 20.0 * i / count;
+            seriesY[i] = std::sin(seriesX[i]) * 5 + std::sin(seriesX[i] * 997.0);
+        }
+        QTemporaryFile file;
+        file.open();
+        DataSeries::write(file.fileName(), seriesX.data(), seriesY.data(), count);
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const DataSeries> series = DataSeries::open(file.fileName());
+        const double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        ViewportSnapshot zoomed = viewport;
+        zoomed.xMin = 1.0;
+        zoomed.xMax = 1.5;
+        SampleBuffer full;
+        SampleBuffer zoom;
+        const double fullNs = measureNsPerSample(1, repeats, [&]() {
+            series->extract(viewport, full);
+        });
+        const double zoomNs = measureNsPerSample(1, repeats, [&]() {
+            series->extract(zoomed, zoom);
+        });
+        out << count << ';' << QString::number(openMs, 'f', 1) << ';' << QString::number(fullNs, 'f', 0) << ';'
+            << QString::number(zoomNs, 'f', 0) << ';' << full.size() << ';' << zoom.size() << '\n';
+    }
+
+    // Кольцевой буфер потокового ряда без ограничения скорости: источник пишет
+    // пачками, читатель забирает точки в цикле. Пропускная способность в миллионах
+    // точек в секунду и число отброшенных точек при переполнении
+    out << "\nring_capacity;batch;points;mpoints_per_s;dropped\n";
+    for (int capacity : {1 << 12, 1 << 16}) {
+        for (int batch : {1, 64}) {
+            StreamingSeries series("bench", capacity, 1 << 16);
+            const qint64 total = 1 << 24;
+            std::atomic<bool> done{false};
+            auto start = std::chrono::steady_clock::now();
+            std::thread producer([&]() {
+                std::vector<double> batchX(batch);
+                std::vector<double> batchY(batch);
+                for (qint64 sent = 0; sent < total; sent += batch) {
+                    for (int i = 0; i < batch; ++i) {
+                        batchX[i] = double(sent + i);
+                        batchY[i] = std::sin(double(sent + i));
+                    }
+                    series.append(batchX.data(), batchY.data(), batch);
+                }
+                done = true;
+            });
+            qint64 received = 0;
+            while (!done.load() || series.appendedCount() != quint64(received)) {
+                received += series.drain();
+            }
+            producer.join();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            out << capacity << ';' << batch << ';' << received << ';'
+                << QString::number(received / seconds / 1e6, 'f', 1) << ';' << series.droppedCount() << '\n';
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include "plotrenderer.h"
+#include "curvedecimator.h"
+#include <QLinearGradient>
+#include <QPainterPath>
+#include <QtMath>
+#include <cmath>
+#include <limits>
+#include "tracer.h"
+
+PlotRenderer::PlotRenderer(const ViewportSnapshot &viewport)
+    : view(viewport)
+{
+}
+
+void PlotRenderer::drawBackground(QPainter &painter)
+{
+    // Заполняем фон градиентом
+    QLinearGradient gradient(0, 0, 0, view.size.height());
+    gradient.setColorAt(0, QColor(240, 240, 245));
+    gradient.setColorAt(1, QColor(250, 250, 255));
+    painter.fillRect(QRect(QPoint(0, 0), view.size), gradient);
+}
+
+void PlotRenderer::drawGrid(QPainter &painter)
+{
+    // Основная сетка
+    painter.setPen(QPen(QColor(220, 220, 230), 1, Qt::SolidLine));
+
+    // Определяем шаг сетки в зависимости от масштаба
+    double xRange = view.xMax - view.xMin;
+    double yRange = view.yMax - view.yMin;
+    
+    double xStep = std::pow(10, std::floor(std::log10(xRange)) - 1);
+    double yStep = std::pow(10, std::floor(std::log10(yRange)) - 1);
+    
+    if (xRange / xStep < 5) xStep /= 2;
+    if (yRange / yStep < 5) yStep /= 2;
+    
+    // Вертикальные линии
+    for (double x = std::ceil(view.xMin / xStep) * xStep; x <= view.xMax; x += xStep) {
+        QPoint p1 = transformToScreen(x, view.yMin);
+        QPoint p2 = transformToScreen(x, view.yMax);
+        painter.drawLine(p1, p2);
+    }
+
+    // Горизонтальные линии
+    for (double y = std::ceil(view.yMin / yStep) * yStep; y <= view.yMax; y += yStep) {
+        QPoint p1 = transformToScreen(view.xMin, y);
+        QPoint p2 = transformToScreen(view.xMax, y);
+        painter.drawLine(p1, p2);
+    }
+
+    // Дополнительная сетка (более мелкая)
+    painter.setPen(QPen(QColor(235, 235, 240), 1, Qt::DotLine));
+    double smallStep = xStep / 5;
+    
+    // Вертикальные линии
+    for (double x = std::ceil(view.xMin / smallStep) * smallStep; x <= view.xMax; x += smallStep) {
+        if (std::fmod(x, xStep) != 0) { // Пропускаем линии основной сетки
+            QPoint p1 = transformToScreen(x, view.yMin);
+            QPoint p2 = transformToScreen(x, view.yMax);
+            painter.drawLine(p1, p2);
+        }
+    }
+
+    // Горизонтальные линии
+    smallStep = yStep / 5;
+    for (double y = std::ceil(view.yMin / smallStep) * smallStep; y <= view.yMax; y += smallStep) {
+        if (std::fmod(y, yStep) != 0) { // Пропускаем линии основной сетки
+            QPoint p1 = transformToScreen(view.xMin, y);
+            QPoint p2 = transformToScreen(view.xMax, y);
+            painter.drawLine(p1, p2);
+        }
+    }
+}
+
+void PlotRenderer::drawAxisLabels(QPainter &painter)
+{
+    painter.setPen(QColor(60, 60, 70));
+    QFont font = painter.font();
+    font.setPointSize(9);
+    painter.setFont(font);
+
+    // Определяем шаг меток в зависимости от масштаба
+    double xRange = view.xMax - view.xMin;
+    double yRange = view.yMax - view.yMin;
+    
+    double xStep = std::pow(10, std::floor(std::log10(xRange)) - 1);
+    double yStep = std::pow(10, std::floor(std::log10(yRange)) - 1);
+    
+    if (xRange / xStep < 5) xStep /= 2;
+    if (yRange / yStep < 5) yStep /= 2;
+
+    // Метки на оси X
+    for (double x = std::ceil(view.xMin / xStep) * xStep; x <= view.xMax; x += xStep) {
+        if (std::abs(x) < xStep/2) continue;
+        QPoint pos = transformToScreen(x, 0);
+        QString label = QString::number(x);
+        QRect textRect = painter.fontMetrics().boundingRect(label);
+        
+        // Рисуем маленькую черточку
+        painter.drawLine(pos.x(), pos.y() - 3, pos.x(), pos.y() + 3);
+        
+        // Рисуем текст с фоном
+        QRect bgRect = textRect.adjusted(-2, -2, 2, 2);
+        bgRect.moveCenter(QPoint(pos.x(), pos.y() + textRect.height() + 5));
+        
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QColor(255, 255, 255, 200));
+        painter.drawRect(bgRect);
+        
+        painter.setPen(QColor(60, 60, 70));
+        painter.drawText(bgRect, Qt::AlignCenter, label);
+    }
+
+    // Метки на оси Y
+    for (double y = std::ceil(view.yMin / yStep) * yStep; y <= view.yMax; y += yStep) {
+        if (std::abs(y) < yStep/2) continue;
+        QPoint pos = transformToScreen(0, y);
+        QString label = QString::number(y);
+        QRect textRect = painter.fontMetrics().boundingRect(label);
+        
+        // Рисуем маленькую черточку
+        painter.drawLine(pos.x() - 3, pos.y(), pos.x() + 3, pos.y());
+        
+        // Рисуем текст с фоном
+        QRect bgRect = textRect.adjusted(-4, -2, 4, 2);
+        bgRect.moveCenter(QPoint(pos.x() - textRect.width() - 10, pos.y()));
+        
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QColor(255, 255, 255, 200));
+        painter.drawRect(bgRect);
+        
+        painter.setPen(QColor(60, 60, 70));
+        painter.drawText(bgRect, Qt::AlignCenter, label);
+    }
+}
+
+void PlotRenderer::drawAxes(QPainter &painter)
+{
+    // Рисуем оси
+    QPen axisPen(QColor(60, 60, 70), 2);
+    painter.setPen(axisPen);
+
+    // Ось X
+    QPoint xAxis1 = transformToScreen(view.xMin, 0);
+    QPoint xAxis2 = transformToScreen(view.xMax, 0);
+    painter.drawLine(xAxis1, xAxis2);
+
+    // Ось Y
+    QPoint yAxis1 = transformToScreen(0, view.yMin);
+    QPoint yAxis2 = transformToScreen(0, view.yMax);
+    painter.drawLine(yAxis1, yAxis2);
+
+    // Стрелки на концах осей
+    int arrowSize = 12;
+    double arrowAngle = 25.0; // угол стрелки в градусах
+    
+    // Стрелка оси X
+    QPointF xArrowP1 = xAxis2;
+    QPointF xArrowP2 = xAxis2 - QPointF(arrowSize * std::cos(qDegreesToRadians(arrowAngle)),
+                                       arrowSize * std::sin(qDegreesToRadians(arrowAngle)));
+    QPointF xArrowP3 = xAxis2 - QPointF(arrowSize * std::cos(qDegreesToRadians(-arrowAngle)),
+                                       arrowSize * std::sin(qDegreesToRadians(-arrowAngle)));
+    
+    QPolygonF xArrow;
+    xArrow << xArrowP1 << xArrowP2 << xArrowP3;
+    
+    // Стрелка оси Y
+    QPointF yArrowP1 = yAxis2;
+    QPointF yArrowP2 = yAxis2 - QPointF(arrowSize * std::sin(qDegreesToRadians(arrowAngle)),
+                                       arrowSize * std::cos(qDegreesToRadians(arrowAngle)));
+    QPointF yArrowP3 = yAxis2 - QPointF(-arrowSize * std::sin(qDegreesToRadians(arrowAngle)),
+                                       arrowSize * std::cos(qDegreesToRadians(arrowAngle)));
+    
+    QPolygonF yArrow;
+    yArrow << yArrowP1 << yArrowP2 << yArrowP3;
+    
+    // Рисуем стрелки
+    painter.setBrush(QColor(60, 60, 70));
+    painter.drawPolygon(xArrow);
+    painter.drawPolygon(yArrow);
+}
+
+void PlotRenderer::drawFunction(QPainter &painter, const QString &expr, const Function &func,
+                                const SampleBuffer &points, FrameStats::FunctionStats *stats)
+{
+    drawCurve(painter, expr, func.color, func.width, points, stats);
+}
+
+void PlotRenderer::drawCurve(QPainter &painter, const QString &label, const QColor &color, qreal width,
+                             const SampleBuffer &points, FrameStats::FunctionStats *stats, bool sortedByX)
+{
+    TraceScope trace("drawCurve", "paint", points.size());
+    StageTimer stage;
+    qint64 rasterNs = 0;
+    // drawPath растеризует путь сразу; его время считаем отдельно от построения
+    auto drawPath = [&painter, &stage, &rasterNs](const QPainterPath &path) {
+        const qint64 start = stage.total();
+        painter.drawPath(path);
+        rasterNs += stage.total() - start;
+    };
+
+    painter.setPen(QPen(color, width));
+    painter.setBrush(Qt::NoBrush);
+
+    if (points.isEmpty()) return;
+
+    QPainterPath path;
+    bool pathStarted = false;
+    QPoint prevPoint;
+    double prevX = 0, prevY = 0;
+    bool prevPointVisible = false;
+
+    // По x точки могут немного выходить за край области: сетка выборки привязана
+    // к узлам, кратным шагу, а не к xMin. Лишнее обрежется при отрисовке.
+    // Неупорядоченная по x кривая может уходить за край области и по x
+    auto isPointVisible = [this, sortedByX](double x, double y) {
+        // Пропускаем точку (0,0) и близкие к ней точки
+        if (std::abs(x) < 1e-10 && std::abs(y) < 1e-10) {
+            return false;
+        }
+        if (!sortedByX && !(x >= view.xMin && x <= view.xMax)) {
+            return false;
+        }
+        return std::isfinite(y) && y >= view.yMin && y <= view.yMax;
+    };
+
+    // Из точек одного столбца пикселей в путь идут не больше четырёх. Прореживание
+    // по столбцам годится только для упорядоченных по x точек; у параметрических
+    // кривых ниже отбрасываются лишь подряд идущие точки одного пикселя
+    const SampleBuffer *source = &points;
+    if (sortedByX) {
+        CurveDecimator::decimate(points, view, isPointVisible, decimatedPoints);
+        source = &decimatedPoints;
+    }
+
+    // Экранные координаты — одним проходом по массивам x и y, по той же формуле,
+    // что и в transformToScreen
+    const int count = source->size();
+    screenPoints.xs.resize(count);
+    screenPoints.ys.resize(count);
+    const double *xs = source->xs.data();
+    const double *ys = source->ys.data();
+    ScreenCoord *screenXs = screenPoints.xs.data();
+    ScreenCoord *screenYs = screenPoints.ys.data();
+    const double w = view.size.width();
+    const double h = view.size.height();
+    for (int i = 0; i < count; ++i) {
+        screenXs[i] = static_cast<ScreenCoord>(w * (xs[i] - view.xMin) / (view.xMax - view.xMin));
+        screenYs[i] = static_cast<ScreenCoord>(h * (1 - (ys[i] - view.yMin) / (view.yMax - view.yMin)));
+    }
+
+    for (int i = 0; i < count; ++i) {
+        double x = xs[i];
+        double y = ys[i];
+        bool currentPointVisible = isPointVisible(x, y);
+        QPoint currentPoint(static_cast<int>(screenXs[i]), static_cast<int>(screenYs[i]));
+        if (!sortedByX && pathStarted && currentPointVisible && prevPointVisible && currentPoint == prevPoint) {
+            continue;
+        }
+
+        if (!pathStarted && currentPointVisible) {
+            // Начинаем новый путь
+            path.moveTo(currentPoint);
+            pathStarted = true;
+        } else if (pathStarted) {
+            if (!currentPointVisible && !prevPointVisible) {
+                // Обе точки невидимы, прерываем путь
+                drawPath(path);
+                path = QPainterPath();
+                pathStarted = false;
+            } else {
+                // Проверяем расстояние на экране
+                int screenDX = currentPoint.x() - prevPoint.x();
+                int screenDY = currentPoint.y() - prevPoint.y();
+                double screenDistance = std::sqrt(screenDX * screenDX + screenDY * screenDY);
+
+                if (screenDistance > view.size.height()) {
+                    // Слишком большой разрыв, начинаем новый путь
+                    drawPath(path);
+                    path = QPainterPath();
+                    if (currentPointVisible) {
+                        path.moveTo(currentPoint);
+                    } else {
+                        pathStarted = false;
+                    }
+                } else {
+                    // Добавляем линию к текущей точке
+                    path.lineTo(currentPoint);
+                }
+            }
+        }
+
+        prevPoint = currentPoint;
+        prevX = x;
+        prevY = y;
+        prevPointVisible = currentPointVisible;
+    }
+
+    if (pathStarted) {
+        drawPath(path);
+    }
+    if (stats) {
+        stats->rasterNs = rasterNs;
+        stats->pathNs = stage.total() - rasterNs;
+    }
+    drawLabel(painter, label);
+}
+
+void PlotRenderer::drawSegments(QPainter &painter, const QString &label, const QColor &color, qreal width,
+                                const SampleBuffer &segments, FrameStats::FunctionStats *stats)
+{
+    TraceScope trace("drawSegments", "paint", segments.size() / 2);
+    StageTimer stage;
+    painter.setPen(QPen(color, width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+    painter.setBrush(Qt::NoBrush);
+
+    // Отрезки короче пикселя, поэтому координаты не округляются до целых.
+    // Соседние по порядку отрезки, сходящиеся в одной точке, продолжают один подпуть
+    const double w = view.size.width();
+    const double h = view.size.height();
+    const double kx = w / (view.xMax - view.xMin);
+    const double ky = h / (view.yMax - view.yMin);
+    const QRectF visible(-width, -width, w + 2 * width, h + 2 * width);
+    QPainterPath path;
+    QPointF last(std::numeric_limits<double>::quiet_NaN(), 0.0);
+    for (int i = 0; i + 1 < segments.size(); i += 2) {
+        const QPointF from(kx * (segments.xs[i] - view.xMin), h - ky * (segments.ys[i] - view.yMin));
+        const QPointF to(kx * (segments.xs[i + 1] - view.xMin), h - ky * (segments.ys[i + 1] - view.yMin));
+        if (!visible.contains(from) && !visible.contains(to)) {
+            continue;
+        }
+        if (!(std::abs(from.x() - last.x()) <= 1e-3 && std::abs(from.y() - last.y()) <= 1e-3)) {
+            path.moveTo(from);
+        }
+        path.lineTo(to);
+        last = to;
+    }
+    const qint64 pathNs = stage.lap();
+    painter.drawPath(path);
+    if (stats) {
+        stats->pathNs = pathNs;
+        stats->rasterNs = stage.lap();
+    }
+    drawLabel(painter, label);
+}
+
+void PlotRenderer::drawHeatmap(QPainter &painter, const HeatmapImage &heatmap)
+{
+    if (heatmap.isNull()) {
+        return;
+    }
+    TraceScope trace("drawHeatmap", "paint");
+    const ViewportSnapshot &source = heatmap.viewport;
+    const double kx = view.size.width() / (view.xMax - view.xMin);
+    const double ky = view.size.height() / (view.yMax - view.yMin);
+    const QRectF target(QPointF((source.xMin - view.xMin) * kx, view.size.height() - (source.yMax - view.yMin) * ky),
+                        QPointF((source.xMax - view.xMin) * kx, view.size.height() - (source.yMin - view.yMin) * ky));
+    painter.save();
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(target, heatmap.image);
+    painter.restore();
+}
+
+void PlotRenderer::drawFeatures(QPainter &painter, const QVector<CurveFeature> &features)
+{
+    if (features.isEmpty()) {
+        return;
+    }
+    TraceScope trace("drawFeatures", "paint", features.size());
+    const double kx = view.size.width() / (view.xMax - view.xMin);
+    const double ky = view.size.height() / (view.yMax - view.yMin);
+    const QRectF bounds = QRectF(QPointF(0, 0), view.size).adjusted(-8, -8, 8, 8);
+    constexpr qreal size = 5.0;
+    painter.save();
+    painter.setPen(QPen(QColor(60, 60, 70), 1.5));
+    for (const CurveFeature &feature : features) {
+        const QPointF point((feature.x - view.xMin) * kx, view.size.height() - (feature.y - view.yMin) * ky);
+        if (!bounds.contains(point)) {
+            continue;
+        }
+        switch (feature.kind) {
+        case CurveFeature::Root:
+            painter.setBrush(QColor(255, 255, 255));
+            painter.drawEllipse(point, size - 1, size - 1);
+            break;
+        case CurveFeature::Minimum:
+        case CurveFeature::Maximum: {
+            // Вершина треугольника — в самой точке, основание — под минимумом или над
+            // максимумом, с той стороны, где нет кривой
+            const qreal direction = feature.kind == CurveFeature::Minimum ? 1.0 : -1.0;
+            const QPointF triangle[3] = {point, point + QPointF(-size, direction * 1.6 * size),
+                                         point + QPointF(size, direction * 1.6 * size)};
+            painter.setBrush(QColor(230, 126, 34));
+            painter.drawPolygon(triangle, 3);
+            break;
+        }
+        case CurveFeature::Intersection: {
+            const QPointF diamond[4] = {point + QPointF(0, -size), point + QPointF(size, 0),
+                                        point + QPointF(0, size), point + QPointF(-size, 0)};
+            painter.setBrush(QColor(142, 68, 173));
+            painter.drawPolygon(diamond, 4);
+            break;
+        }
+        }
+    }
+    painter.restore();
+}
+
+void PlotRenderer::drawLabel(QPainter &painter, const QString &label)
+{
+    // Рисуем подпись кривой в правом верхнем углу
+    QFont font = painter.font();
+    font.setPointSize(10);
+    painter.setFont(font);
+    
+    QFontMetrics fm(font);
+    QRect textRect = fm.boundingRect(label);
+    textRect.adjust(-5, -5, 5, 5);
+    
+    // Рисуем фон для текста
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(255, 255, 255, 230));
+    painter.drawRect(textRect);
+    
+    // Рисуем текст черным цветом
+    painter.setPen(Qt::black);
+    painter.drawText(textRect, Qt::AlignCenter, label);
+}
+
+QPoint PlotRenderer::transformToScreen(double x, double y) const
+{
+    int screenX = view.size.width() * (x - view.xMin) / (view.xMax - view.xMin);
+    int screenY = view.size.height() * (1 - (y - view.yMin) / (view.yMax - view.yMin));
+    return QPoint(screenX, screenY);
+}
@@ -0,0 +1,113 @@
+#ifndef PLOTRENDERER_H
+#define PLOTRENDERER_H
+
+#include <QPainter>
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+#include "function.h"
+#include "functionsampler.h"
+#include "evaluationservice.h"
+#include "samplebuffer.h"
+
+// Отсечки времени этапов кадра
+class StageTimer
+{
+public:
+    StageTimer() { timer.start(); }
+
+    // Время с прошлой отсечки (или с создания)
+    qint64 lap()
+    {
+        const qint64 now = timer.nsecsElapsed();
+        const qint64 elapsed = now - last;
+        last = now;
+        return elapsed;
+    }
+
+    qint64 total() const { return timer.nsecsElapsed(); }
+
+private:
+    QElapsedTimer timer;
+    qint64 last = 0;
+};
+
+// Замеры одного кадра paintEvent, в наносекундах. Этап, чей слой взят из кэша,
+// в кадре не выполнялся, и его время равно нулю
+struct FrameStats {
+    struct FunctionStats {
+        QString expression;
+        qint64 pathNs = 0;          // прореживание точек и построение QPainterPath
+        qint64 rasterNs = 0;        // растеризация пути (drawPath)
+        SamplingStats sampling;     // последнее вычисление точек в EvaluationService
+    };
+
+    quint64 frame = 0;
+    qint64 totalNs = 0;
+    qint64 backgroundNs = 0;        // заливка фона
+    qint64 gridNs = 0;
+    qint64 axesNs = 0;
+    qint64 axisLabelsNs = 0;
+    qint64 composeNs = 0;           // сведение слоёв в сцену
+    qint64 blitNs = 0;              // вывод сцены в виджет
+    qint64 overlayNs = 0;           // точка под курсором, координаты и сама панель
+    QVector<FunctionStats> functions;
+
+    // Итоги по всем функциям
+    int samplesEvaluated = 0;
+    int nanCount = 0;
+    int cacheHits = 0;
+    int cacheMisses = 0;
+
+    double cacheHitRate() const {
+        const int total = cacheHits + cacheMisses;
+        return total > 0 ? double(cacheHits) / total : 0.0;
+    }
+};
+
+// Отрисовка графика на любом QPainter: фон, сетка, оси с подписями и функции.
+// Не зависит от виджета — всё, что нужно, берётся из области просмотра, — поэтому
+// ей пользуются и PlotWidget, и пакетный рендер без окна. Объект не потокобезопасен
+// (у него свои рабочие буферы), но разные объекты можно использовать параллельно.
+class PlotRenderer
+{
+public:
+    explicit PlotRenderer(const ViewportSnapshot &viewport = ViewportSnapshot());
+
+    void setViewport(const ViewportSnapshot &viewport) { view = viewport; }
+    const ViewportSnapshot &viewport() const { return view; }
+
+    void drawBackground(QPainter &painter);
+    void drawGrid(QPainter &painter);
+    void drawAxes(QPainter &painter);
+    void drawAxisLabels(QPainter &painter);
+    void drawFunction(QPainter &painter, const QString &expr, const Function &func,
+                      const SampleBuffer &points, FrameStats::FunctionStats *stats = nullptr);
+    // Кривая по точкам: функция, ряд данных или, с sortedByX = false, параметрическая
+    // кривая, чьи точки упорядочены по параметру, а не по x
+    void drawCurve(QPainter &painter, const QString &label, const QColor &color, qreal width,
+                   const SampleBuffer &points, FrameStats::FunctionStats *stats = nullptr,
+                   bool sortedByX = true);
+    // Отрезки неявной кривой: точки 2k и 2k + 1 — концы k-го отрезка
+    void drawSegments(QPainter &painter, const QString &label, const QColor &color, qreal width,
+                      const SampleBuffer &segments, FrameStats::FunctionStats *stats = nullptr);
+    // Изображение поля, построенное для своей области просмотра: при сдвиге и зуме
+    // оно растягивается на место этой области, пока не придёт новое
+    void drawHeatmap(QPainter &painter, const HeatmapImage &heatmap);
+    // Маркеры особых точек: корни — кружки, экстремумы — треугольники вершиной
+    // к экстремуму, пересечения — ромбы
+    void drawFeatures(QPainter &painter, const QVector<CurveFeature> &features);
+    QPoint transformToScreen(double x, double y) const;
+
+private:
+    void drawLabel(QPainter &painter, const QString &label);
+
+    ViewportSnapshot view;
+
+    // Рабочие буферы drawCurve: прореженные точки и их экранные координаты.
+    // Живут между вызовами, чтобы отрисовка не выделяла память на каждом кадре
+    SampleBuffer decimatedPoints;
+    ScreenBuffer screenPoints;
+};
+
+#endif // PLOTRENDERER_H
@@ -3,59 +3,66 @@
 #include <QPainterPath>
 #include <QDebug>
 #include <cmath>
+#include <limits>
 #include <QRegularExpression>
 #include <QToolTip>
+#include <QElapsedTimer>
+#include "tracer.h"
 
-// Функция для вычисления котангенса
-static double cot(double x) {
-    double tanVal = tan(x);
-    if (tanVal == 0) {
-        return std::numeric_limits<double>::infinity();
-    }
-    return 1.0 / tanVal;
-}
+namespace {
 
-// Функция для вычисления степени с поддержкой отрицательных чисел
-static double power(double base, double exponent) {
-    if (base < 0) {
-        // Для отрицательного основания проверяем, является ли показатель целым числом
-        if (std::abs(exponent - std::round(exponent)) < 1e-10) {
-            return std::pow(base, exponent);
-        }
-        return std::numeric_limits<double>::quiet_NaN();
+QString formatMs(qint64 ns)
+{
+    // Этап не выполнялся: слой взят из кэша
+    if (ns == 0) {
+        return QStringLiteral("—");
     }
-    return std::pow(base, exponent);
+    return QString::number(ns / 1e6, 'f', 2);
 }
 
+} // namespace
+
 PlotWidget::PlotWidget(QWidget *parent)
     : QWidget(parent)
+    , evaluationService(new EvaluationService(this))
+    , streamTimer(new QTimer(this))
 {
     setMinimumSize(400, 300);
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
+
+    // Перерисовываемся, когда фоновый поток досчитал точки
+    connect(evaluationService, &EvaluationService::resultReady, this, [this]() {
+        update();
+    });
+
+    // Около 30 кадров в секунду: чаще точки всё равно не разглядеть
+    streamTimer->setInterval(33);
+    connect(streamTimer, &QTimer::timeout, this, &PlotWidget::drainStreams);
 }
 
 PlotWidget::~PlotWidget()
 {
 }
 
-void PlotWidget::addFunction(const QString &func, const QColor &color)
+FunctionHandle PlotWidget::addFunction(const QString &func, const QColor &color)
 {
-    Function newFunc(func, color);
     try {
-        // Используем preprocessExpression для полной обработки выражения
-        QString processedExpr = newFunc.preprocessExpression(func);
-        qDebug() << "Преобразованное выражение:" << processedExpr;
-        
-        // Пробное вычисление для проверки корректности
-        newFunc.xValue = 0.0;
-        newFunc.parser->SetExpr(processedExpr.toStdString());
-        double testResult = newFunc.parser->Eval();
-        qDebug() << "Тестовое вычисление при x=0:" << testResult;
-        
-        functions[func] = newFunc;
-        update();
+        // Выражение разбирается и компилируется один раз, в конструкторе
+        Function newFunc(func, color);
+        qDebug() << "Преобразованное выражение:" << QString::fromStdString(newFunc.processedExpression);
+
+        // Пробное вычисление для проверки корректности. Если выражение собрал
+        // собственный вычислитель, muParser его тоже разберёт — проверка не нужна
+        if (!newFunc.compiled) {
+            mu::Parser &parser = newFunc.muParser();
+            newFunc.xValues[0] = 0.0;
+            double testResult = parser.Eval();
+            qDebug() << "Тестовое вычисление при x=0:" << testResult;
+        }
+
+        return addFunction(std::move(newFunc));
     }
     catch (const mu::Parser::exception_type &e) {
         qDebug() << "Ошибка разбора функции:" << QString::fromStdString(e.GetMsg());
@@ -69,24 +76,285 @@ void PlotWidget::addFunction(const QString &func, const QColor &color)
     catch (...) {
         qDebug() << "Неизвестная ошибка при добавлении функции";
     }
+    return FunctionHandle();
+}
+
+FunctionHandle PlotWidget::addFunction(Function &&func)
+{
+    FunctionHandle handle = functions.insert(PlotCurve{std::move(func), FunctionLayer()});
+    update();
+    return handle;
+}
+
+bool PlotWidget::setFunctionExpression(FunctionHandle handle, Function &&func)
+{
+    PlotCurve *curve = functions.get(handle);
+    if (!curve) {
+        return false;
+    }
+    func.color = curve->function.color;
+    func.width = curve->function.width;
+    curve->function = std::move(func);
+    // Точки нового выражения придут от EvaluationService, до тех пор слой пуст
+    curve->layer.points.reset();
+    curve->layer.dirty = true;
+    // Маркеры прежнего выражения убираются сразу, не дожидаясь анализа
+    featureLayer.dirty = true;
+    update();
+    return true;
+}
+
+bool PlotWidget::setFunctionColor(FunctionHandle handle, const QColor &color)
+{
+    PlotCurve *curve = functions.get(handle);
+    if (!curve) {
+        return false;
+    }
+    if (curve->function.color != color) {
+        curve->function.color = color;
+        curve->layer.dirty = true;
+        update();
+    }
+    return true;
+}
+
+bool PlotWidget::setFunctionWidth(FunctionHandle handle, qreal width)
+{
+    PlotCurve *curve = functions.get(handle);
+    if (!curve) {
+        return false;
+    }
+    if (curve->function.width != width) {
+        curve->function.width = width;
+        curve->layer.dirty = true;
+        update();
+    }
+    return true;
+}
+
+bool PlotWidget::removeFunction(FunctionHandle handle)
+{
+    if (!functions.remove(handle)) {
+        return false;
+    }
+    sceneLayer.dirty = true;
+    featureLayer.dirty = true;
+    update();
+    return true;
+}
+
+ParametricHandle PlotWidget::addParametricCurve(const ParametricCurveSpec &spec, const QColor &color,
+                                                qreal width)
+{
+    try {
+        // Пробное вычисление в начале диапазона, как в addFunction
+        ParametricComponents components(spec);
+        auto check = [&spec](const Function &component) {
+            if (!component.compiled) {
+                mu::Parser &parser = component.muParser();
+                component.xValues[0] = spec.tMin;
+                parser.Eval();
+            }
+        };
+        check(components.first);
+        if (!components.polar) {
+            check(components.second);
+        }
+    }
+    catch (const mu::Parser::exception_type &e) {
+        qDebug() << "Ошибка разбора кривой:" << QString::fromStdString(e.GetMsg());
+        return ParametricHandle();
+    }
+    catch (const std::exception &e) {
+        qDebug() << "Стандартная ошибка C++:" << e.what();
+        return ParametricHandle();
+    }
+
+    ParametricHandle handle = parametricCurves.insert(PlotParametric{spec, color, width, FunctionLayer()});
+    update();
+    return handle;
+}
+
+bool PlotWidget::removeParametricCurve(ParametricHandle handle)
+{
+    if (!parametricCurves.remove(handle)) {
+        return false;
+    }
+    sceneLayer.dirty = true;
+    update();
+    return true;
 }
 
-void PlotWidget::updateFunction(const QString &oldFunc, const QString &newFunc, const QColor &color)
+ImplicitHandle PlotWidget::addImplicitCurve(const QString &expression, const QColor &color, qreal width)
 {
-    if (functions.contains(oldFunc)) {
-        functions.remove(oldFunc);
+    try {
+        // Пробное вычисление в точке (0, 0), как в addFunction
+        ImplicitFunction function(expression);
+        if (!function.isCompiled()) {
+            function.muParser().Eval();
+        }
+    }
+    catch (const mu::Parser::exception_type &e) {
+        qDebug() << "Ошибка разбора неявной кривой:" << QString::fromStdString(e.GetMsg());
+        return ImplicitHandle();
     }
-    addFunction(newFunc, color);
+    catch (const std::exception &e) {
+        qDebug() << "Стандартная ошибка C++:" << e.what();
+        return ImplicitHandle();
+    }
+
+    ImplicitHandle handle = implicitCurves.insert(PlotImplicit{expression, color, width, FunctionLayer()});
+    update();
+    return handle;
 }
 
-void PlotWidget::removeFunction(const QString &func)
+bool PlotWidget::removeImplicitCurve(ImplicitHandle handle)
 {
-    functions.remove(func);
+    if (!implicitCurves.remove(handle)) {
+        return false;
+    }
+    sceneLayer.dirty = true;
     update();
+    return true;
+}
+
+bool PlotWidget::setHeatmap(const HeatmapSpec &spec)
+{
+    if (spec.isEmpty()) {
+        clearHeatmap();
+        return true;
+    }
+    try {
+        // Пробное вычисление в точке (0, 0), как в addFunction
+        ImplicitFunction function(spec.expression);
+        if (!function.isCompiled()) {
+            function.muParser().Eval();
+        }
+    }
+    catch (const mu::Parser::exception_type &e) {
+        qDebug() << "Ошибка разбора поля:" << QString::fromStdString(e.GetMsg());
+        return false;
+    }
+    catch (const std::exception &e) {
+        qDebug() << "Стандартная ошибка C++:" << e.what();
+        return false;
+    }
+
+    heatmapSpec = spec;
+    update();
+    return true;
+}
+
+void PlotWidget::clearHeatmap()
+{
+    heatmapSpec = HeatmapSpec();
+    update();
+}
+
+void PlotWidget::setCurveAnalysisEnabled(bool enabled)
+{
+    if (curveAnalysis != enabled) {
+        curveAnalysis = enabled;
+        featureLayer.dirty = true;
+        update();
+    }
+}
+
+DataSeriesHandle PlotWidget::addDataSeries(std::shared_ptr<const DataSeries> series, const QColor &color,
+                                           qreal width)
+{
+    if (!series) {
+        return DataSeriesHandle();
+    }
+    DataSeriesHandle handle = dataSeries.insert(PlotSeries{std::move(series), color, width, SeriesLayer()});
+    update();
+    return handle;
+}
+
+bool PlotWidget::removeDataSeries(DataSeriesHandle handle)
+{
+    if (!dataSeries.remove(handle)) {
+        return false;
+    }
+    sceneLayer.dirty = true;
+    update();
+    return true;
+}
+
+StreamHandle PlotWidget::addStreamingSeries(std::shared_ptr<StreamingSeries> series, const QColor &color,
+                                            qreal width)
+{
+    if (!series) {
+        return StreamHandle();
+    }
+    StreamHandle handle = streams.insert(PlotStream{std::move(series), color, width, SeriesLayer()});
+    streamTimer->start();
+    update();
+    return handle;
+}
+
+bool PlotWidget::removeStreamingSeries(StreamHandle handle)
+{
+    if (!streams.remove(handle)) {
+        return false;
+    }
+    if (streams.isEmpty()) {
+        streamTimer->stop();
+    }
+    sceneLayer.dirty = true;
+    update();
+    return true;
+}
+
+void PlotWidget::setStreamRefreshInterval(int msec)
+{
+    streamTimer->setInterval(std::max(1, msec));
+}
+
+void PlotWidget::setAutoScroll(bool enabled)
+{
+    autoScroll = enabled;
+    if (enabled) {
+        drainStreams();
+    }
+}
+
+void PlotWidget::drainStreams()
+{
+    TraceScope trace("drainStreams", "stream");
+    bool arrived = false;
+    double newestX = -std::numeric_limits<double>::infinity();
+    for (PlotStream &stream : streams) {
+        if (stream.data->drain() > 0) {
+            stream.layer.dirty = true;
+            arrived = true;
+        }
+        const double lastX = stream.data->lastX();
+        if (std::isfinite(lastX)) {
+            newestX = std::max(newestX, lastX);
+        }
+    }
+
+    // Ширина области сохраняется, сдвигается только она сама
+    if (autoScroll && std::isfinite(newestX) && newestX != xMax) {
+        const double range = xMax - xMin;
+        xMax = newestX;
+        xMin = newestX - range;
+        arrived = true;
+    }
+    if (arrived) {
+        update();
+    }
+}
+
+void PlotWidget::setSampleCacheMemoryBudget(qint64 bytes)
+{
+    evaluationService->setCacheMemoryBudget(bytes);
 }
 
 void PlotWidget::wheelEvent(QWheelEvent *event)
 {
+    TraceScope trace("wheel", "input");
     QPoint numDegrees = event->angleDelta() / 8;
     if (!numDegrees.isNull()) {
         double factor = std::pow(1.2, numDegrees.y() / 15.0);
@@ -116,283 +384,299 @@ void PlotWidget::zoom(double factor, QPoint center)
 
 void PlotWidget::paintEvent(QPaintEvent *)
 {
+    TraceScope trace("paintEvent", "paint");
+    // Массив функций переходит из кадра в кадр вместе с выделенной под него памятью
+    FrameStats &stats = frameStatsInProgress;
+    QVector<FrameStats::FunctionStats> functionStats;
+    functionStats.swap(stats.functions);
+    functionStats.clear();
+    stats = FrameStats();
+    stats.functions.swap(functionStats);
+    stats.frame = lastFrameStats.frame + 1;
+    StageTimer stage;
+
+    // Если область просмотра или набор функций изменились, заказываем новые точки.
+    // Пока они считаются, рисуем последние готовые — paintEvent никогда не ждёт вычислений
+    requestEvaluation();
+
+    // Перерисовываем только изменившиеся слои, остальные берём готовыми
+    updateLayers();
+
     QPainter painter(this);
+    stage.lap();
+    painter.drawImage(0, 0, sceneLayer.image);
+    stats.blitNs = stage.lap();
     painter.setRenderHint(QPainter::Antialiasing);
 
-    // Заполняем фон градиентом
-    QLinearGradient gradient(0, 0, 0, height());
-    gradient.setColorAt(0, QColor(240, 240, 245));
-    gradient.setColorAt(1, QColor(250, 250, 255));
-    painter.fillRect(rect(), gradient);
-
-    // Рисуем сетку и оси
-    drawGrid(painter);
-    drawAxes(painter);
-    drawAxisLabels(painter);
-
-    // Рисуем все функции
-    for (auto it = functions.begin(); it != functions.end(); ++it) {
-        drawFunction(painter, it.key(), it.value());
-    }
-
     // Рисуем координаты или точку на графике
     if (isMouseInWidget) {
         if (isAltPressed) {
             drawCoordinates(painter);
-        } else if (hasNearestPoint && !functions.isEmpty()) {
+        } else if (hasNearestPoint && hasHoverCurves()) {
             drawGraphPoint(painter);
         }
     }
-}
-
-void PlotWidget::drawGrid(QPainter &painter)
-{
-    // Основная сетка
-    painter.setPen(QPen(QColor(220, 220, 230), 1, Qt::SolidLine));
-
-    // Определяем шаг сетки в зависимости от масштаба
-    double xRange = xMax - xMin;
-    double yRange = yMax - yMin;
-    
-    double xStep = std::pow(10, std::floor(std::log10(xRange)) - 1);
-    double yStep = std::pow(10, std::floor(std::log10(yRange)) - 1);
-    
-    if (xRange / xStep < 5) xStep /= 2;
-    if (yRange / yStep < 5) yStep /= 2;
-    
-    // Вертикальные линии
-    for (double x = std::ceil(xMin / xStep) * xStep; x <= xMax; x += xStep) {
-        QPoint p1 = transformToScreen(x, yMin);
-        QPoint p2 = transformToScreen(x, yMax);
-        painter.drawLine(p1, p2);
+    // Панель показывает предыдущий кадр: текущий ещё не досчитан
+    if (statsOverlayVisible) {
+        drawStatsOverlay(painter);
     }
+    stats.overlayNs = stage.lap();
 
-    // Горизонтальные линии
-    for (double y = std::ceil(yMin / yStep) * yStep; y <= yMax; y += yStep) {
-        QPoint p1 = transformToScreen(xMin, y);
-        QPoint p2 = transformToScreen(xMax, y);
-        painter.drawLine(p1, p2);
-    }
-
-    // Дополнительная сетка (более мелкая)
-    painter.setPen(QPen(QColor(235, 235, 240), 1, Qt::DotLine));
-    double smallStep = xStep / 5;
-    
-    // Вертикальные линии
-    for (double x = std::ceil(xMin / smallStep) * smallStep; x <= xMax; x += smallStep) {
-        if (std::fmod(x, xStep) != 0) { // Пропускаем линии основной сетки
-            QPoint p1 = transformToScreen(x, yMin);
-            QPoint p2 = transformToScreen(x, yMax);
-            painter.drawLine(p1, p2);
-        }
-    }
-
-    // Горизонтальные линии
-    smallStep = yStep / 5;
-    for (double y = std::ceil(yMin / smallStep) * smallStep; y <= yMax; y += smallStep) {
-        if (std::fmod(y, yStep) != 0) { // Пропускаем линии основной сетки
-            QPoint p1 = transformToScreen(xMin, y);
-            QPoint p2 = transformToScreen(xMax, y);
-            painter.drawLine(p1, p2);
-        }
+    for (const FrameStats::FunctionStats &function : stats.functions) {
+        stats.samplesEvaluated += function.sampling.evaluations;
+        stats.nanCount += function.sampling.nanCount;
+        stats.cacheHits += function.sampling.cacheHits;
+        stats.cacheMisses += function.sampling.cacheMisses;
     }
+    stats.totalNs = stage.total();
+    std::swap(lastFrameStats, frameStatsInProgress);
 }
 
-void PlotWidget::drawAxisLabels(QPainter &painter)
+void PlotWidget::setStatsOverlayVisible(bool visible)
 {
-    painter.setPen(QColor(60, 60, 70));
-    QFont font = painter.font();
-    font.setPointSize(9);
-    painter.setFont(font);
-
-    // Определяем шаг меток в зависимости от масштаба
-    double xRange = xMax - xMin;
-    double yRange = yMax - yMin;
-    
-    double xStep = std::pow(10, std::floor(std::log10(xRange)) - 1);
-    double yStep = std::pow(10, std::floor(std::log10(yRange)) - 1);
-    
-    if (xRange / xStep < 5) xStep /= 2;
-    if (yRange / yStep < 5) yStep /= 2;
-
-    // Метки на оси X
-    for (double x = std::ceil(xMin / xStep) * xStep; x <= xMax; x += xStep) {
-        if (std::abs(x) < xStep/2) continue;
-        QPoint pos = transformToScreen(x, 0);
-        QString label = QString::number(x);
-        QRect textRect = painter.fontMetrics().boundingRect(label);
-        
-        // Рисуем маленькую черточку
-        painter.drawLine(pos.x(), pos.y() - 3, pos.x(), pos.y() + 3);
-        
-        // Рисуем текст с фоном
-        QRect bgRect = textRect.adjusted(-2, -2, 2, 2);
-        bgRect.moveCenter(QPoint(pos.x(), pos.y() + textRect.height() + 5));
-        
-        painter.setPen(Qt::NoPen);
-        painter.setBrush(QColor(255, 255, 255, 200));
-        painter.drawRect(bgRect);
-        
-        painter.setPen(QColor(60, 60, 70));
-        painter.drawText(bgRect, Qt::AlignCenter, label);
-    }
-
-    // Метки на оси Y
-    for (double y = std::ceil(yMin / yStep) * yStep; y <= yMax; y += yStep) {
-        if (std::abs(y) < yStep/2) continue;
-        QPoint pos = transformToScreen(0, y);
-        QString label = QString::number(y);
-        QRect textRect = painter.fontMetrics().boundingRect(label);
-        
-        // Рисуем маленькую черточку
-        painter.drawLine(pos.x() - 3, pos.y(), pos.x() + 3, pos.y());
-        
-        // Рисуем текст с фоном
-        QRect bgRect = textRect.adjusted(-4, -2, 4, 2);
-        bgRect.moveCenter(QPoint(pos.x() - textRect.width() - 10, pos.y()));
-        
-        painter.setPen(Qt::NoPen);
-        painter.setBrush(QColor(255, 255, 255, 200));
-        painter.drawRect(bgRect);
-        
-        painter.setPen(QColor(60, 60, 70));
-        painter.drawText(bgRect, Qt::AlignCenter, label);
+    if (statsOverlayVisible != visible) {
+        statsOverlayVisible = visible;
+        update();
     }
 }
 
-void PlotWidget::drawAxes(QPainter &painter)
+void PlotWidget::renderLayer(PlotLayer &layer, const std::function<void(QPainter &)> &draw)
 {
-    // Рисуем оси
-    QPen axisPen(QColor(60, 60, 70), 2);
-    painter.setPen(axisPen);
-
-    // Ось X
-    QPoint xAxis1 = transformToScreen(xMin, 0);
-    QPoint xAxis2 = transformToScreen(xMax, 0);
-    painter.drawLine(xAxis1, xAxis2);
-
-    // Ось Y
-    QPoint yAxis1 = transformToScreen(0, yMin);
-    QPoint yAxis2 = transformToScreen(0, yMax);
-    painter.drawLine(yAxis1, yAxis2);
+    const qreal ratio = devicePixelRatioF();
+    const QSize pixelSize = size() * ratio;
+    if (layer.image.size() != pixelSize || layer.image.devicePixelRatio() != ratio) {
+        layer.image = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+        layer.image.setDevicePixelRatio(ratio);
+    }
+    layer.image.fill(Qt::transparent);
 
-    // Стрелки на концах осей
-    int arrowSize = 12;
-    double arrowAngle = 25.0; // угол стрелки в градусах
-    
-    // Стрелка оси X
-    QPointF xArrowP1 = xAxis2;
-    QPointF xArrowP2 = xAxis2 - QPointF(arrowSize * std::cos(qDegreesToRadians(arrowAngle)),
-                                       arrowSize * std::sin(qDegreesToRadians(arrowAngle)));
-    QPointF xArrowP3 = xAxis2 - QPointF(arrowSize * std::cos(qDegreesToRadians(-arrowAngle)),
-                                       arrowSize * std::sin(qDegreesToRadians(-arrowAngle)));
-    
-    QPolygonF xArrow;
-    xArrow << xArrowP1 << xArrowP2 << xArrowP3;
-    
-    // Стрелка оси Y
-    QPointF yArrowP1 = yAxis2;
-    QPointF yArrowP2 = yAxis2 - QPointF(arrowSize * std::sin(qDegreesToRadians(arrowAngle)),
-                                       arrowSize * std::cos(qDegreesToRadians(arrowAngle)));
-    QPointF yArrowP3 = yAxis2 - QPointF(-arrowSize * std::sin(qDegreesToRadians(arrowAngle)),
-                                       arrowSize * std::cos(qDegreesToRadians(arrowAngle)));
-    
-    QPolygonF yArrow;
-    yArrow << yArrowP1 << yArrowP2 << yArrowP3;
-    
-    // Рисуем стрелки
-    painter.setBrush(QColor(60, 60, 70));
-    painter.drawPolygon(xArrow);
-    painter.drawPolygon(yArrow);
+    QPainter painter(&layer.image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    draw(painter);
+    layer.dirty = false;
 }
 
-void PlotWidget::drawFunction(QPainter &painter, const QString &expr, Function &func)
+void PlotWidget::updateLayers()
 {
-    painter.setPen(QPen(func.color, 2.5));
-    painter.setBrush(Qt::NoBrush);
-
-    QVector<QPair<double, double>> points = calculatePoints(func);
-    if (points.isEmpty()) return;
+    // При смене области просмотра, размера или плотности пикселей устаревает всё
+    const ViewportSnapshot viewport = viewportSnapshot();
+    if (viewport != layerViewport || devicePixelRatioF() != layerPixelRatio) {
+        layerViewport = viewport;
+        layerPixelRatio = devicePixelRatioF();
+        renderer.setViewport(viewport);
+        backgroundLayer.dirty = true;
+        axesLayer.dirty = true;
+        heatmapLayer.dirty = true;
+        featureLayer.dirty = true;
+        for (PlotCurve &curve : functions) {
+            curve.layer.dirty = true;
+        }
+        for (PlotSeries &series : dataSeries) {
+            series.layer.dirty = true;
+        }
+        for (PlotStream &stream : streams) {
+            stream.layer.dirty = true;
+        }
+        for (PlotParametric &curve : parametricCurves) {
+            curve.layer.dirty = true;
+        }
+        for (PlotImplicit &curve : implicitCurves) {
+            curve.layer.dirty = true;
+        }
+    }
 
-    QPainterPath path;
-    bool pathStarted = false;
-    QPoint prevPoint;
-    double prevX = 0, prevY = 0;
-    bool prevPointVisible = false;
+    // Слой функции устаревает, если пришли новые точки; смену стиля помечают
+    // setFunctionColor и setFunctionWidth
+    FrameStats &stats = frameStatsInProgress;
+    const EvaluationResult &result = evaluationService->latestResult();
+    for (PlotCurve &curve : functions) {
+        const CurvePoints points = result.curves.value(curve.function.expression);
+        if (curve.layer.points != points) {
+            curve.layer.points = points;
+            curve.layer.dirty = true;
+        }
+    }
+    for (PlotParametric &curve : parametricCurves) {
+        const CurvePoints points = result.curves.value(curve.spec.key());
+        if (curve.layer.points != points) {
+            curve.layer.points = points;
+            curve.layer.dirty = true;
+        }
+    }
+    for (PlotImplicit &curve : implicitCurves) {
+        const CurvePoints segments = result.curves.value(ImplicitFunction::key(curve.expression));
+        if (curve.layer.points != segments) {
+            curve.layer.points = segments;
+            curve.layer.dirty = true;
+        }
+    }
+    const CurveFeatures features = curveAnalysis ? result.features : CurveFeatures();
+    if (featureLayer.features != features) {
+        featureLayer.features = features;
+        featureLayer.dirty = true;
+    }
 
-    auto isPointVisible = [this](double x, double y) {
-        // Пропускаем точку (0,0) и близкие к ней точки
-        if (std::abs(x) < 1e-10 && std::abs(y) < 1e-10) {
-            return false;
+    if (backgroundLayer.dirty) {
+        renderLayer(backgroundLayer, [this, &stats](QPainter &painter) {
+            StageTimer stage;
+            renderer.drawBackground(painter);
+            stats.backgroundNs = stage.lap();
+            renderer.drawGrid(painter);
+            stats.gridNs = stage.lap();
+        });
+        sceneLayer.dirty = true;
+    }
+    // Поле приходит от EvaluationService сначала грубым, затем точным
+    const HeatmapImage field = heatmapSpec.isEmpty() ? HeatmapImage() : result.heatmap;
+    if (field.image.cacheKey() != heatmapLayer.field.image.cacheKey() || field.viewport != heatmapLayer.field.viewport) {
+        heatmapLayer.field = field;
+        heatmapLayer.dirty = true;
+    }
+    if (!heatmapSpec.isEmpty()) {
+        FrameStats::FunctionStats fieldStats;
+        fieldStats.expression = heatmapSpec.key();
+        fieldStats.sampling = result.stats.value(heatmapSpec.key());
+        stats.functions.append(fieldStats);
+    }
+    if (heatmapLayer.dirty) {
+        renderLayer(heatmapLayer, [this](QPainter &painter) {
+            renderer.drawHeatmap(painter, heatmapLayer.field);
+        });
+        sceneLayer.dirty = true;
+    }
+    if (axesLayer.dirty) {
+        renderLayer(axesLayer, [this, &stats](QPainter &painter) {
+            StageTimer stage;
+            renderer.drawAxes(painter);
+            stats.axesNs = stage.lap();
+            renderer.drawAxisLabels(painter);
+            stats.axisLabelsNs = stage.lap();
+        });
+        sceneLayer.dirty = true;
+    }
+    // Ряды данных считаются здесь же, в GUI-потоке: выборка из пирамиды дешевле,
+    // чем передача точек из фонового потока
+    for (PlotSeries &series : dataSeries) {
+        FrameStats::FunctionStats seriesStats;
+        seriesStats.expression = series.data->name();
+        if (series.layer.dirty) {
+            StageTimer stage;
+            series.data->extract(viewport, series.layer.points);
+            seriesStats.sampling.points = series.layer.points.size();
+            seriesStats.sampling.nanoseconds = stage.lap();
+            renderLayer(series.layer, [this, &series, &seriesStats](QPainter &painter) {
+                renderer.drawCurve(painter, series.data->name(), series.color, series.width,
+                                   series.layer.points, &seriesStats);
+            });
+            sceneLayer.dirty = true;
         }
-        return std::isfinite(y) && y >= yMin && y <= yMax && x >= xMin && x <= xMax;
-    };
-
-    for (int i = 0; i < points.size(); ++i) {
-        double x = points[i].first;
-        double y = points[i].second;
-        bool currentPointVisible = isPointVisible(x, y);
-        QPoint currentPoint = transformToScreen(x, y);
-
-        if (!pathStarted && currentPointVisible) {
-            // Начинаем новый путь
-            path.moveTo(currentPoint);
-            pathStarted = true;
-        } else if (pathStarted) {
-            if (!currentPointVisible && !prevPointVisible) {
-                // Обе точки невидимы, прерываем путь
-                painter.drawPath(path);
-                path = QPainterPath();
-                pathStarted = false;
-            } else {
-                // Проверяем расстояние на экране
-                int screenDX = currentPoint.x() - prevPoint.x();
-                int screenDY = currentPoint.y() - prevPoint.y();
-                double screenDistance = std::sqrt(screenDX * screenDX + screenDY * screenDY);
-
-                if (screenDistance > height()) {
-                    // Слишком большой разрыв, начинаем новый путь
-                    painter.drawPath(path);
-                    path = QPainterPath();
-                    if (currentPointVisible) {
-                        path.moveTo(currentPoint);
-                    } else {
-                        pathStarted = false;
-                    }
-                } else {
-                    // Добавляем линию к текущей точке
-                    path.lineTo(currentPoint);
-                }
-            }
+        stats.functions.append(seriesStats);
+    }
+    // Новые точки потоковых рядов помечает drainStreams
+    for (PlotStream &stream : streams) {
+        FrameStats::FunctionStats streamStats;
+        streamStats.expression = stream.data->name();
+        if (stream.layer.dirty) {
+            StageTimer stage;
+            stream.data->visiblePoints(viewport, stream.layer.points);
+            streamStats.sampling.points = stream.layer.points.size();
+            streamStats.sampling.nanoseconds = stage.lap();
+            renderLayer(stream.layer, [this, &stream, &streamStats](QPainter &painter) {
+                renderer.drawCurve(painter, stream.data->name(), stream.color, stream.width,
+                                   stream.layer.points, &streamStats);
+            });
+            sceneLayer.dirty = true;
         }
+        stats.functions.append(streamStats);
+    }
+    static const SampleBuffer noPoints;
+    for (PlotCurve &curve : functions) {
+        FrameStats::FunctionStats functionStats;
+        functionStats.expression = curve.function.expression;
+        functionStats.sampling = result.stats.value(curve.function.expression);
+        if (curve.layer.dirty) {
+            const Function &func = curve.function;
+            const SampleBuffer &points = curve.layer.points ? *curve.layer.points : noPoints;
+            renderLayer(curve.layer, [this, &func, &points, &functionStats](QPainter &painter) {
+                renderer.drawFunction(painter, func.expression, func, points, &functionStats);
+            });
+            sceneLayer.dirty = true;
+        }
+        stats.functions.append(functionStats);
+    }
 
-        prevPoint = currentPoint;
-        prevX = x;
-        prevY = y;
-        prevPointVisible = currentPointVisible;
+    for (PlotParametric &curve : parametricCurves) {
+        const QString key = curve.spec.key();
+        FrameStats::FunctionStats curveStats;
+        curveStats.expression = key;
+        curveStats.sampling = result.stats.value(key);
+        if (curve.layer.dirty) {
+            const SampleBuffer &points = curve.layer.points ? *curve.layer.points : noPoints;
+            renderLayer(curve.layer, [this, &curve, &key, &points, &curveStats](QPainter &painter) {
+                renderer.drawCurve(painter, key, curve.color, curve.width, points, &curveStats, false);
+            });
+            sceneLayer.dirty = true;
+        }
+        stats.functions.append(curveStats);
+    }
+    for (PlotImplicit &curve : implicitCurves) {
+        const QString key = ImplicitFunction::key(curve.expression);
+        FrameStats::FunctionStats curveStats;
+        curveStats.expression = key;
+        curveStats.sampling = result.stats.value(key);
+        if (curve.layer.dirty) {
+            const SampleBuffer &segments = curve.layer.points ? *curve.layer.points : noPoints;
+            renderLayer(curve.layer, [this, &curve, &key, &segments, &curveStats](QPainter &painter) {
+                renderer.drawSegments(painter, key, curve.color, curve.width, segments, &curveStats);
+            });
+            sceneLayer.dirty = true;
+        }
+        stats.functions.append(curveStats);
     }
 
-    if (pathStarted) {
-        painter.drawPath(path);
+    if (featureLayer.dirty) {
+        renderLayer(featureLayer, [this](QPainter &painter) {
+            if (!featureLayer.features) {
+                return;
+            }
+            // Пока особые точки ищутся, приходят прежние — точки удалённых функций не рисуем
+            QVector<CurveFeature> visible;
+            for (const CurveFeature &feature : *featureLayer.features) {
+                if (hasFunction(feature.expression) && (feature.other.isEmpty() || hasFunction(feature.other))) {
+                    visible.append(feature);
+                }
+            }
+            renderer.drawFeatures(painter, visible);
+        });
+        sceneLayer.dirty = true;
     }
 
-    // Рисуем текст функции в правом верхнем углу
-    QFont font = painter.font();
-    font.setPointSize(10);
-    painter.setFont(font);
-    
-    QFontMetrics fm(font);
-    QRect textRect = fm.boundingRect(expr);
-    textRect.adjust(-5, -5, 5, 5);
-    
-    // Рисуем фон для текста
-    painter.setPen(Qt::NoPen);
-    painter.setBrush(QColor(255, 255, 255, 230));
-    painter.drawRect(textRect);
-    
-    // Рисуем текст черным цветом
-    painter.setPen(Qt::black);
-    painter.drawText(textRect, Qt::AlignCenter, expr);
+    // Сводим слои в одно изображение, чтобы при движении мыши копировать одну картинку
+    if (sceneLayer.dirty) {
+        StageTimer stage;
+        renderLayer(sceneLayer, [this](QPainter &painter) {
+            painter.drawImage(0, 0, backgroundLayer.image);
+            painter.drawImage(0, 0, heatmapLayer.image);
+            painter.drawImage(0, 0, axesLayer.image);
+            for (const PlotSeries &series : dataSeries) {
+                painter.drawImage(0, 0, series.layer.image);
+            }
+            for (const PlotStream &stream : streams) {
+                painter.drawImage(0, 0, stream.layer.image);
+            }
+            for (const PlotCurve &curve : functions) {
+                painter.drawImage(0, 0, curve.layer.image);
+            }
+            for (const PlotParametric &curve : parametricCurves) {
+                painter.drawImage(0, 0, curve.layer.image);
+            }
+            for (const PlotImplicit &curve : implicitCurves) {
+                painter.drawImage(0, 0, curve.layer.image);
+            }
+            painter.drawImage(0, 0, featureLayer.image);
+        });
+        stats.composeNs = stage.lap();
+    }
 }
 
 QPoint PlotWidget::transformToScreen(double x, double y)
@@ -409,60 +693,62 @@ QPair<double, double> PlotWidget::transformToGraph(int screenX, int screenY)
     return {x, y};
 }
 
-QVector<QPair<double, double>> PlotWidget::calculatePoints(const Function &func)
+ViewportSnapshot PlotWidget::viewportSnapshot() const
 {
-    QVector<QPair<double, double>> points;
-    const int numPoints = width() * 8;
-    const double step = (xMax - xMin) / numPoints;
+    ViewportSnapshot viewport;
+    viewport.xMin = xMin;
+    viewport.xMax = xMax;
+    viewport.yMin = yMin;
+    viewport.yMax = yMax;
+    viewport.size = size();
+    return viewport;
+}
 
-    // Добавляем дополнительные точки около нуля для функций типа 1/x
-    if (xMin < 0 && xMax > 0) {
-        // Точки слева от нуля
-        for (int i = -10; i < 0; ++i) {
-            double x = step * i / 1000.0;
-            double y = evaluateFunction(x, func);
-            if (std::isfinite(y)) {
-                points.append({x, y});
-            }
-        }
-        
-        // Точки справа от нуля
-        for (int i = 1; i <= 10; ++i) {
-            double x = step * i / 1000.0;
-            double y = evaluateFunction(x, func);
-            if (std::isfinite(y)) {
-                points.append({x, y});
-            }
+void PlotWidget::requestEvaluation()
+{
+    ViewportSnapshot viewport = viewportSnapshot();
+    // Одинаковые выражения вычисляются один раз; стиль функций сюда не входит,
+    // поэтому смена цвета или толщины нового вычисления не заказывает
+    QStringList expressions;
+    for (const PlotCurve &curve : functions) {
+        expressions.append(curve.function.expression);
+    }
+    expressions.removeDuplicates();
+    QVector<ParametricCurveSpec> parametric;
+    for (const PlotParametric &curve : parametricCurves) {
+        if (!parametric.contains(curve.spec)) {
+            parametric.append(curve.spec);
         }
     }
-
-    // Основные точки графика
-    for (int i = 0; i <= numPoints; ++i) {
-        double x = xMin + i * step;
-        // Пропускаем точку x = 0 для функций типа 1/x
-        if (std::abs(x) < step/1000.0) continue;
-        
-        double y = evaluateFunction(x, func);
-        points.append({x, y});
+    QStringList implicit;
+    for (const PlotImplicit &curve : implicitCurves) {
+        implicit.append(curve.expression);
+    }
+    implicit.removeDuplicates();
+    if (viewport == requestedViewport && expressions == requestedExpressions &&
+        parametric == requestedParametric && implicit == requestedImplicit &&
+        heatmapSpec == requestedHeatmap && curveAnalysis == requestedAnalysis) {
+        return;
     }
+    requestedViewport = viewport;
+    requestedExpressions = expressions;
+    requestedParametric = parametric;
+    requestedImplicit = implicit;
+    requestedHeatmap = heatmapSpec;
+    requestedAnalysis = curveAnalysis;
+    evaluationService->request(viewport, expressions, parametric, implicit, heatmapSpec, curveAnalysis);
+}
 
-    return points;
+SampleBuffer PlotWidget::calculatePoints(const Function &func)
+{
+    return FunctionSampler::calculatePoints(func, viewportSnapshot());
 }
 
 double PlotWidget::evaluateFunction(double x, const Function &func) const
 {
-    try {
-        func.xValue = x;
-        return func.parser->Eval();
-    }
-    catch (const mu::Parser::exception_type &e) {
-        qDebug() << "Ошибка вычисления функции при x =" << x << ":" << QString::fromStdString(e.GetMsg());
-        return std::numeric_limits<double>::quiet_NaN();
-    }
-    catch (...) {
-        qDebug() << "Неизвестная ошибка при вычислении функции при x =" << x;
-        return std::numeric_limits<double>::quiet_NaN();
-    }
+    double y;
+    func.evaluateBatch(&x, &y, 1);
+    return y;
 }
 
 void PlotWidget::mousePressEvent(QMouseEvent *event)
@@ -484,6 +770,7 @@ void PlotWidget::mouseReleaseEvent(QMouseEvent *event)
 
 void PlotWidget::mouseMoveEvent(QMouseEvent *event)
 {
+    TraceScope trace(isPanning ? "pan" : "hover", "input");
     if (isPanning) {
         QPoint delta = event->pos() - lastMousePos;
         pan(delta);
@@ -494,7 +781,7 @@ void PlotWidget::mouseMoveEvent(QMouseEvent *event)
     isMouseInWidget = true;
 
     // Находим ближайшую точку на графике, если не зажат Alt
-    if (!isAltPressed && !functions.isEmpty()) {
+    if (!isAltPressed && hasHoverCurves()) {
         nearestPoint = findNearestPoint(currentMousePos);
         hasNearestPoint = true;
     }
@@ -508,6 +795,9 @@ void PlotWidget::pan(const QPoint &delta)
     double dx = -(xMax - xMin) * delta.x() / width();
     double dy = (yMax - yMin) * delta.y() / height();
 
+    // Пользователь смотрит на старые точки — не возвращаем его к новым
+    autoScroll = false;
+
     // Смещаем область просмотра
     xMin += dx;
     xMax += dx;
@@ -574,6 +864,8 @@ void PlotWidget::keyPressEvent(QKeyEvent *event)
     if (event->key() == Qt::Key_Alt) {
         isAltPressed = true;
         update();
+    } else if (event->key() == Qt::Key_F3) {
+        setStatsOverlayVisible(!statsOverlayVisible);
     }
     QWidget::keyPressEvent(event);
 }
@@ -587,23 +879,42 @@ void PlotWidget::keyReleaseEvent(QKeyEvent *event)
     QWidget::keyReleaseEvent(event);
 }
 
+bool PlotWidget::hasFunction(const QString &expression) const
+{
+    for (const PlotCurve &curve : functions) {
+        if (curve.function.expression == expression) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PlotWidget::hasHoverCurves() const
+{
+    return !functions.isEmpty() || !parametricCurves.isEmpty() || !implicitCurves.isEmpty();
+}
+
 QPair<double, double> PlotWidget::findNearestPoint(const QPoint &mousePos)
 {
-    if (functions.isEmpty()) {
+    if (!hasHoverCurves()) {
         return {0, 0};
     }
 
     // Получаем x-координату мыши в системе графика
     QPair<double, double> mouseCoords = transformToGraph(mousePos.x(), mousePos.y());
     double mouseX = mouseCoords.first;
+    // Расстояния сравниваются в пикселях: у функций — по вертикали,
+    // у параметрических и неявных кривых — до ближайшей точки кривой
+    const double scaleX = width() / (xMax - xMin);
+    const double scaleY = height() / (yMax - yMin);
     double bestDistance = std::numeric_limits<double>::infinity();
     QPair<double, double> bestPoint;
 
     // Проверяем каждую функцию
-    for (auto it = functions.begin(); it != functions.end(); ++it) {
-        double y = evaluateFunction(mouseX, it.value());
+    for (const PlotCurve &curve : functions) {
+        double y = evaluateFunction(mouseX, curve.function);
         if (std::isfinite(y)) {
-            double distance = std::abs(y - mouseCoords.second);
+            double distance = std::abs(y - mouseCoords.second) * scaleY;
             if (distance < bestDistance) {
                 bestDistance = distance;
                 bestPoint = {mouseX, y};
@@ -611,12 +922,49 @@ QPair<double, double> PlotWidget::findNearestPoint(const QPoint &mousePos)
         }
     }
 
+    // У неявных кривых в слое концы отрезков — те же точки кривой
+    QVector<const SampleBuffer *> curvePoints;
+    for (const PlotParametric &curve : parametricCurves) {
+        if (curve.layer.points) {
+            curvePoints.append(curve.layer.points.get());
+        }
+    }
+    for (const PlotImplicit &curve : implicitCurves) {
+        if (curve.layer.points) {
+            curvePoints.append(curve.layer.points.get());
+        }
+    }
+    for (const SampleBuffer *buffer : curvePoints) {
+        const SampleBuffer &points = *buffer;
+        for (int i = 0; i < points.size(); ++i) {
+            const double distance = std::hypot((points.xs[i] - mouseX) * scaleX,
+                                               (points.ys[i] - mouseCoords.second) * scaleY);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                bestPoint = {points.xs[i], points.ys[i]};
+            }
+        }
+    }
+
+    // Рядом с маркером особой точки показываем её уточнённые координаты
+    if (featureLayer.features) {
+        double snapDistance = 8.0;
+        for (const CurveFeature &feature : *featureLayer.features) {
+            const double distance = std::hypot((feature.x - mouseX) * scaleX,
+                                               (feature.y - mouseCoords.second) * scaleY);
+            if (distance < snapDistance && hasFunction(feature.expression)) {
+                snapDistance = distance;
+                bestPoint = {feature.x, feature.y};
+            }
+        }
+    }
+
     return bestPoint;
 }
 
 void PlotWidget::drawGraphPoint(QPainter &painter)
 {
-    if (!hasNearestPoint || functions.isEmpty()) {
+    if (!hasNearestPoint || !hasHoverCurves()) {
         return;
     }
 
@@ -680,4 +1028,45 @@ void PlotWidget::drawGraphPoint(QPainter &painter)
     // Рисуем текст
     painter.setPen(QColor(60, 60, 70));
     painter.drawText(textRect, Qt::AlignCenter, coordText);
-} 
\ No newline at end of file
+}
+
+void PlotWidget::drawStatsOverlay(QPainter &painter)
+{
+    const FrameStats &stats = lastFrameStats;
+    QStringList lines;
+    lines << QString("Кадр %1: %2 мс").arg(stats.frame).arg(formatMs(stats.totalNs));
+    lines << QString("фон %1  сетка %2  оси %3  подписи %4")
+                 .arg(formatMs(stats.backgroundNs), formatMs(stats.gridNs),
+                      formatMs(stats.axesNs), formatMs(stats.axisLabelsNs));
+    lines << QString("сведение %1  вывод %2  наложение %3")
+                 .arg(formatMs(stats.composeNs), formatMs(stats.blitNs), formatMs(stats.overlayNs));
+    for (const FrameStats::FunctionStats &function : stats.functions) {
+        const SamplingStats &sampling = function.sampling;
+        lines << QString("%1: выборка %2  путь %3  растр %4 | точек %5, вычислено %6, NaN %7")
+                     .arg(function.expression, formatMs(sampling.nanoseconds),
+                          formatMs(function.pathNs), formatMs(function.rasterNs))
+                     .arg(sampling.points).arg(sampling.evaluations).arg(sampling.nanCount);
+    }
+    lines << QString("Всего вычислено %1, NaN %2, кэш точек %3%")
+                 .arg(stats.samplesEvaluated).arg(stats.nanCount)
+                 .arg(100.0 * stats.cacheHitRate(), 0, 'f', 1);
+    const QString text = lines.join('\n');
+
+    QFont font = painter.font();
+    font.setFamily("monospace");
+    font.setStyleHint(QFont::Monospace);
+    font.setPointSize(9);
+    painter.setFont(font);
+
+    // В левом нижнем углу: вверху слева уже подписи функций
+    QFontMetrics fm(font);
+    QRect textRect = fm.boundingRect(QRect(0, 0, width(), height()), Qt::AlignLeft, text);
+    textRect.adjust(-6, -6, 6, 6);
+    textRect.moveBottomLeft(QPoint(10, height() - 10));
+
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(30, 30, 40, 200));
+    painter.drawRect(textRect);
+    painter.setPen(QColor(230, 230, 240));
+    painter.drawText(textRect.adjusted(6, 6, -6, -6), Qt::AlignLeft | Qt::AlignTop, text);
+}
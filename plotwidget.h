@@ -8,186 +8,32 @@
 #include <QWheelEvent>
 #include <QMouseEvent>
 #include <QKeyEvent>
-#include <muParser.h>
 #include <QMap>
+#include <QImage>
+#include <QTimer>
 #include <cmath>
-#include <memory>
 #include <QDebug>
-#include <QRegularExpression>
-
-struct Function {
-    QString expression;
-    QColor color;
-    std::shared_ptr<mu::Parser> parser;
-    mutable double xValue;
-
-    static double power_wrapper(double v1, double v2) {
-        if (v1 < 0 && std::floor(v2) != v2) {
-            return std::numeric_limits<double>::quiet_NaN();
-        }
-        return std::pow(v1, v2);
-    }
-
-    // Метод для предварительной обработки выражения
-    QString preprocessExpression(const QString &expr) const {
-        QString result = expr;
-        
-        // Проверяем, является ли ввод просто числом
-        bool isNumber;
-        result.toDouble(&isNumber);
-        if (!isNumber) {
-            // Заменяем все вхождения числа перед x на число*x
-            QRegularExpression numberBeforeX("(\\d+)([xX])");
-            result.replace(numberBeforeX, "\\1*\\2");
-            
-            // Заменяем все вхождения числа с точкой перед x на число*x
-            QRegularExpression floatBeforeX("(\\d*\\.\\d+)([xX])");
-            result.replace(floatBeforeX, "\\1*\\2");
-            
-            // Заменяем все вхождения x перед числом на x*число
-            QRegularExpression numberAfterX("([xX])(\\d+)");
-            result.replace(numberAfterX, "\\1*\\2");
-            
-            // Заменяем все вхождения x перед числом с точкой на x*число
-            QRegularExpression floatAfterX("([xX])(\\d*\\.\\d+)");
-            result.replace(floatAfterX, "\\1*\\2");
-            
-            // Заменяем )x на )*x и x( на x*(
-            result.replace(")(", ")*(");
-            result.replace(")x", ")*x");
-            result.replace(")X", ")*X");
-            result.replace("x(", "x*(");
-            result.replace("X(", "X*(");
-            
-            // Приводим x к нижнему регистру для единообразия
-            result.replace("X", "x");
-            
-            // Заменяем "^" на "pow" для корректной работы со степенями
-            QRegularExpression powerRegex("([\\d.]+|x|\\([^)]+\\))\\s*\\^\\s*([\\d.]+|x|\\([^)]+\\))");
-            int pos = 0;
-            QRegularExpressionMatch match;
-            while ((match = powerRegex.match(result, pos)).hasMatch()) {
-                QString matchStr = match.captured(0);
-                QString base = match.captured(1);
-                QString exponent = match.captured(2);
-                QString replacement = QString("pow(%1,%2)").arg(base, exponent);
-                result.replace(match.capturedStart(), match.capturedLength(), replacement);
-                pos = match.capturedStart() + replacement.length();
-            }
-        }
-        
-        // Добавляем нейтральный член с x в конец любого выражения
-        result = QString("(%1)+0*x").arg(result);
-        
-        qDebug() << "Исходное выражение:" << expr;
-        qDebug() << "Обработанное выражение:" << result;
-        return result;
-    }
-
-    Function(const QString &expr = QString(), const QColor &col = Qt::blue)
-        : expression(expr), color(col), xValue(0.0), parser(std::make_shared<mu::Parser>())
-    {
-        try {
-            parser->SetDecSep('.');
-            parser->SetThousandsSep(' ');
-            
-            // Определяем стандартные математические функции
-            parser->DefineFun("pow", power_wrapper);
-            parser->DefineFun("sin", static_cast<double (*)(double)>(std::sin));
-            parser->DefineFun("cos", static_cast<double (*)(double)>(std::cos));
-            parser->DefineFun("tan", static_cast<double (*)(double)>(std::tan));
-            parser->DefineFun("sqrt", static_cast<double (*)(double)>(std::sqrt));
-            parser->DefineFun("abs", static_cast<double (*)(double)>(std::abs));
-            parser->DefineFun("exp", static_cast<double (*)(double)>(std::exp));
-            parser->DefineFun("log", static_cast<double (*)(double)>(std::log));
-            parser->DefineFun("log10", static_cast<double (*)(double)>(std::log10));
-
-            // Определяем переменную до установки выражения
-            parser->DefineVar("x", &xValue);
-
-            // Устанавливаем выражение для парсера с предварительной обработкой
-            if (!expression.isEmpty()) {
-                QString processedExpr = preprocessExpression(expression);
-                parser->SetExpr(processedExpr.toStdString());
-            }
-        }
-        catch (const mu::Parser::exception_type &e) {
-            qDebug() << "Ошибка при инициализации парсера:" << QString::fromStdString(e.GetMsg());
-        }
-    }
-
-    Function(const Function &other)
-        : expression(other.expression), color(other.color), xValue(other.xValue), 
-          parser(std::make_shared<mu::Parser>())
-    {
-        try {
-            parser->SetDecSep('.');
-            parser->SetThousandsSep(' ');
-            
-            // Определяем стандартные математические функции
-            parser->DefineFun("pow", power_wrapper);
-            parser->DefineFun("sin", static_cast<double (*)(double)>(std::sin));
-            parser->DefineFun("cos", static_cast<double (*)(double)>(std::cos));
-            parser->DefineFun("tan", static_cast<double (*)(double)>(std::tan));
-            parser->DefineFun("sqrt", static_cast<double (*)(double)>(std::sqrt));
-            parser->DefineFun("abs", static_cast<double (*)(double)>(std::abs));
-            parser->DefineFun("exp", static_cast<double (*)(double)>(std::exp));
-            parser->DefineFun("log", static_cast<double (*)(double)>(std::log));
-            parser->DefineFun("log10", static_cast<double (*)(double)>(std::log10));
-
-            // Определяем переменную до установки выражения
-            parser->DefineVar("x", &xValue);
-
-            // Копируем выражение из другого парсера с предварительной обработкой
-            if (!expression.isEmpty()) {
-                QString processedExpr = preprocessExpression(expression);
-                parser->SetExpr(processedExpr.toStdString());
-            }
-        }
-        catch (const mu::Parser::exception_type &e) {
-            qDebug() << "Ошибка при копировании функции:" << QString::fromStdString(e.GetMsg());
-        }
-    }
-
-    Function& operator=(const Function &other)
-    {
-        if (this != &other) {
-            expression = other.expression;
-            color = other.color;
-            xValue = other.xValue;
-            parser = std::make_shared<mu::Parser>();
-            
-            try {
-                parser->SetDecSep('.');
-                parser->SetThousandsSep(' ');
-                
-                // Определяем стандартные математические функции
-                parser->DefineFun("pow", power_wrapper);
-                parser->DefineFun("sin", static_cast<double (*)(double)>(std::sin));
-                parser->DefineFun("cos", static_cast<double (*)(double)>(std::cos));
-                parser->DefineFun("tan", static_cast<double (*)(double)>(std::tan));
-                parser->DefineFun("sqrt", static_cast<double (*)(double)>(std::sqrt));
-                parser->DefineFun("abs", static_cast<double (*)(double)>(std::abs));
-                parser->DefineFun("exp", static_cast<double (*)(double)>(std::exp));
-                parser->DefineFun("log", static_cast<double (*)(double)>(std::log));
-                parser->DefineFun("log10", static_cast<double (*)(double)>(std::log10));
-
-                // Определяем переменную до установки выражения
-                parser->DefineVar("x", &xValue);
-
-                // Копируем выражение с предварительной обработкой
-                if (!expression.isEmpty()) {
-                    QString processedExpr = preprocessExpression(expression);
-                    parser->SetExpr(processedExpr.toStdString());
-                }
-            }
-            catch (const mu::Parser::exception_type &e) {
-                qDebug() << "Ошибка присваивания парсера:" << QString::fromStdString(e.GetMsg());
-            }
-        }
-        return *this;
-    }
-};
+#include <QStringList>
+#include "function.h"
+#include "functionsampler.h"
+#include "evaluationservice.h"
+#include "slotmap.h"
+#include "plotrenderer.h"
+#include "dataseries.h"
+#include "streamingseries.h"
+#include "parametriccurve.h"
+#include "implicitcurve.h"
+
+// Дескриптор функции на графике; остаётся действительным, пока функция не удалена
+using FunctionHandle = SlotHandle;
+// Дескриптор параметрической или полярной кривой на графике
+using ParametricHandle = SlotHandle;
+// Дескриптор неявной кривой на графике
+using ImplicitHandle = SlotHandle;
+// Дескриптор ряда данных на графике
+using DataSeriesHandle = SlotHandle;
+// Дескриптор потокового ряда на графике
+using StreamHandle = SlotHandle;
 
 class PlotWidget : public QWidget {
     Q_OBJECT
@@ -195,9 +41,58 @@ class PlotWidget : public QWidget {
 public:
     explicit PlotWidget(QWidget *parent = nullptr);
     ~PlotWidget();
-    void addFunction(const QString &func, const QColor &color);
-    void updateFunction(const QString &oldFunc, const QString &newFunc, const QColor &color);
-    void removeFunction(const QString &func);
+    // Возвращает пустой дескриптор, если выражение не разобралось
+    FunctionHandle addFunction(const QString &func, const QColor &color);
+    // Добавляет уже разобранную и проверенную функцию (см. ExpressionValidator)
+    FunctionHandle addFunction(Function &&func);
+    // Новое выражение для той же функции: точки пересчитываются, цвет и толщина
+    // остаются прежними
+    bool setFunctionExpression(FunctionHandle handle, Function &&func);
+    // Смена стиля перерисовывает только слой функции, без вычисления точек
+    bool setFunctionColor(FunctionHandle handle, const QColor &color);
+    bool setFunctionWidth(FunctionHandle handle, qreal width);
+    bool removeFunction(FunctionHandle handle);
+    // Параметрическая (x(t), y(t)) или полярная r(θ) кривая. Возвращает пустой
+    // дескриптор, если выражение не разобралось
+    ParametricHandle addParametricCurve(const ParametricCurveSpec &spec, const QColor &color,
+                                        qreal width = 2.5);
+    bool removeParametricCurve(ParametricHandle handle);
+    // Неявная кривая F(x, y) = 0; expression — левая часть, например x^2 + y^2 - 4.
+    // Возвращает пустой дескриптор, если выражение не разобралось
+    ImplicitHandle addImplicitCurve(const QString &expression, const QColor &color, qreal width = 2.5);
+    bool removeImplicitCurve(ImplicitHandle handle);
+    // Скалярное поле f(x, y) цветом под графиками; одно на виджет. false, если
+    // выражение не разобралось (прежнее поле тогда остаётся)
+    bool setHeatmap(const HeatmapSpec &spec);
+    void clearHeatmap();
+    const HeatmapSpec &heatmap() const { return heatmapSpec; }
+    // Ряд измеренных точек поверх графиков функций. Ряд не копируется: при каждой
+    // перерисовке из него берутся O(ширины) точек (см. DataSeries::extract)
+    DataSeriesHandle addDataSeries(std::shared_ptr<const DataSeries> series, const QColor &color,
+                                   qreal width = 1.5);
+    bool removeDataSeries(DataSeriesHandle handle);
+    // Потоковый ряд: источник пишет в него из своего потока, а виджет забирает
+    // новые точки по таймеру не чаще раза в streamRefreshInterval мс
+    StreamHandle addStreamingSeries(std::shared_ptr<StreamingSeries> series, const QColor &color,
+                                    qreal width = 1.5);
+    bool removeStreamingSeries(StreamHandle handle);
+    void setStreamRefreshInterval(int msec);
+    int streamRefreshInterval() const { return streamTimer->interval(); }
+    // Слежение за новыми точками: правый край области держится на последнем x
+    // потоковых рядов. Сдвиг графика мышью слежение выключает
+    void setAutoScroll(bool enabled);
+    bool isAutoScroll() const { return autoScroll; }
+    // Поиск корней, экстремумов и пересечений функций в фоне и маркеры на графике
+    void setCurveAnalysisEnabled(bool enabled);
+    bool isCurveAnalysisEnabled() const { return curveAnalysis; }
+    // Сколько памяти может занимать кэш точек одной функции
+    void setSampleCacheMemoryBudget(qint64 bytes);
+
+    // Замеры последнего завершённого кадра
+    const FrameStats &frameStats() const { return lastFrameStats; }
+    // Панель с замерами поверх графика; переключается также клавишей F3
+    void setStatsOverlayVisible(bool visible);
+    bool isStatsOverlayVisible() const { return statsOverlayVisible; }
 
 protected:
     void paintEvent(QPaintEvent *event) override;
@@ -210,7 +105,9 @@ protected:
     void keyReleaseEvent(QKeyEvent *event) override;
 
 private:
-    QMap<QString, Function> functions;
+    // Бенчмарк отрисовки замеряет отдельные этапы paintEvent
+    friend class PlotRenderBenchmark;
+
     double xMin = -10.0;
     double xMax = 10.0;
     double yMin = -10.0;
@@ -225,18 +122,115 @@ private:
     
     QPair<double, double> nearestPoint;
     bool hasNearestPoint = false;
-    
-    QVector<QPair<double, double>> calculatePoints(const Function &func);
-    void drawAxes(QPainter &painter);
-    void drawGrid(QPainter &painter);
-    void drawFunction(QPainter &painter, const QString &expr, Function &func);
-    void drawAxisLabels(QPainter &painter);
+
+    // Фоновое вычисление точек и последнее отправленное ему задание
+    EvaluationService *evaluationService;
+    ViewportSnapshot requestedViewport;
+    QStringList requestedExpressions;
+    QVector<ParametricCurveSpec> requestedParametric;
+    QStringList requestedImplicit;
+    HeatmapSpec requestedHeatmap;
+    bool requestedAnalysis = false;
+
+    // Кэшированные слои изображения; слой перерисовывается, только если он грязный.
+    // Интерактивный слой (точка под курсором, координаты) не кэшируется: он
+    // рисуется поверх готовой сцены, поэтому движение мыши не трогает остальные слои.
+    struct PlotLayer {
+        QImage image;
+        bool dirty = true;
+    };
+    // Слой функции помнит, по каким точкам он нарисован
+    struct FunctionLayer : PlotLayer {
+        CurvePoints points;
+    };
+    // Функция на графике вместе со своим слоем
+    struct PlotCurve {
+        Function function;
+        FunctionLayer layer;
+    };
+    SlotMap<PlotCurve> functions;
+    // Параметрическая кривая; её точки, как и точки функций, приходят от EvaluationService
+    struct PlotParametric {
+        ParametricCurveSpec spec;
+        QColor color;
+        qreal width;
+        FunctionLayer layer;
+    };
+    SlotMap<PlotParametric> parametricCurves;
+    // Неявная кривая; в слое лежат её отрезки
+    struct PlotImplicit {
+        QString expression;
+        QColor color;
+        qreal width;
+        FunctionLayer layer;
+    };
+    SlotMap<PlotImplicit> implicitCurves;
+    // Поле и изображение, по которому нарисован его слой
+    struct HeatmapLayer : PlotLayer {
+        HeatmapImage field;
+    };
+    HeatmapSpec heatmapSpec;
+    HeatmapLayer heatmapLayer;
+    // Маркеры особых точек и список, по которому они нарисованы
+    struct FeatureLayer : PlotLayer {
+        CurveFeatures features;
+    };
+    bool curveAnalysis = true;
+    FeatureLayer featureLayer;
+    // Ряд данных; его точки для текущей области лежат в слое, пока она не сменится
+    struct SeriesLayer : PlotLayer {
+        SampleBuffer points;
+    };
+    struct PlotSeries {
+        std::shared_ptr<const DataSeries> data;
+        QColor color;
+        qreal width;
+        SeriesLayer layer;
+    };
+    SlotMap<PlotSeries> dataSeries;
+    struct PlotStream {
+        std::shared_ptr<StreamingSeries> data;
+        QColor color;
+        qreal width;
+        SeriesLayer layer;
+    };
+    SlotMap<PlotStream> streams;
+    QTimer *streamTimer;
+    bool autoScroll = false;
+    PlotLayer backgroundLayer;                  // фон и сетка
+    PlotLayer axesLayer;                        // оси и подписи к ним
+    PlotLayer sceneLayer;                       // все слои выше, сведённые вместе
+    ViewportSnapshot layerViewport;             // область, для которой нарисованы слои
+    qreal layerPixelRatio = 0;
+
+    // Замеры: текущий кадр заполняется по ходу paintEvent, а по его окончании
+    // меняется местами с последним завершённым
+    FrameStats frameStatsInProgress;
+    FrameStats lastFrameStats;
+    bool statsOverlayVisible = false;
+
+    // Фон, сетка, оси и функции рисуются им; область просмотра обновляется
+    // перед перерисовкой слоёв
+    PlotRenderer renderer;
+
+    ViewportSnapshot viewportSnapshot() const;
+    void requestEvaluation();
+    // Забирает новые точки потоковых рядов и, если они есть, заказывает перерисовку
+    void drainStreams();
+    // Помечает грязными слои, чьи исходные данные изменились, и перерисовывает их
+    void updateLayers();
+    void renderLayer(PlotLayer &layer, const std::function<void(QPainter &)> &draw);
+    SampleBuffer calculatePoints(const Function &func);
     void drawCoordinates(QPainter &painter);
     void drawGraphPoint(QPainter &painter);
+    void drawStatsOverlay(QPainter &painter);
     QPoint transformToScreen(double x, double y);
     QPair<double, double> transformToGraph(int screenX, int screenY);
     void zoom(double factor, QPoint center);
     void pan(const QPoint &delta);
+    // Есть ли на графике кривые, к которым привязывается точка под курсором
+    bool hasHoverCurves() const;
+    bool hasFunction(const QString &expression) const;
     QPair<double, double> findNearestPoint(const QPoint &mousePos);
     double evaluateFunction(double x, const Function &func) const;
 };
@@ -0,0 +1,468 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTextStream>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "plotwidget.h"
+#include "tracer.h"
+
+// Бенчмарк всего конвейера построения графика без окна (платформа offscreen):
+// предобработка выражения, создание и копирование Function, вычисление точек,
+// отрисовка функции, сетки и подписей на QImage, выборка и отрисовка
+// параметрической и неявной кривых, полный paintEvent
+// с разбивкой по этапам и кадры с потоковым рядом под постоянной нагрузкой.
+// Параметры — ширина виджета, число функций и сложность выражений; результаты
+// выводятся в CSV или JSON, чтобы прогоны можно было сравнивать между собой.
+//
+//   function_plotter_render_bench --widths 800,1920 --functions 1,8 --format json -o out.json
+
+namespace {
+
+void silentMessageHandler(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+struct Complexity {
+    QString name;
+    QString expression;
+};
+
+const Complexity complexities[] = {
+    {"simple", "2x^2 + 3x - 1"},
+    {"medium", "sin(x)*cos(2x) + x/3"},
+    {"heavy", "exp(-x^2/8)*log(abs(x)+1) + sqrt(abs(x))/(1+x^2) + tan(x/3)"}
+};
+
+struct Result {
+    QString benchmark;
+    int width = 0;
+    int height = 0;
+    int functions = 0;
+    QString complexity;
+    qint64 iterations = 0;
+    double nsPerOp = 0.0;
+};
+
+// Время одной операции в наносекундах: число повторов подбирается так, чтобы
+// замер длился не меньше minMs, берётся медиана из пяти замеров
+template <typename Body>
+QPair<qint64, double> measure(int minMs, Body body)
+{
+    auto run = [&body](qint64 iterations) {
+        QElapsedTimer timer;
+        timer.start();
+        for (qint64 i = 0; i < iterations; ++i) {
+            body();
+        }
+        return double(timer.nsecsElapsed());
+    };
+
+    qint64 iterations = 1;
+    const double batchNs = minMs * 1e6 / 5;
+    while (run(iterations) < batchNs && iterations < (qint64(1) << 24)) {
+        iterations *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < 5; ++i) {
+        samples.push_back(run(iterations) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    return {iterations, samples[samples.size() / 2]};
+}
+
+QList<int> parseList(const QString &value)
+{
+    QList<int> list;
+    for (const QString &item : value.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        int number = item.trimmed().toInt(&ok);
+        if (ok && number > 0) {
+            list.append(number);
+        }
+    }
+    return list;
+}
+
+} // namespace
+
+class PlotRenderBenchmark
+{
+public:
+    PlotRenderBenchmark(int minMs) : minMs(minMs) {}
+
+    QList<Result> results;
+
+    void expressionBenchmarks()
+    {
+        for (const Complexity &complexity : complexities) {
+            Function func(complexity.expression);
+            add("preprocess_expression", 0, 0, 1, complexity.name, measure(minMs, [&]() {
+                Function::preprocessExpression(complexity.expression);
+            }));
+            add("function_construct", 0, 0, 1, complexity.name, measure(minMs, [&]() {
+                Function constructed(complexity.expression);
+            }));
+            add("function_copy", 0, 0, 1, complexity.name, measure(minMs, [&]() {
+                Function copy(func);
+            }));
+        }
+    }
+
+    void widgetBenchmarks(int width, const QList<int> &functionCounts)
+    {
+        const int height = width * 9 / 16;
+        PlotWidget widget;
+        widget.resize(width, height);
+        const ViewportSnapshot viewport = widget.viewportSnapshot();
+        PlotRenderer renderer(viewport);
+
+        QImage image(widget.size(), QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+
+        add("draw_grid", width, height, 0, QString(), measure(minMs, [&]() {
+            renderer.drawGrid(painter);
+        }));
+        add("draw_axis_labels", width, height, 0, QString(), measure(minMs, [&]() {
+            renderer.drawAxisLabels(painter);
+        }));
+
+        for (const Complexity &complexity : complexities) {
+            Function func(complexity.expression);
+            SampleBuffer points;
+            add("calculate_points", width, height, 1, complexity.name, measure(minMs, [&]() {
+                points = FunctionSampler::calculatePoints(func, viewport);
+            }));
+            add("draw_function", width, height, 1, complexity.name, measure(minMs, [&]() {
+                renderer.drawFunction(painter, complexity.expression, func, points);
+            }));
+        }
+
+        // Фигура Лиссажу: кривая длинная и быстро осциллирует, адаптивная выборка
+        // даёт на ней близкое к худшему число точек
+        const ParametricCurveSpec lissajous =
+            ParametricCurveSpec::parametric("sin(3t)", "cos(2t)", 0, 2 * M_PI);
+        const ParametricComponents components(lissajous);
+        const double scaleX = width / (viewport.xMax - viewport.xMin);
+        const double scaleY = height / (viewport.yMax - viewport.yMin);
+        ParametricScratch scratch;
+        SampleBuffer curvePoints;
+        add("sample_parametric", width, height, 1, lissajous.key(), measure(minMs, [&]() {
+            ParametricSampler::calculatePoints(components, lissajous, scaleX, scaleY, curvePoints,
+                                               ParametricSampler::CancelCheck(), nullptr, &scratch);
+        }));
+        add("draw_parametric", width, height, 1, lissajous.key(), measure(minMs, [&]() {
+            renderer.drawCurve(painter, lissajous.key(), Qt::darkGreen, 2.5, curvePoints, nullptr, false);
+        }));
+
+        // Неявная кривая: полная сетка без кэша и сдвиг на 2% ширины, при котором
+        // досчитываются только открывшиеся плитки
+        const ImplicitFunction implicit("sin(x*y) - 0.5");
+        SampleBuffer segments;
+        add("sample_implicit", width, height, 1, implicit.key(), measure(minMs, [&]() {
+            ImplicitCurveSampler::calculateSegments(implicit, viewport, segments);
+        }));
+        ImplicitCurveCache implicitCache;
+        ViewportSnapshot panned = viewport;
+        const double panStep = 0.02 * (viewport.xMax - viewport.xMin);
+        add("sample_implicit_pan", width, height, 1, implicit.key(), measure(minMs, [&]() {
+            panned.xMin += panStep;
+            panned.xMax += panStep;
+            ImplicitCurveSampler::calculateSegments(implicit, panned, segments,
+                                                    ImplicitCurveSampler::CancelCheck(), nullptr, &implicitCache);
+        }));
+        ImplicitCurveSampler::calculateSegments(implicit, viewport, segments);
+        add("draw_implicit", width, height, 1, implicit.key(), measure(minMs, [&]() {
+            renderer.drawSegments(painter, implicit.key(), Qt::darkMagenta, 2.5, segments);
+        }));
+
+        // Поле: сразу точный уровень без кэша, затем сдвиг на 2% ширины с кэшем плиток
+        const HeatmapSpec field{"sin(x) * cos(y)"};
+        const ImplicitFunction fieldFunction(field.expression);
+        HeatmapImage heatmap;
+        add("sample_heatmap", width, height, 1, field.key(), measure(minMs, [&]() {
+            HeatmapCache cold;
+            heatmap = HeatmapRenderer::renderFinal(fieldFunction, field, viewport, cold);
+        }));
+        HeatmapCache heatmapCache;
+        panned = viewport;
+        add("sample_heatmap_pan", width, height, 1, field.key(), measure(minMs, [&]() {
+            panned.xMin += panStep;
+            panned.xMax += panStep;
+            heatmap = HeatmapRenderer::renderFinal(fieldFunction, field, panned, heatmapCache);
+        }));
+        heatmap = HeatmapRenderer::renderFinal(fieldFunction, field, viewport, heatmapCache);
+        add("draw_heatmap", width, height, 1, field.key(), measure(minMs, [&]() {
+            renderer.drawHeatmap(painter, heatmap);
+        }));
+
+        // Особые точки без кэша: корни и экстремумы sin(x) * x, пересечения с cos(x)
+        const Function analyzed("sin(x) * x");
+        const Function crossing("cos(x)");
+        const SampleBuffer analyzedPoints = FunctionSampler::calculatePoints(analyzed, viewport);
+        const SampleBuffer crossingPoints = FunctionSampler::calculatePoints(crossing, viewport);
+        QVector<CurveFeature> features;
+        add("analyze_function", width, height, 1, analyzed.expression, measure(minMs, [&]() {
+            features.clear();
+            CurveAnalyzer::analyzeFunction(analyzed, analyzedPoints, viewport, features);
+        }));
+        add("find_intersections", width, height, 1, analyzed.expression, measure(minMs, [&]() {
+            features.clear();
+            CurveAnalyzer::findIntersections(analyzed, analyzedPoints, crossing, crossingPoints, viewport, features);
+        }));
+        add("draw_features", width, height, 1, analyzed.expression, measure(minMs, [&]() {
+            renderer.drawFeatures(painter, features);
+        }));
+        painter.end();
+
+        for (int count : functionCounts) {
+            for (const Complexity &complexity : complexities) {
+                paintBenchmarks(width, height, count, complexity);
+            }
+        }
+    }
+
+    // Потоковый ряд под постоянной нагрузкой: источник в отдельном потоке пишет
+    // rate точек в секунду, а GUI-поток раз в 16 мс забирает их и перерисовывает
+    // виджет со слежением за новыми точками и одной функцией. Замеряются время кадра
+    // (медиана и 99-й перцентиль) и пропускная способность приёма
+    void streamBenchmarks(int width, int rate)
+    {
+        const int height = width * 9 / 16;
+        PlotWidget widget;
+        widget.resize(width, height);
+        widget.addFunction(complexities[1].expression, Qt::blue);
+        auto series = std::make_shared<StreamingSeries>("telemetry");
+        widget.addStreamingSeries(series, Qt::red);
+        widget.setAutoScroll(true);
+        QImage image(widget.size(), QImage::Format_ARGB32_Premultiplied);
+
+        const qint64 durationNs = std::max<qint64>(1000, 5 * minMs) * 1000000;
+        std::atomic<bool> running{true};
+        std::thread producer([&]() {
+            QElapsedTimer clock;
+            clock.start();
+            qint64 sent = 0;
+            double xs[256];
+            double ys[256];
+            while (running.load(std::memory_order_relaxed)) {
+                // Догоняем расписание пачками, между ними спим
+                const qint64 due = clock.nsecsElapsed() * rate / 1000000000;
+                while (sent < due) {
+                    const int batch = static_cast<int>(std::min<qint64>(256, due - sent));
+                    for (int i = 0; i < batch; ++i) {
+                        const double t = double(sent + i) / rate;
+                        xs[i] = t;
+                        ys[i] = 5 * std::sin(t * 3) + std::sin(t * 211);
+                    }
+                    series->append(xs, ys, batch);
+                    sent += batch;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        std::vector<double> frames;
+        QElapsedTimer clock;
+        clock.start();
+        while (clock.nsecsElapsed() < durationNs) {
+            QElapsedTimer frame;
+            frame.start();
+            widget.drainStreams();
+            widget.render(&image);
+            QCoreApplication::processEvents();
+            frames.push_back(double(frame.nsecsElapsed()));
+            const qint64 rest = 16000000 - frame.nsecsElapsed();
+            if (rest > 0) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(rest));
+            }
+        }
+        const double elapsedNs = double(clock.nsecsElapsed());
+        running = false;
+        producer.join();
+        widget.drainStreams();
+
+        std::sort(frames.begin(), frames.end());
+        const qint64 frameCount = static_cast<qint64>(frames.size());
+        const qint64 received = static_cast<qint64>(series->appendedCount());
+        add("stream_frame_median", width, height, 2, complexities[1].name,
+            {frameCount, frames[frames.size() / 2]});
+        add("stream_frame_p99", width, height, 2, complexities[1].name,
+            {frameCount, frames[std::min(frames.size() - 1, frames.size() * 99 / 100)]});
+        add("stream_ingest", width, height, 2, complexities[1].name,
+            {received, received > 0 ? elapsedNs / received : 0.0});
+        add("stream_dropped", width, height, 2, complexities[1].name,
+            {static_cast<qint64>(series->droppedCount()), 0.0});
+    }
+
+    void write(QTextStream &out, bool json) const
+    {
+        if (json) {
+            QJsonArray array;
+            for (const Result &result : results) {
+                QJsonObject object;
+                object["benchmark"] = result.benchmark;
+                object["width"] = result.width;
+                object["height"] = result.height;
+                object["functions"] = result.functions;
+                object["complexity"] = result.complexity;
+                object["iterations"] = result.iterations;
+                object["ns_per_op"] = result.nsPerOp;
+                array.append(object);
+            }
+            out << QJsonDocument(array).toJson(QJsonDocument::Indented);
+            return;
+        }
+        out << "benchmark;width;height;functions;complexity;iterations;ns_per_op\n";
+        for (const Result &result : results) {
+            out << result.benchmark << ';' << result.width << ';' << result.height << ';'
+                << result.functions << ';' << result.complexity << ';' << result.iterations << ';'
+                << QString::number(result.nsPerOp, 'f', 1) << '\n';
+        }
+    }
+
+private:
+    int minMs;
+
+    void add(const QString &benchmark, int width, int height, int functions, const QString &complexity,
+             const QPair<qint64, double> &measurement)
+    {
+        Result result;
+        result.benchmark = benchmark;
+        result.width = width;
+        result.height = height;
+        result.functions = functions;
+        result.complexity = complexity;
+        result.iterations = measurement.first;
+        result.nsPerOp = measurement.second;
+        results.append(result);
+    }
+
+    void paintBenchmarks(int width, int height, int count, const Complexity &complexity)
+    {
+        PlotWidget widget;
+        widget.resize(width, height);
+        for (int i = 0; i < count; ++i) {
+            // Разные выражения, чтобы каждая функция вычислялась отдельно
+            widget.addFunction(QString("%1 + %2").arg(complexity.expression).arg(i), Qt::blue);
+        }
+
+        // Первая отрисовка заказывает точки; ждём, пока фоновый поток их посчитает
+        QImage image(widget.size(), QImage::Format_ARGB32_Premultiplied);
+        QEventLoop loop;
+        QObject::connect(widget.evaluationService, &EvaluationService::resultReady, &loop, [&]() {
+            if (!widget.evaluationService->latestResult().preview) {
+                loop.quit();
+            }
+        });
+        QTimer::singleShot(30000, &loop, &QEventLoop::quit);
+        widget.render(&image);
+        loop.exec();
+        QCoreApplication::processEvents();
+
+        // Полная перерисовка: все слои устарели, как после сдвига или зума
+        add("paint_full", width, height, count, complexity.name, measure(minMs, [&]() {
+            widget.layerViewport = ViewportSnapshot();
+            widget.render(&image);
+        }));
+        // Разбивка последней полной перерисовки по этапам (см. PlotWidget::frameStats)
+        const FrameStats &stats = widget.frameStats();
+        qint64 pathNs = 0;
+        qint64 rasterNs = 0;
+        for (const FrameStats::FunctionStats &function : stats.functions) {
+            pathNs += function.pathNs;
+            rasterNs += function.rasterNs;
+        }
+        const QPair<QString, qint64> stages[] = {
+            {"stage_background", stats.backgroundNs},
+            {"stage_grid", stats.gridNs},
+            {"stage_axes", stats.axesNs},
+            {"stage_axis_labels", stats.axisLabelsNs},
+            {"stage_function_path", pathNs},
+            {"stage_function_raster", rasterNs},
+            {"stage_compose", stats.composeNs},
+            {"stage_blit", stats.blitNs}
+        };
+        for (const auto &stage : stages) {
+            add(stage.first, width, height, count, complexity.name, {1, double(stage.second)});
+        }
+        // Перерисовка при движении мыши: слои берутся из кэша
+        add("paint_cached", width, height, count, complexity.name, measure(minMs, [&]() {
+            widget.render(&image);
+        }));
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    // Бенчмарк не открывает окон и работает без дисплея
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Бенчмарк вычисления и отрисовки графиков");
+    parser.addHelpOption();
+    QCommandLineOption widthsOption("widths", "Ширины виджета через запятую.", "list", "800,1920,3840");
+    QCommandLineOption functionsOption("functions", "Число функций на графике через запятую.", "list", "1,4,16");
+    QCommandLineOption formatOption("format", "Формат вывода: csv или json.", "format", "csv");
+    QCommandLineOption outputOption({"o", "output"}, "Файл результатов (по умолчанию stdout).", "file");
+    QCommandLineOption minTimeOption("min-time", "Минимальная длительность замера, мс.", "ms", "200");
+    QCommandLineOption traceOption("trace", "Записать трассу Chrome Trace Event в файл.", "file");
+    QCommandLineOption streamRateOption("stream-rate", "Точек в секунду для потокового ряда.", "rate", "50000");
+    parser.addOptions({widthsOption, functionsOption, formatOption, outputOption, minTimeOption, traceOption,
+                       streamRateOption});
+    parser.process(app);
+
+    if (parser.isSet(traceOption)) {
+        Tracer::start(parser.value(traceOption).toStdString());
+        Tracer::setThreadName("GUI");
+    }
+
+    // Отладочный вывод парсера искажает замеры
+    qInstallMessageHandler(silentMessageHandler);
+
+    const QList<int> widths = parseList(parser.value(widthsOption));
+    const QList<int> functionCounts = parseList(parser.value(functionsOption));
+    const bool json = parser.value(formatOption) == "json";
+    const int minMs = std::max(1, parser.value(minTimeOption).toInt());
+
+    PlotRenderBenchmark benchmark(minMs);
+    benchmark.expressionBenchmarks();
+    for (int width : widths) {
+        benchmark.widgetBenchmarks(width, functionCounts);
+        benchmark.streamBenchmarks(width, std::max(1, parser.value(streamRateOption).toInt()));
+    }
+
+    QFile file;
+    if (parser.isSet(outputOption)) {
+        file.setFileName(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            QTextStream(stderr) << "Не удалось открыть " << file.fileName() << '\n';
+            return 1;
+        }
+    } else {
+        file.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    QTextStream out(&file);
+    benchmark.write(out, json);
+    Tracer::stop();
+    return 0;
+}
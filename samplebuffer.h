@@ -0,0 +1,85 @@
+#ifndef SAMPLEBUFFER_H
+#define SAMPLEBUFFER_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Распределитель с выравниванием по Alignment байт: начало массива попадает
+// на границу строки кэша, и векторные инструкции читают его без сдвига
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+    T *allocate(std::size_t count)
+    {
+        return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *memory, std::size_t) noexcept
+    {
+        ::operator delete(memory, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Точки кривой в виде структуры массивов: x и y лежат в отдельных выровненных
+// массивах. clear() не освобождает память, поэтому буфер, который переиспользуется
+// от кадра к кадру, после первых кадров больше не обращается к куче.
+template <typename T>
+struct SampleSeries {
+    AlignedVector<T> xs;
+    AlignedVector<T> ys;
+
+    int size() const { return static_cast<int>(xs.size()); }
+    bool isEmpty() const { return xs.empty(); }
+
+    void clear()
+    {
+        xs.clear();
+        ys.clear();
+    }
+
+    void reserve(int count)
+    {
+        xs.reserve(count);
+        ys.reserve(count);
+    }
+
+    void append(T x, T y)
+    {
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+};
+
+// Точки в координатах графика
+using SampleBuffer = SampleSeries<double>;
+
+// Экранные координаты нужны только для отрисовки; при сборке с
+// FUNCTION_PLOTTER_FLOAT_SCREEN они хранятся в float — вдвое меньше памяти и вдвое
+// больше значений в одном векторном регистре
+#ifdef FUNCTION_PLOTTER_FLOAT_SCREEN
+using ScreenCoord = float;
+#else
+using ScreenCoord = double;
+#endif
+using ScreenBuffer = SampleSeries<ScreenCoord>;
+
+#endif // SAMPLEBUFFER_H
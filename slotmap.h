@@ -0,0 +1,136 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <QtGlobal>
+#include <QHash>
+#include <vector>
+
+// Дескриптор элемента SlotMap: номер слота и его поколение. После удаления
+// элемента поколение слота растёт, и старый дескриптор перестаёт что-либо находить,
+// даже если слот занят снова.
+struct SlotHandle {
+    quint32 index = 0;
+    quint32 generation = 0;     // 0 — пустой дескриптор
+
+    bool isNull() const { return generation == 0; }
+
+    // Упаковка в одно число, например для QVariant
+    quint64 toId() const { return (quint64(generation) << 32) | index; }
+    static SlotHandle fromId(quint64 id)
+    {
+        return {quint32(id & 0xffffffffu), quint32(id >> 32)};
+    }
+
+    bool operator==(const SlotHandle &other) const
+    {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const SlotHandle &other) const { return !(*this == other); }
+};
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+inline size_t qHash(const SlotHandle &handle, size_t seed = 0)
+#else
+inline uint qHash(const SlotHandle &handle, uint seed = 0)
+#endif
+{
+    return qHash(handle.toId(), seed);
+}
+
+// Хранилище с доступом по дескриптору за O(1). Значения лежат плотно в одном
+// векторе, поэтому обход идёт без пропусков; при удалении на место удалённого
+// переезжает последний элемент, так что порядок обхода не сохраняется.
+template <typename T>
+class SlotMap
+{
+public:
+    SlotHandle insert(T &&value)
+    {
+        quint32 index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = quint32(slots.size());
+            slots.push_back(Slot());
+        }
+        Slot &slot = slots[index];
+        slot.dense = int(values.size());
+        values.push_back(std::move(value));
+        denseToSlot.push_back(index);
+        return {index, slot.generation};
+    }
+
+    bool remove(SlotHandle handle)
+    {
+        const int dense = denseIndex(handle);
+        if (dense < 0) {
+            return false;
+        }
+        const int lastDense = int(values.size()) - 1;
+        if (dense != lastDense) {
+            values[dense] = std::move(values[lastDense]);
+            denseToSlot[dense] = denseToSlot[lastDense];
+            slots[denseToSlot[dense]].dense = dense;
+        }
+        values.pop_back();
+        denseToSlot.pop_back();
+
+        Slot &slot = slots[handle.index];
+        slot.dense = -1;
+        // Поколение 0 зарезервировано за пустым дескриптором
+        if (++slot.generation == 0) {
+            slot.generation = 1;
+        }
+        freeSlots.push_back(handle.index);
+        return true;
+    }
+
+    T *get(SlotHandle handle)
+    {
+        const int dense = denseIndex(handle);
+        return dense < 0 ? nullptr : &values[dense];
+    }
+    const T *get(SlotHandle handle) const
+    {
+        const int dense = denseIndex(handle);
+        return dense < 0 ? nullptr : &values[dense];
+    }
+    bool contains(SlotHandle handle) const { return denseIndex(handle) >= 0; }
+
+    int size() const { return int(values.size()); }
+    bool isEmpty() const { return values.empty(); }
+
+    // Дескриптор элемента по его номеру в плотном массиве (0..size()-1)
+    SlotHandle handleAt(int dense) const
+    {
+        const quint32 index = denseToSlot[dense];
+        return {index, slots[index].generation};
+    }
+
+    typename std::vector<T>::iterator begin() { return values.begin(); }
+    typename std::vector<T>::iterator end() { return values.end(); }
+    typename std::vector<T>::const_iterator begin() const { return values.begin(); }
+    typename std::vector<T>::const_iterator end() const { return values.end(); }
+
+private:
+    struct Slot {
+        quint32 generation = 1;
+        int dense = -1;         // номер в values, -1 — слот свободен
+    };
+
+    std::vector<Slot> slots;
+    std::vector<quint32> freeSlots;
+    std::vector<T> values;
+    std::vector<quint32> denseToSlot;
+
+    int denseIndex(SlotHandle handle) const
+    {
+        if (handle.index >= slots.size() || slots[handle.index].generation != handle.generation) {
+            return -1;
+        }
+        return slots[handle.index].dense;
+    }
+};
+
+#endif // SLOTMAP_H
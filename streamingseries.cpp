@@ -0,0 +1,96 @@
+#include "streamingseries.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+quint64 roundUpToPowerOfTwo(int value)
+{
+    quint64 result = 1;
+    while (result < quint64(std::max(1, value))) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+StreamingSeries::StreamingSeries(const QString &name, int capacity, int historyLimit)
+    : seriesName(name)
+    , mask(roundUpToPowerOfTwo(capacity) - 1)
+    , historyLimit(std::max(1, historyLimit))
+    , ringX(mask + 1)
+    , ringY(mask + 1)
+{
+}
+
+bool StreamingSeries::append(double x, double y)
+{
+    return append(&x, &y, 1) == 1;
+}
+
+int StreamingSeries::append(const double *xs, const double *ys, int count)
+{
+    const quint64 h = head.load(std::memory_order_relaxed);
+    // tail перечитываем, только если по старому значению места не хватает
+    quint64 space = mask + 1 - (h - cachedTail);
+    if (space < quint64(count)) {
+        cachedTail = tail.load(std::memory_order_acquire);
+        space = mask + 1 - (h - cachedTail);
+    }
+    const int accepted = static_cast<int>(std::min<quint64>(space, quint64(count)));
+    for (int i = 0; i < accepted; ++i) {
+        const quint64 slot = (h + i) & mask;
+        ringX[slot] = xs[i];
+        ringY[slot] = ys[i];
+    }
+    if (accepted > 0) {
+        head.store(h + accepted, std::memory_order_release);
+    }
+    if (accepted < count) {
+        dropped.fetch_add(count - accepted, std::memory_order_relaxed);
+    }
+    return accepted;
+}
+
+int StreamingSeries::drain()
+{
+    const quint64 t = tail.load(std::memory_order_relaxed);
+    const quint64 h = head.load(std::memory_order_acquire);
+    if (h == t) {
+        return 0;
+    }
+
+    // Старые точки удаляются пачкой, когда история вырастает вдвое против предела:
+    // так сдвиг массива приходится в среднем на O(1) на точку
+    const int incoming = static_cast<int>(h - t);
+    if (points.size() + incoming > 2 * historyLimit) {
+        const int excess = std::min(points.size(), points.size() + incoming - historyLimit);
+        points.xs.erase(points.xs.begin(), points.xs.begin() + excess);
+        points.ys.erase(points.ys.begin(), points.ys.begin() + excess);
+    }
+    for (quint64 i = t; i != h; ++i) {
+        points.append(ringX[i & mask], ringY[i & mask]);
+    }
+    tail.store(h, std::memory_order_release);
+    return incoming;
+}
+
+void StreamingSeries::visiblePoints(const ViewportSnapshot &viewport, SampleBuffer &result) const
+{
+    result.clear();
+    const double *xs = points.xs.data();
+    const int count = points.size();
+    int first = static_cast<int>(std::lower_bound(xs, xs + count, viewport.xMin) - xs);
+    int last = static_cast<int>(std::upper_bound(xs, xs + count, viewport.xMax) - xs);
+    if (first > 0) --first;
+    if (last < count) ++last;
+    result.xs.assign(points.xs.begin() + first, points.xs.begin() + last);
+    result.ys.assign(points.ys.begin() + first, points.ys.begin() + last);
+}
+
+double StreamingSeries::lastX() const
+{
+    return points.isEmpty() ? std::numeric_limits<double>::quiet_NaN() : points.xs.back();
+}
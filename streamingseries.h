@@ -0,0 +1,69 @@
+#ifndef STREAMINGSERIES_H
+#define STREAMINGSERIES_H
+
+#include <QString>
+#include <atomic>
+#include "functionsampler.h"
+#include "samplebuffer.h"
+
+// Ряд точек, поступающих в реальном времени (телеметрия и т. п.).
+//
+// Поток-источник пишет точки через append в кольцевой буфер фиксированной ёмкости
+// без блокировок: один писатель и один читатель, индексы — атомарные счётчики,
+// каждый из которых меняет только одна сторона. Если читатель не успевает и буфер
+// полон, append не ждёт, а отбрасывает точку и увеличивает droppedCount.
+//
+// Читатель — GUI-поток: drain переносит накопившиеся точки в историю, из которой
+// рисуется график. История ограничена historyLimit последними точками.
+// x должны поступать в неубывающем порядке (например, время отсчёта).
+class StreamingSeries
+{
+public:
+    static constexpr int DefaultCapacity = 1 << 16;
+    static constexpr int DefaultHistoryLimit = 1 << 20;
+
+    // capacity округляется вверх до степени двойки
+    explicit StreamingSeries(const QString &name, int capacity = DefaultCapacity,
+                             int historyLimit = DefaultHistoryLimit);
+
+    StreamingSeries(const StreamingSeries &) = delete;
+    StreamingSeries &operator=(const StreamingSeries &) = delete;
+
+    const QString &name() const { return seriesName; }
+    int capacity() const { return static_cast<int>(mask + 1); }
+
+    // Только поток-источник. false, если буфер полон и точка отброшена
+    bool append(double x, double y);
+    // Пачка точек; возвращает, сколько поместилось (остальные отброшены)
+    int append(const double *xs, const double *ys, int count);
+
+    // Только GUI-поток. Переносит новые точки в историю и возвращает их число
+    int drain();
+    const SampleBuffer &history() const { return points; }
+    // Точки истории в области просмотра и по одной за её краями
+    void visiblePoints(const ViewportSnapshot &viewport, SampleBuffer &result) const;
+    // Последний x в истории; NaN, если она пуста
+    double lastX() const;
+
+    // Можно читать из любого потока
+    quint64 droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    quint64 appendedCount() const { return head.load(std::memory_order_relaxed); }
+
+private:
+    const QString seriesName;
+    const quint64 mask;
+    const int historyLimit;
+    AlignedVector<double> ringX;
+    AlignedVector<double> ringY;
+
+    // Счётчики не сбрасываются; позиция в буфере — счётчик & mask.
+    // Каждый на своей строке кэша, чтобы писатель и читатель не мешали друг другу
+    alignas(64) std::atomic<quint64> head{0};   // пишет источник
+    quint64 cachedTail = 0;                     // последний прочитанный источником tail
+    alignas(64) std::atomic<quint64> tail{0};   // пишет GUI-поток
+    alignas(64) std::atomic<quint64> dropped{0};
+
+    SampleBuffer points;
+};
+
+#endif // STREAMINGSERIES_H
@@ -0,0 +1,207 @@
+#include "tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled{false};
+
+namespace {
+
+// Поля атомарные (с relaxed-доступом, то есть обычными записями), потому что
+// после переполнения в слот может писать один поток, пока его читает другой
+struct Event {
+    // Номер записи + 1; 0 — слот пуст или как раз перезаписывается
+    std::atomic<std::uint64_t> sequence{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<const char *> category{nullptr};
+    std::atomic<std::int64_t> start{0};
+    std::atomic<std::int64_t> duration{0};
+    std::atomic<std::int64_t> value{-1};
+    std::atomic<std::uint32_t> thread{0};
+};
+
+struct Buffer {
+    std::unique_ptr<Event[]> events;
+    std::uint64_t capacity = 0;
+    std::atomic<std::uint64_t> head{0};
+};
+
+// Буфер создаётся в start() до включения флага и живёт до конца программы:
+// поток, успевший прочитать флаг, может записать событие уже после stop()
+std::atomic<Buffer *> buffer{nullptr};
+std::string outputPath;
+std::mutex controlMutex;
+
+std::mutex threadNamesMutex;
+std::vector<std::pair<std::uint32_t, std::string>> threadNames;
+
+std::atomic<std::uint32_t> nextThreadId{1};
+
+std::uint32_t currentThreadId()
+{
+    thread_local const std::uint32_t id = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void writeEscaped(std::FILE *file, const char *text)
+{
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            std::fputc('\\', file);
+        }
+        if (static_cast<unsigned char>(*c) >= 0x20) {
+            std::fputc(*c, file);
+        }
+    }
+}
+
+} // namespace
+
+void Tracer::start(const std::string &path, int capacity)
+{
+    std::lock_guard<std::mutex> lock(controlMutex);
+    if (!buffer.load()) {
+        Buffer *created = new Buffer;
+        created->capacity = static_cast<std::uint64_t>(std::max(1, capacity));
+        created->events.reset(new Event[created->capacity]);
+        buffer.store(created, std::memory_order_release);
+    }
+    outputPath = path;
+    enabled.store(true, std::memory_order_release);
+}
+
+void Tracer::startFromEnvironment()
+{
+    const char *path = std::getenv("FUNCTION_PLOTTER_TRACE");
+    if (path && *path) {
+        start(path);
+    }
+}
+
+std::int64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::setThreadName(const char *name)
+{
+    const std::uint32_t id = currentThreadId();
+    std::lock_guard<std::mutex> lock(threadNamesMutex);
+    for (auto &entry : threadNames) {
+        if (entry.first == id) {
+            entry.second = name;
+            return;
+        }
+    }
+    threadNames.emplace_back(id, name);
+}
+
+void Tracer::record(const char *name, const char *category, std::int64_t startNs,
+                    std::int64_t durationNs, std::int64_t value)
+{
+    Buffer *target = buffer.load(std::memory_order_acquire);
+    if (!target) {
+        return;
+    }
+    const std::uint64_t index = target->head.fetch_add(1, std::memory_order_relaxed);
+    Event &event = target->events[index % target->capacity];
+    // Пока поля пишутся, слот помечен пустым — stop() его пропустит
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.category.store(category, std::memory_order_relaxed);
+    event.start.store(startNs, std::memory_order_relaxed);
+    event.duration.store(durationNs, std::memory_order_relaxed);
+    event.value.store(value, std::memory_order_relaxed);
+    event.thread.store(currentThreadId(), std::memory_order_relaxed);
+    event.sequence.store(index + 1, std::memory_order_release);
+}
+
+bool Tracer::stop()
+{
+    std::lock_guard<std::mutex> lock(controlMutex);
+    if (!enabled.exchange(false)) {
+        return false;
+    }
+    Buffer *source = buffer.load(std::memory_order_acquire);
+
+    // Копируем целиком записанные события и упорядочиваем по времени начала
+    struct Copy {
+        const char *name;
+        const char *category;
+        std::int64_t start;
+        std::int64_t duration;
+        std::int64_t value;
+        std::uint32_t thread;
+    };
+    std::vector<Copy> events;
+    const std::uint64_t head = source->head.load(std::memory_order_acquire);
+    const std::uint64_t first = head > source->capacity ? head - source->capacity : 0;
+    events.reserve(static_cast<size_t>(head - first));
+    for (std::uint64_t index = first; index < head; ++index) {
+        const Event &event = source->events[index % source->capacity];
+        if (event.sequence.load(std::memory_order_acquire) != index + 1) {
+            continue;
+        }
+        const Copy copy = {event.name.load(std::memory_order_relaxed),
+                           event.category.load(std::memory_order_relaxed),
+                           event.start.load(std::memory_order_relaxed),
+                           event.duration.load(std::memory_order_relaxed),
+                           event.value.load(std::memory_order_relaxed),
+                           event.thread.load(std::memory_order_relaxed)};
+        // Слот перезаписали, пока мы его читали
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.sequence.load(std::memory_order_relaxed) != index + 1) {
+            continue;
+        }
+        events.push_back(copy);
+    }
+    std::sort(events.begin(), events.end(), [](const Copy &a, const Copy &b) { return a.start < b.start; });
+    // Следующая запись начнётся с чистого буфера
+    source->head.store(0, std::memory_order_relaxed);
+    for (std::uint64_t i = 0; i < source->capacity; ++i) {
+        source->events[i].sequence.store(0, std::memory_order_relaxed);
+    }
+
+    std::FILE *file = std::fopen(outputPath.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "Не удалось записать трассу в %s\n", outputPath.c_str());
+        return false;
+    }
+    // Время в трассе — микросекунды от первого события
+    const std::int64_t origin = events.empty() ? 0 : events.front().start;
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    bool firstEntry = true;
+    {
+        std::lock_guard<std::mutex> namesLock(threadNamesMutex);
+        for (const auto &entry : threadNames) {
+            std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                         firstEntry ? "" : ",\n", entry.first);
+            writeEscaped(file, entry.second.c_str());
+            std::fputs("\"}}", file);
+            firstEntry = false;
+        }
+    }
+    for (const Copy &event : events) {
+        std::fprintf(file, "%s{\"name\":\"", firstEntry ? "" : ",\n");
+        writeEscaped(file, event.name);
+        std::fputs("\",\"cat\":\"", file);
+        writeEscaped(file, event.category);
+        std::fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                     event.thread, (event.start - origin) / 1000.0, event.duration / 1000.0);
+        if (event.value >= 0) {
+            std::fprintf(file, ",\"args\":{\"value\":%lld}", static_cast<long long>(event.value));
+        }
+        std::fputc('}', file);
+        firstEntry = false;
+    }
+    std::fputs("\n]}\n", file);
+    const bool ok = std::ferror(file) == 0;
+    return std::fclose(file) == 0 && ok;
+}
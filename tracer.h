@@ -0,0 +1,79 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Трасса работы программы в формате Chrome Trace Event: файл открывается в
+// chrome://tracing или ui.perfetto.dev, у каждого интервала есть поток, начало
+// и длительность.
+// Запись включается переменной окружения FUNCTION_PLOTTER_TRACE=<файл> (см.
+// startFromEnvironment) или вызовом start(). Пока она выключена, TraceScope
+// только читает один флаг.
+// События из всех потоков пишутся в кольцевой буфер без блокировок: место под
+// событие занимается атомарным счётчиком. При переполнении старые события
+// затираются, поэтому в файл попадает конец сессии — то, что было перед заминкой.
+class Tracer
+{
+public:
+    static constexpr int DefaultCapacity = 1 << 18;
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Начинает запись; stop() сохранит её в path. Буфер на capacity событий
+    // создаётся при первом запуске и дальше переиспользуется
+    static void start(const std::string &path, int capacity = DefaultCapacity);
+    // Включает запись, если задана переменная окружения FUNCTION_PLOTTER_TRACE
+    static void startFromEnvironment();
+    // Выключает запись и сохраняет трассу. Вызывать, когда остальные потоки
+    // уже ничего не записывают (например, при выходе из программы)
+    static bool stop();
+
+    // Имя текущего потока в трассе
+    static void setThreadName(const char *name);
+
+    // Монотонное время в наносекундах
+    static std::int64_t now();
+    // name и category должны жить до stop() — обычно это строковые литералы
+    static void record(const char *name, const char *category, std::int64_t startNs,
+                       std::int64_t durationNs, std::int64_t value);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+// Интервал от создания до уничтожения объекта:
+//   TraceScope trace("paintEvent", "paint");
+// value (например, число точек) попадает в args события, если не отрицательно
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, const char *category, std::int64_t value = -1)
+        : name(Tracer::isEnabled() ? name : nullptr), category(category), value(value)
+    {
+        if (this->name) {
+            start = Tracer::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (name) {
+            Tracer::record(name, category, start, Tracer::now() - start, value);
+        }
+    }
+
+    void setValue(std::int64_t newValue) { value = newValue; }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    const char *category;
+    std::int64_t value;
+    std::int64_t start = 0;
+};
+
+#endif // TRACER_H
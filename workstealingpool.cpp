@@ -0,0 +1,149 @@
+#include "workstealingpool.h"
+#include <algorithm>
+#include "tracer.h"
+
+namespace {
+// Пул и слот, которым принадлежит текущий рабочий поток
+thread_local WorkStealingPool *currentPool = nullptr;
+thread_local int currentSlot = -1;
+}
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+{
+    for (int i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsAvailable.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+WorkStealingPool &WorkStealingPool::instance()
+{
+    static WorkStealingPool pool(std::max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    return pool;
+}
+
+void WorkStealingPool::run(int taskCount, const std::function<void(int, int)> &task)
+{
+    if (taskCount <= 0) {
+        return;
+    }
+
+    // Рабочий поток этого пула сохраняет свой слот, внешний поток получает последний
+    const int slot = currentPool == this ? currentSlot : threadCount();
+
+    if (workers.empty() || taskCount == 1) {
+        for (int i = 0; i < taskCount; ++i) {
+            task(i, slot);
+        }
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->task = &task;
+    job->rangeCount = slotCount();
+    job->ranges.reset(new Range[job->rangeCount]);
+    // Изначально задачи делятся между участниками поровну
+    for (int r = 0; r < job->rangeCount; ++r) {
+        job->ranges[r].begin = static_cast<int>(static_cast<long long>(taskCount) * r / job->rangeCount);
+        job->ranges[r].end = static_cast<int>(static_cast<long long>(taskCount) * (r + 1) / job->rangeCount);
+    }
+    job->unclaimed = taskCount;
+    job->remaining = taskCount;
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back(job);
+    }
+    jobsAvailable.notify_all();
+
+    process(*job, slot);
+    removeJob(job);
+
+    // Ждём задачи, которые ещё выполняют другие потоки
+    std::unique_lock<std::mutex> lock(job->doneMutex);
+    job->done.wait(lock, [&job]() { return job->remaining.load() == 0; });
+}
+
+void WorkStealingPool::workerLoop(int slot)
+{
+    currentPool = this;
+    currentSlot = slot;
+    Tracer::setThreadName("WorkStealingPool");
+
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            job = jobs.front();
+        }
+        process(*job, slot);
+        removeJob(job);
+    }
+}
+
+void WorkStealingPool::process(Job &job, int slot)
+{
+    int index;
+    while (claim(job, slot, index)) {
+        (*job.task)(index, slot);
+        if (job.remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(job.doneMutex);
+            job.done.notify_all();
+        }
+    }
+}
+
+bool WorkStealingPool::claim(Job &job, int slot, int &index)
+{
+    if (job.unclaimed.load() <= 0) {
+        return false;
+    }
+
+    // Сначала своя очередь — с начала
+    const int own = slot % job.rangeCount;
+    {
+        Range &range = job.ranges[own];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin < range.end) {
+            index = range.begin++;
+            --job.unclaimed;
+            return true;
+        }
+    }
+
+    // Затем перехватываем задачи с конца чужих очередей
+    for (int i = 1; i < job.rangeCount; ++i) {
+        Range &range = job.ranges[(own + i) % job.rangeCount];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin < range.end) {
+            index = --range.end;
+            --job.unclaimed;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::removeJob(const std::shared_ptr<Job> &job)
+{
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    auto it = std::find(jobs.begin(), jobs.end(), job);
+    if (it != jobs.end()) {
+        jobs.erase(it);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом работы (work stealing) для параллельного вычисления точек.
+// Задание из taskCount независимых задач делится на диапазоны по числу участников;
+// каждый участник берёт задачи из начала своего диапазона, а закончив — забирает
+// задачи с конца чужих. Вызывающий поток тоже участвует в работе и получает
+// собственный номер слота, поэтому у каждой задачи есть номер слота, по которому
+// можно держать состояние «на поток» (например, копию парсера).
+class WorkStealingPool
+{
+public:
+    // threadCount — число рабочих потоков (без учёта вызывающего)
+    explicit WorkStealingPool(int threadCount);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // Общий пул приложения: по одному рабочему потоку на ядро, кроме вызывающего
+    static WorkStealingPool &instance();
+
+    int threadCount() const { return static_cast<int>(workers.size()); }
+    // Число различных слотов, которые могут прийти в задачу
+    int slotCount() const { return threadCount() + 1; }
+
+    // Выполняет task(index, slot) для index из [0, taskCount) и возвращает управление,
+    // когда все задачи завершены. Вызывающий поток выполняет только задачи своего
+    // задания, поэтому run можно вызывать и изнутри задачи.
+    void run(int taskCount, const std::function<void(int index, int slot)> &task);
+
+private:
+    struct Range {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+
+    struct Job {
+        const std::function<void(int, int)> *task = nullptr;
+        std::unique_ptr<Range[]> ranges;
+        int rangeCount = 0;
+        std::atomic<int> unclaimed{0};
+        std::atomic<int> remaining{0};
+        std::mutex doneMutex;
+        std::condition_variable done;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex jobsMutex;
+    std::condition_variable jobsAvailable;
+    std::vector<std::shared_ptr<Job>> jobs;
+    bool stopping = false;
+
+    void workerLoop(int slot);
+    // Забирает и выполняет задачи задания, пока они есть
+    void process(Job &job, int slot);
+    bool claim(Job &job, int slot, int &index);
+    void removeJob(const std::shared_ptr<Job> &job);
+};
+
+#endif // WORKSTEALINGPOOL_H